@@ -9,24 +9,30 @@ SavingsAccount and CheckingAccount both derive from BankAccount.
 They each add their own unique data (interestRate, overdraftLimit) and behaviors (applyInterest, overdraft logic).
 
 Polymorphism:
-Methods like withdraw and displayAccountInfo are declared virtual in the base class and overridden in the derived classes.
+Methods like displayAccountInfo are declared virtual in the base class and overridden in the derived classes.
 We can store both SavingsAccount and CheckingAccount objects in a container of BankAccount* and call their methods polymorphically.
+Transaction rules (withdraw limits, fees, overdraft, interest) are composed per product at compile time into a
+constexpr table that AccountOps reads by each row's AccountKind tag, so the transaction path has no virtual calls or dynamic_cast.
 
 Transaction Logging:
-Each deposit/withdraw adds an entry to a transactionHistory.
+Each deposit/withdraw appends an entry to the bank-wide Ledger, chained per account.
 We demonstrate some complexities where derived classes might need to call base class logic to ensure consistency and logging.
 
 Menu-Driven Interface:
 The main function presents a text-based menu to create new accounts, deposit/withdraw, display info, show transaction history, and exit.
 
+Persistence:
+Bank::saveSnapshot writes a versioned binary snapshot (account table plus ledger) in one sequential pass.
+Bank::loadSnapshot maps it and uses the columns and ledger segments in place, so startup does no per-record parsing.
+Bank::enableDurability adds a write-ahead log with group commit; recovery loads the snapshot and replays the log tail in parallel.
+
 Memory Management:
-Dynamic allocation (new) is used for accounts stored in the Bank class.
-The Bank destructor cleans them up.
+Accounts are constructed in per-type ObjectPools owned by the Bank class.
+Pools hand out stable pointers and release their slabs in bulk when the Bank is destroyed.
 
 What I want to modify later based on specific requirements:
 Enhance Input Validation: I might want more robust checks (e.g., negative overdraft, negative interest rate, etc.).
-File I/O: Save/load accounts to a file, so the data persists between runs.
-Refine Logging: Possibly add time stamps to transactions or separate them from the base class.
+Refine Logging: Possibly separate transaction logging from the base class.
 Improve Architecture: Split classes into .hpp/.cpp files, apply design patterns, or add user authentication, etc.
 */
 
@@ -41,408 +47,8730 @@ Improve Architecture: Split classes into .hpp/.cpp files, apply design patterns,
  *  - Basic Menu Interface for Testing
  *
  * Compile and run:
- *   g++ BankAccountSystem.cpp -o BankAccountSystem
+ *   g++ -std=c++17 -pthread BankAccountSystem.cpp -o BankAccountSystem
  *   ./BankAccountSystem
  ******************************************************/
 
  #include <iostream>
  #include <string>
  #include <vector>
+ #include <deque>
+ #include <unordered_map>  // for prepared cross-shard transfers
+ #include <memory>   // for unique_ptr
+ #include <functional>
+ #include <atomic>
+ #include <mutex>
+ #include <shared_mutex>
+ #include <condition_variable>
+ #include <thread>   // for this_thread::yield
+ #include <future>   // for OperationScheduler and TaskExecutor results
+ #include <algorithm>
+ #include <cstddef>  // for size_t
+ #include <cstdint>  // for fixed-width integers
+ #include <new>      // for placement new, operator new
+ #include <utility>  // for std::forward
+ #include <chrono>   // for timing batch runs
+ #include <cmath>    // for llround
+ #include <random>   // for load generator streams
+ #include <ctime>    // for gmtime, strftime
  #include <limits>   // for numeric_limits
  #include <iomanip>  // for setprecision, fixed
+ #include <sstream>  // for the metrics endpoint body
+ #include <cstdio>   // for snapshot writing
+ #include <cstring>  // for memcmp, memcpy
+ #include <cstdlib>  // for strtoull, malloc (benchmark build)
+ 
+ #if !defined(__unix__) && !defined(__APPLE__)
+ #error "BankAccountSystem needs a POSIX system (mmap, fsync, sockets); see requirements.txt"
+ #endif
+ #if !defined(__GNUC__)
+ #error "BankAccountSystem needs GCC or Clang (overflow builtins); see requirements.txt"
+ #endif
+ #include <fcntl.h>       // for open
+ #include <sys/mman.h>    // for mmap
+ #include <sys/stat.h>    // for fstat
+ #include <unistd.h>      // for close, write, fsync, fdatasync
+ #include <sys/socket.h>  // for the metrics endpoint
+ #include <netinet/in.h>  // for sockaddr_in
+ #include <arpa/inet.h>   // for htons, htonl
+ #include <poll.h>        // for poll
+ 
+ #if __cplusplus >= 202002L && defined(__has_include)
+ #if __has_include(<coroutine>)
+ #include <coroutine>     // for the async API (C++20 builds)
+ #endif
+ #endif
+ 
+ #if defined(__AVX2__)
+ #include <immintrin.h>
+ #elif defined(__ARM_NEON) && defined(__aarch64__)
+ #include <arm_neon.h>
+ #endif
+ 
+ /******************************************************
+  * Build-time money configuration
+  *  - BANK_MONEY_SCALE       : minor units per currency unit
+  *  - BANK_RATE_SCALE        : rate units per 1.0 (1e6 = ppm)
+  *  - BANK_INTEREST_ROUNDING : HalfEven, HalfAwayFromZero
+  *                             or TowardZero
+  ******************************************************/
+ #ifndef BANK_MONEY_SCALE
+ #define BANK_MONEY_SCALE 100
+ #endif
+ #ifndef BANK_RATE_SCALE
+ #define BANK_RATE_SCALE 1000000
+ #endif
+ #ifndef BANK_INTEREST_ROUNDING
+ #define BANK_INTEREST_ROUNDING HalfEven
+ #endif
+ 
+ enum class RoundingMode {
+     HalfEven,          // banker's rounding
+     HalfAwayFromZero,  // commercial rounding
+     TowardZero         // truncate
+ };
+ 
+ constexpr RoundingMode kInterestRounding = RoundingMode::BANK_INTEREST_ROUNDING;
+ 
+ // Widest integer available for intermediate products
+ #if defined(__SIZEOF_INT128__)
+ __extension__ typedef __int128 WideInt;
+ #else
+ typedef std::int64_t WideInt;  // products must then fit in 63 bits
+ #endif
+ 
+ // Divide a (possibly wide) product by d, rounding with the given mode
+ template <typename Int>
+ constexpr std::int64_t divideRounded(Int value, std::int64_t d, RoundingMode mode) {
+     Int q = value / d;
+     Int r = value % d;
+     Int twiceRem = 2 * (r < 0 ? -r : r);
+     if (mode != RoundingMode::TowardZero && r != 0) {
+         bool roundAway = twiceRem > d ||
+                          (twiceRem == d && (mode == RoundingMode::HalfAwayFromZero || (q & 1) != 0));
+         if (roundAway) {
+             q += value < 0 ? -1 : 1;
+         }
+     }
+     return static_cast<std::int64_t>(q);
+ }
+ 
+ constexpr bool isPowerOfTen(std::int64_t n) {
+     return n == 1 || (n % 10 == 0 && isPowerOfTen(n / 10));
+ }
+ 
+ /******************************************************
+  * FixedPoint - Exact decimal number in int64 units
+  *  - Scale units make up 1.0 (e.g. 100 -> cents)
+  *  - All arithmetic and compares are integer ops
+  *  - Operators wrap like int64; balances are credited
+  *    through tryAdd, which refuses a sum out of range
+  *  - fromDouble gives invalid() for NaN or out-of-range
+  *    input, which every operation rejects
+  ******************************************************/
+ template <std::int64_t Scale>
+ class FixedPoint {
+     static_assert(Scale >= 10 && isPowerOfTen(Scale), "FixedPoint scale must be a power of ten");
+ 
+ private:
+     std::int64_t units;
+ 
+     constexpr explicit FixedPoint(std::int64_t rawUnits) : units(rawUnits) {}
+ 
+ public:
+     static constexpr std::int64_t scale = Scale;
+ 
+     constexpr FixedPoint() : units(0) {}
+ 
+     static constexpr FixedPoint fromUnits(std::int64_t rawUnits) { return FixedPoint(rawUnits); }
+ 
+     // Nearest representable value (used for user input), or invalid() for NaN or out of range
+     static FixedPoint fromDouble(double value) {
+         double scaled = value * Scale;
+         const double limit = 9223372036854775808.0;  // 2^63
+         if (!(scaled > -limit && scaled < limit)) {
+             return invalid();
+         }
+         return FixedPoint(static_cast<std::int64_t>(std::llround(scaled)));
+     }
+ 
+     // Marks input that could not be represented; negative, so it fails every amount check
+     static constexpr FixedPoint invalid() { return FixedPoint(std::numeric_limits<std::int64_t>::min()); }
+     constexpr bool isValid() const { return units != std::numeric_limits<std::int64_t>::min(); }
+ 
+     // a + b into `sum`, or false (leaving `sum` unchanged) if it leaves the range
+     static bool tryAdd(FixedPoint a, FixedPoint b, FixedPoint &sum) {
+         std::int64_t total;
+         if (__builtin_add_overflow(a.units, b.units, &total) || total == std::numeric_limits<std::int64_t>::min()) {
+             return false;
+         }
+         sum.units = total;
+         return true;
+     }
+ 
+     constexpr std::int64_t raw() const { return units; }
+     constexpr double toDouble() const { return static_cast<double>(units) / Scale; }
+ 
+     constexpr FixedPoint operator+(FixedPoint o) const { return FixedPoint(units + o.units); }
+     constexpr FixedPoint operator-(FixedPoint o) const { return FixedPoint(units - o.units); }
+     constexpr FixedPoint operator-() const { return FixedPoint(-units); }
+     FixedPoint& operator+=(FixedPoint o) { units += o.units; return *this; }
+     FixedPoint& operator-=(FixedPoint o) { units -= o.units; return *this; }
+ 
+     constexpr bool operator==(FixedPoint o) const { return units == o.units; }
+     constexpr bool operator!=(FixedPoint o) const { return units != o.units; }
+     constexpr bool operator<(FixedPoint o) const { return units < o.units; }
+     constexpr bool operator<=(FixedPoint o) const { return units <= o.units; }
+     constexpr bool operator>(FixedPoint o) const { return units > o.units; }
+     constexpr bool operator>=(FixedPoint o) const { return units >= o.units; }
+ };
+ 
+ // Prints every decimal digit of the scale, independent of stream precision
+ template <std::int64_t Scale>
+ std::ostream& operator<<(std::ostream &os, FixedPoint<Scale> value) {
+     std::int64_t units = value.raw();
+     std::uint64_t mag = units < 0 ? 0 - static_cast<std::uint64_t>(units) : static_cast<std::uint64_t>(units);
+     std::string digits = std::to_string(mag % Scale);
+     int width = 0;
+     for (std::int64_t s = Scale; s > 1; s /= 10) {
+         ++width;
+     }
+     digits.insert(0, width - digits.size(), '0');
+     return os << (units < 0 ? "-" : "") << (mag / Scale) << '.' << digits;
+ }
+ 
+ typedef FixedPoint<BANK_MONEY_SCALE> Money;
+ typedef FixedPoint<BANK_RATE_SCALE> Rate;
+ 
+ // Interest on a balance, rounded with kInterestRounding; zero unless positive
+ constexpr Money applyRate(Money balance, Rate rate) {
+     WideInt product = static_cast<WideInt>(balance.raw()) * rate.raw();
+     if (product <= 0) {
+         return Money();
+     }
+     // Typical products fit in 64 bits, where the division by the constant scale becomes a multiply
+     return Money::fromUnits(product <= std::numeric_limits<std::int64_t>::max()
+         ? divideRounded(static_cast<std::int64_t>(product), Rate::scale, kInterestRounding)
+         : divideRounded(product, Rate::scale, kInterestRounding));
+ }
+ 
+ static_assert(sizeof(Money) == sizeof(std::int64_t), "Money columns are scanned as raw int64 lanes");
+ static_assert(applyRate(Money::fromUnits(12346), Rate::fromUnits(BANK_RATE_SCALE / 10)) == Money::fromUnits(kInterestRounding == RoundingMode::TowardZero ? 1234 : 1235),
+               "applyRate rounding self-check");
+ 
+ /******************************************************
+  * TransactionType - Kind of balance change (1 byte)
+  ******************************************************/
+ enum class TransactionType : std::uint8_t {
+     Deposit,
+     Withdrawal,
+     Interest,
+     TransferOut,  // debit leg of a transfer
+     TransferIn,   // credit leg of a transfer
+     Fee           // product fee charged with a withdrawal
+ };
+ 
+ inline const char* transactionTypeName(TransactionType type) {
+     switch (type) {
+         case TransactionType::Deposit:     return "Deposit";
+         case TransactionType::Withdrawal:  return "Withdrawal";
+         case TransactionType::Interest:    return "Interest";
+         case TransactionType::TransferOut: return "Transfer Out";
+         case TransactionType::TransferIn:  return "Transfer In";
+         case TransactionType::Fee:         return "Fee";
+     }
+     return "Unknown";
+ }
  
  /******************************************************
   * Transaction Structure
   *  - Logs each deposit/withdraw action on an account.
+  *  - Fixed 32-byte record with no heap-owned fields:
+  *      id               : bank-wide transaction id
+  *      stampAndType     : microseconds since the Unix epoch
+  *                         (high 56 bits) | type (low 8 bits)
+  *      amount           : amount moved
+  *      resultingBalance : balance after the change
   ******************************************************/
  struct Transaction {
-     std::string type;  // "Deposit" or "Withdrawal"
-     double amount;
-     double resultingBalance;
-     
-     Transaction(const std::string &t, double amt, double bal)
-         : type(t), amount(amt), resultingBalance(bal) {}
+     std::uint64_t id;
+     std::uint64_t stampAndType;
+     Money amount;
+     Money resultingBalance;
+ 
+     Transaction() : id(0), stampAndType(0) {}
+ 
+     Transaction(TransactionType t, Money amt, Money bal, std::uint64_t txId, std::int64_t micros)
+         : id(txId),
+           stampAndType((static_cast<std::uint64_t>(micros) << 8) | static_cast<std::uint8_t>(t)),
+           amount(amt), resultingBalance(bal) {}
+ 
+     TransactionType type() const { return static_cast<TransactionType>(stampAndType & 0xFF); }
+     std::int64_t timestampMicros() const { return static_cast<std::int64_t>(stampAndType >> 8); }
  };
  
+ static_assert(sizeof(Transaction) == 32, "Transaction records are packed to 32 bytes");
+ 
+ // Wall-clock time in microseconds since the Unix epoch
+ inline std::int64_t currentTimeMicros() {
+     return std::chrono::duration_cast<std::chrono::microseconds>(
+         std::chrono::system_clock::now().time_since_epoch()).count();
+ }
+ 
+ // Format a transaction timestamp as "YYYY-MM-DD HH:MM:SS" (UTC)
+ inline std::string formatTimestamp(std::int64_t micros) {
+     std::time_t seconds = static_cast<std::time_t>(micros / 1000000);
+     char buffer[32] = "";
+     if (const std::tm *utc = std::gmtime(&seconds)) {
+         std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", utc);
+     }
+     return buffer;
+ }
+ 
  /******************************************************
-  * BankAccount - Base Class
-  *
-  * Protected members:
-  *   accountHolder  : name of owner
-  *   accountNumber  : unique ID number
-  *   balance        : current account balance
-  *
-  * Private member:
-  *   transactionHistory: log of deposit/withdraw actions
+  * TxStatus - Outcome of an account or Bank operation
   ******************************************************/
- class BankAccount {
- protected:
-     std::string accountHolder;
-     int accountNumber;
-     double balance;
+ enum class TxStatus : std::uint8_t {
+     Ok,
+     AccountNotFound,
+     InvalidAmount,       // amount must be positive
+     InsufficientFunds,   // exceeds available balance
+     OverdraftExceeded,   // exceeds balance plus overdraft limit
+     SameAccount,         // transfer source and destination match
+     NotSavingsAccount,   // interest requested on an account whose product earns none
+     AccountExists,       // account number already in use
+     CapacityExceeded,    // account table is full
+     NotDurable,          // applied in memory, but the write-ahead log write failed
+     InvalidCursor,       // history cursor belongs to another account
+     UnknownTransfer,     // commit for a transfer this bank never prepared
+     DuplicateTransaction, // client transaction id already applied within the dedup window
+     WithdrawalLimitExceeded, // more than the product allows in one withdrawal
+     DailyLimitExceeded,   // more than the account's daily withdrawal limit
+     VelocityLimitExceeded, // more withdrawals within the velocity window than the account allows
+     BalanceOverflow       // the credit would take the balance beyond Money's range
+ };
+ 
+ inline const char* txStatusMessage(TxStatus status) {
+     switch (status) {
+         case TxStatus::Ok:                return "OK";
+         case TxStatus::AccountNotFound:   return "Account not found";
+         case TxStatus::InvalidAmount:     return "Amount must be positive";
+         case TxStatus::InsufficientFunds: return "Amount exceeds available balance";
+         case TxStatus::OverdraftExceeded: return "Amount exceeds overdraft limit";
+         case TxStatus::SameAccount:       return "Source and destination are the same account";
+         case TxStatus::NotSavingsAccount: return "Not a SavingsAccount";
+         case TxStatus::AccountExists:     return "Account already exists";
+         case TxStatus::CapacityExceeded:  return "Account table is full";
+         case TxStatus::NotDurable:        return "Change could not be written to the log";
+         case TxStatus::InvalidCursor:     return "History cursor does not belong to this account";
+         case TxStatus::UnknownTransfer:   return "Transfer was not prepared on this bank";
+         case TxStatus::DuplicateTransaction: return "Transaction ID was already used";
+         case TxStatus::WithdrawalLimitExceeded: return "Amount exceeds the per-withdrawal limit";
+         case TxStatus::DailyLimitExceeded: return "Amount exceeds the daily withdrawal limit";
+         case TxStatus::VelocityLimitExceeded: return "Too many withdrawals in a short time";
+         case TxStatus::BalanceOverflow:   return "Balance would exceed the largest supported amount";
+     }
+     return "Unknown";
+ }
+ 
+ /******************************************************
+  * TxResult - Status plus the amount actually moved
+  *  - Used where the amount is computed (e.g. interest)
+  ******************************************************/
+ struct TxResult {
+     TxStatus status;
+     Money amount;
+ 
+     bool ok() const { return status == TxStatus::Ok; }
+ };
+ 
+ /******************************************************
+  * LogSink - Asynchronous diagnostics writer
+  *  - Producers copy a fixed-size LogRecord into a bounded
+  *    lock-free ring (Vyukov MPMC cell sequencing) and
+  *    never block; when the ring is full the record is
+  *    dropped and counted
+  *  - One background thread formats and writes records,
+  *    so the stream is only touched off the hot path
+  *  - Destruction drains what is queued, then joins
+  ******************************************************/
+ enum class LogEvent : std::uint8_t {
+     AccountCreated,
+     Deposit,
+     Withdrawal,
+     Interest,
+     Transfer,
+     InterestRun
+ };
+ 
+ inline const char* logEventName(LogEvent event) {
+     switch (event) {
+         case LogEvent::AccountCreated: return "create";
+         case LogEvent::Deposit:        return "deposit";
+         case LogEvent::Withdrawal:     return "withdraw";
+         case LogEvent::Interest:       return "interest";
+         case LogEvent::Transfer:       return "transfer";
+         case LogEvent::InterestRun:    return "interest-run";
+     }
+     return "unknown";
+ }
+ 
+ struct LogRecord {
+     std::int64_t micros;
+     Money amount;
+     int account;
+     int otherAccount;  // transfer destination, otherwise unused
+     LogEvent event;
+     TxStatus status;
+ };
+ 
+ class LogSink {
+ public:
+     static constexpr std::size_t kCapacity = std::size_t(1) << 14;  // records; power of two
+ 
+ private:
+     struct Cell {
+         std::atomic<std::uint64_t> sequence;
+         LogRecord record;
+     };
+ 
+     std::unique_ptr<Cell[]> cells;
+     alignas(64) std::atomic<std::uint64_t> enqueuePos;
+     alignas(64) std::uint64_t dequeuePos;  // consumer thread only
+     std::atomic<std::uint64_t> droppedCount;
+     std::atomic<bool> stopping;
+     std::ostream &out;
+     std::thread worker;
+ 
+     bool pop(LogRecord &record) {
+         Cell &cell = cells[dequeuePos & (kCapacity - 1)];
+         if (cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+             return false;
+         }
+         record = cell.record;
+         cell.sequence.store(dequeuePos + kCapacity, std::memory_order_release);
+         ++dequeuePos;
+         return true;
+     }
+ 
+     void write(const LogRecord &r) {
+         out << "[" << formatTimestamp(r.micros) << " UTC] " << logEventName(r.event) << " #" << r.account;
+         if (r.event == LogEvent::Transfer) {
+             out << " -> #" << r.otherAccount;
+         }
+         out << " $" << r.amount << ": " << txStatusMessage(r.status) << "\n";
+     }
+ 
+     void drain() {
+         LogRecord record;
+         while (!stopping.load(std::memory_order_acquire)) {
+             if (pop(record)) {
+                 write(record);
+             } else {
+                 out.flush();
+                 std::this_thread::sleep_for(std::chrono::milliseconds(1));
+             }
+         }
+         while (pop(record)) {
+             write(record);
+         }
+         out.flush();
+     }
+ 
+ public:
+     explicit LogSink(std::ostream &stream)
+         : cells(new Cell[kCapacity]), enqueuePos(0), dequeuePos(0), droppedCount(0), stopping(false), out(stream) {
+         for (std::size_t i = 0; i < kCapacity; ++i) {
+             cells[i].sequence.store(i, std::memory_order_relaxed);
+         }
+         worker = std::thread(&LogSink::drain, this);
+     }
+ 
+     ~LogSink() {
+         stopping.store(true, std::memory_order_release);
+         worker.join();
+     }
+ 
+     LogSink(const LogSink&) = delete;
+     LogSink& operator=(const LogSink&) = delete;
+ 
+     // Queue a record without blocking; returns false (and counts a drop) when the ring is full
+     bool push(const LogRecord &record) {
+         std::uint64_t pos = enqueuePos.load(std::memory_order_relaxed);
+         for (;;) {
+             Cell &cell = cells[pos & (kCapacity - 1)];
+             std::uint64_t seq = cell.sequence.load(std::memory_order_acquire);
+             std::int64_t diff = static_cast<std::int64_t>(seq - pos);
+             if (diff == 0) {
+                 if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                     cell.record = record;
+                     cell.sequence.store(pos + 1, std::memory_order_release);
+                     return true;
+                 }
+             } else if (diff < 0) {
+                 droppedCount.fetch_add(1, std::memory_order_relaxed);
+                 return false;
+             } else {
+                 pos = enqueuePos.load(std::memory_order_relaxed);
+             }
+         }
+     }
+ 
+     std::uint64_t dropped() const {
+         return droppedCount.load(std::memory_order_relaxed);
+     }
+ };
+ 
+ /******************************************************
+  * SpinLock - Test-and-test-and-set lock
+  *  - One cache line each so neighbouring locks never share
+  *  - Yields after a short spin so a preempted holder can run
+  ******************************************************/
+ inline void cpuRelax() {
+ #if defined(__x86_64__) || defined(__i386__)
+     __builtin_ia32_pause();
+ #elif defined(__aarch64__)
+     asm volatile("yield");
+ #endif
+ }
  
+ class alignas(64) SpinLock {
  private:
-     // All deposits/withdrawals get logged here
-     std::vector<Transaction> transactionHistory;
+     std::atomic<bool> locked;
  
  public:
-     // Constructor
-     BankAccount(const std::string &holder, int number, double initialBalance)
-         : accountHolder(holder), accountNumber(number), balance(initialBalance) {}
+     SpinLock() : locked(false) {}
  
-     // Virtual destructor for proper cleanup of derived objects
-     virtual ~BankAccount() {}
+     void lock() {
+         for (unsigned spins = 0; locked.exchange(true, std::memory_order_acquire); ) {
+             while (locked.load(std::memory_order_relaxed)) {
+                 if (++spins < 64) {
+                     cpuRelax();
+                 } else {
+                     std::this_thread::yield();
+                 }
+             }
+         }
+     }
  
-     // Deposit with logging
-     virtual void deposit(double amount) {
-         if (amount > 0) {
-             balance += amount;
-             transactionHistory.emplace_back("Deposit", amount, balance);
-         } else {
-             std::cout << "[Deposit Error] Amount must be positive.\n";
+     bool try_lock() {
+         return !locked.load(std::memory_order_relaxed) && !locked.exchange(true, std::memory_order_acquire);
+     }
+ 
+     void unlock() {
+         locked.store(false, std::memory_order_release);
+     }
+ };
+ 
+ // Per-thread shard for sharded counters: threads are numbered round-robin on first use,
+ // so up to kThreadShards threads never share a shard (beyond that, shards are shared)
+ constexpr std::size_t kThreadShards = 64;
+ 
+ inline std::size_t threadShard() {
+     static std::atomic<std::size_t> nextShard{0};
+     thread_local std::size_t shard = kThreadShards;  // constant-initialized: no TLS init guard on the hot path
+     if (shard == kThreadShards) {
+         shard = nextShard.fetch_add(1, std::memory_order_relaxed) % kThreadShards;
+     }
+     return shard;
+ }
+ 
+ // Flush a file's data to stable storage. fdatasync skips metadata the data doesn't
+ // need; macOS lacks it, and there only F_FULLFSYNC gets past the drive's write cache
+ inline bool syncFileData(int fd) {
+ #if defined(__APPLE__)
+     return ::fcntl(fd, F_FULLFSYNC) == 0 || ::fsync(fd) == 0;
+ #else
+     return ::fdatasync(fd) == 0;
+ #endif
+ }
+ 
+ // Same, including metadata
+ inline bool syncFile(int fd) {
+ #if defined(__APPLE__)
+     return ::fcntl(fd, F_FULLFSYNC) == 0 || ::fsync(fd) == 0;
+ #else
+     return ::fsync(fd) == 0;
+ #endif
+ }
+ 
+ // Flush the directory entry of `path` (after creating or renaming it) so the name
+ // survives a crash along with the contents
+ inline bool syncParentDirectory(const std::string &path) {
+     std::string::size_type slash = path.find_last_of('/');
+     std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+     int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+     if (fd < 0) {
+         return false;
+     }
+     bool ok = syncFile(fd);
+     ::close(fd);
+     return ok;
+ }
+ 
+ /******************************************************
+  * WriteAheadLog - Durable journal with group commit
+  *  - Every ledger record, account creation and limit
+  *    change is framed
+  *    (length, FNV-1a checksum, payload) and copied into
+  *    an in-memory group under a short mutex
+  *  - A committer thread waits up to the commit latency
+  *    budget for more records to join, then issues one
+  *    write + fdatasync for the whole group
+  *  - Positions are byte counts: callers wait until
+  *    durablePosition() reaches what they appended
+  *  - A torn or corrupt tail frame ends recovery there
+  *  - The header carries a generation; a checkpoint bumps
+  *    it, so a log older than the snapshot is ignored
+  ******************************************************/
+ enum class WalRecord : std::uint8_t {
+     Entries = 1,        // count, then (row, Transaction) pairs
+     AccountCreated = 2, // row, number, kind, balance, rate, limit, holder
+     Accrual = 3,        // row, epoch, count (0 or 1), then that many (row, Transaction) pairs
+     InterestEpoch = 4,  // epoch: an interest period closed
+     Limits = 5          // row, daily limit, debits per window, ledger sequence when set
+ };
+ 
+ class WriteAheadLog {
+ public:
+     struct Entry {
+         std::uint32_t row;
+         Transaction tx;
+     };
+ 
+     // A savings row settled up to `epoch`, with its Interest record if any was credited
+     struct Accrual {
+         std::uint32_t row;
+         std::uint32_t epoch;
+     };
+ 
+     struct Creation {
+         std::uint32_t row;
+         int number;
+         std::uint8_t kind;
+         std::int64_t balance;  // raw Money units
+         std::int64_t rate;     // raw Rate units
+         std::int64_t limit;    // raw Money units
+         std::string holder;
+     };
+ 
+     // New withdrawal limits of a row; debits logged after `sinceSequence` count toward them
+     struct LimitChange {
+         std::uint32_t row;
+         std::int64_t dailyLimit;  // raw Money units
+         std::uint32_t perWindow;
+         std::uint64_t sinceSequence;
+     };
+ 
+     static constexpr char kMagic[8] = {'B', 'A', 'N', 'K', 'W', 'A', 'L', '1'};
+     static constexpr std::size_t kHeaderBytes = 24;  // magic, money scale, generation
+     static constexpr std::size_t kGroupBytes = std::size_t(1) << 20;  // commit early past this
+ 
+ private:
+     int fd;
+     std::mutex mutex;
+     std::condition_variable workReady;     // committer waits for records
+     std::condition_variable durableReady;  // appenders wait for their group
+     std::vector<char> pending;
+     std::uint64_t appended;                // bytes accepted so far
+     std::uint64_t durable;                 // bytes written and synced so far
+     bool committing;
+     bool stopping;
+     bool failed;
+     std::chrono::microseconds commitLatency;
+     std::thread committer;
+ 
+     // Callbacks waiting for a position: a min-heap on position (see whenDurable)
+     struct DurableCallback {
+         std::uint64_t position;
+         std::function<void(bool)> callback;
+         bool operator>(const DurableCallback &o) const { return position > o.position; }
+     };
+     std::vector<DurableCallback> callbacks;
+ 
+     // Run the callbacks whose position is now durable, outside the mutex (mutex held on entry and exit)
+     void releaseCallbacks(std::unique_lock<std::mutex> &lock) {
+         std::vector<std::function<void(bool)>> ready;
+         while (!callbacks.empty() && callbacks.front().position <= durable) {
+             std::pop_heap(callbacks.begin(), callbacks.end(), std::greater<DurableCallback>());
+             ready.push_back(std::move(callbacks.back().callback));
+             callbacks.pop_back();
+         }
+         if (ready.empty()) {
+             return;
+         }
+         bool ok = !failed;
+         lock.unlock();
+         for (auto &callback : ready) {
+             callback(ok);
+         }
+         lock.lock();
+     }
+ 
+     static std::uint32_t checksum(const char *data, std::size_t bytes) {
+         std::uint32_t hash = 2166136261u;
+         for (std::size_t i = 0; i < bytes; ++i) {
+             hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+         }
+         return hash;
+     }
+ 
+     static bool writeHeader(int fd, std::uint64_t generation) {
+         char header[kHeaderBytes];
+         std::int64_t scale = Money::scale;
+         std::memcpy(header, kMagic, sizeof(kMagic));
+         std::memcpy(header + 8, &scale, sizeof(scale));
+         std::memcpy(header + 16, &generation, sizeof(generation));
+         return writeAll(fd, header, sizeof(header)) && syncFileData(fd);
+     }
+ 
+     static bool writeAll(int fd, const char *data, std::size_t bytes) {
+         while (bytes > 0) {
+             ssize_t n = ::write(fd, data, bytes);
+             if (n < 0) {
+                 return false;
+             }
+             data += n;
+             bytes -= static_cast<std::size_t>(n);
+         }
+         return true;
+     }
+ 
+     template <typename T>
+     static void put(std::vector<char> &out, const T &value) {
+         const char *bytes = reinterpret_cast<const char*>(&value);
+         out.insert(out.end(), bytes, bytes + sizeof(T));
+     }
+ 
+     // Frame `payload` into the pending group; returns the position after it (mutex held)
+     std::uint64_t enqueue(const std::vector<char> &payload) {
+         bool wasEmpty = pending.empty();
+         std::uint32_t bytes = static_cast<std::uint32_t>(payload.size());
+         put(pending, bytes);
+         put(pending, checksum(payload.data(), payload.size()));
+         pending.insert(pending.end(), payload.begin(), payload.end());
+         appended += sizeof(std::uint32_t) * 2 + payload.size();
+         if (wasEmpty || pending.size() >= kGroupBytes) {
+             workReady.notify_one();
+         }
+         return appended;
+     }
+ 
+     void commitLoop() {
+         std::unique_lock<std::mutex> lock(mutex);
+         for (;;) {
+             workReady.wait(lock, [this] { return stopping || !pending.empty(); });
+             if (pending.empty()) {
+                 break;  // stopping with nothing left
+             }
+             // Let more records join this group, up to the latency budget
+             workReady.wait_for(lock, commitLatency, [this] { return stopping || pending.size() >= kGroupBytes; });
+ 
+             std::vector<char> group;
+             group.swap(pending);
+             std::uint64_t target = appended;
+             committing = true;
+             lock.unlock();
+             bool ok = writeAll(fd, group.data(), group.size()) && syncFileData(fd);
+             lock.lock();
+             committing = false;
+             failed = failed || !ok;
+             durable = target;
+             durableReady.notify_all();
+             releaseCallbacks(lock);
+         }
+     }
+ 
+ public:
+     WriteAheadLog()
+         : fd(-1), appended(0), durable(0), committing(false), stopping(false), failed(false),
+           commitLatency(1000) {}
+ 
+     ~WriteAheadLog() {
+         if (committer.joinable()) {
+             {
+                 std::lock_guard<std::mutex> guard(mutex);
+                 stopping = true;
+             }
+             workReady.notify_one();
+             committer.join();
+         }
+         if (fd >= 0) {
+             ::close(fd);
+         }
+     }
+ 
+     WriteAheadLog(const WriteAheadLog&) = delete;
+     WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+ 
+     // Create (or truncate) the log at `path` and start the committer
+     bool open(const std::string &path, std::uint64_t generation, std::chrono::microseconds latency) {
+         fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+         if (fd < 0 || !writeHeader(fd, generation) || !syncParentDirectory(path)) {
+             return false;
+         }
+         commitLatency = latency;
+         committer = std::thread(&WriteAheadLog::commitLoop, this);
+         return true;
+     }
+ 
+     // Journal ledger records; called with the records' account locks held
+     std::uint64_t appendEntries(const Entry *entries, std::size_t count) {
+         std::vector<char> payload;
+         payload.reserve(2 + count * sizeof(Entry));
+         payload.push_back(static_cast<char>(WalRecord::Entries));
+         payload.push_back(static_cast<char>(count));
+         for (std::size_t i = 0; i < count; ++i) {
+             put(payload, entries[i].row);
+             put(payload, entries[i].tx);
+         }
+         std::lock_guard<std::mutex> guard(mutex);
+         return enqueue(payload);
+     }
+ 
+     // Journal a lazy-interest settlement (and its record, if `entry` is non-null) as one
+     // frame, so recovery never sees the credit without the epoch or the reverse
+     std::uint64_t appendAccrual(const Accrual &accrual, const Entry *entry) {
+         std::vector<char> payload;
+         payload.push_back(static_cast<char>(WalRecord::Accrual));
+         put(payload, accrual.row);
+         put(payload, accrual.epoch);
+         payload.push_back(static_cast<char>(entry ? 1 : 0));
+         if (entry) {
+             put(payload, entry->row);
+             put(payload, entry->tx);
          }
+         std::lock_guard<std::mutex> guard(mutex);
+         return enqueue(payload);
+     }
+ 
+     std::uint64_t appendInterestEpoch(std::uint32_t epoch) {
+         std::vector<char> payload;
+         payload.push_back(static_cast<char>(WalRecord::InterestEpoch));
+         put(payload, epoch);
+         std::lock_guard<std::mutex> guard(mutex);
+         return enqueue(payload);
+     }
+ 
+     // Journal a limit change; called with the row's lock held
+     std::uint64_t appendLimits(const LimitChange &l) {
+         std::vector<char> payload;
+         payload.push_back(static_cast<char>(WalRecord::Limits));
+         put(payload, l.row);
+         put(payload, l.dailyLimit);
+         put(payload, l.perWindow);
+         put(payload, l.sinceSequence);
+         std::lock_guard<std::mutex> guard(mutex);
+         return enqueue(payload);
      }
  
-     // Virtual withdraw with logging; overrides in derived classes may add custom behavior
-     virtual void withdraw(double amount) {
-         if (amount <= 0) {
-             std::cout << "[Withdraw Error] Amount must be positive.\n";
+     // Journal an account creation; called with the Bank's creation mutex held
+     std::uint64_t appendCreation(const Creation &c) {
+         std::vector<char> payload;
+         payload.push_back(static_cast<char>(WalRecord::AccountCreated));
+         put(payload, c.row);
+         put(payload, c.number);
+         put(payload, c.kind);
+         put(payload, c.balance);
+         put(payload, c.rate);
+         put(payload, c.limit);
+         put(payload, static_cast<std::uint32_t>(c.holder.size()));
+         payload.insert(payload.end(), c.holder.begin(), c.holder.end());
+         std::lock_guard<std::mutex> guard(mutex);
+         return enqueue(payload);
+     }
+ 
+     std::uint64_t appendedPosition() {
+         std::lock_guard<std::mutex> guard(mutex);
+         return appended;
+     }
+ 
+     // Block until everything up to `position` is on disk; false if a write failed
+     bool waitDurable(std::uint64_t position) {
+         std::unique_lock<std::mutex> lock(mutex);
+         durableReady.wait(lock, [this, position] { return durable >= position; });
+         return !failed;
+     }
+ 
+     // Non-blocking form: call `callback(ok)` once everything up to `position` is on disk,
+     // from the committer thread (or right away, on this thread, if it already is)
+     void whenDurable(std::uint64_t position, std::function<void(bool)> callback) {
+         std::unique_lock<std::mutex> lock(mutex);
+         if (durable >= position) {
+             bool ok = !failed;
+             lock.unlock();
+             callback(ok);
              return;
          }
+         callbacks.push_back(DurableCallback{position, std::move(callback)});
+         std::push_heap(callbacks.begin(), callbacks.end(), std::greater<DurableCallback>());
+     }
+ 
+     // Drop every record (they are covered by a checkpoint just taken, with no appends
+     // in flight), restart as `generation` and release the records' waiters
+     bool reset(std::uint64_t generation) {
+         std::unique_lock<std::mutex> lock(mutex);
+         durableReady.wait(lock, [this] { return !committing; });
+         pending.clear();
+         bool ok = ::ftruncate(fd, 0) == 0 && writeHeader(fd, generation);
+         failed = failed || !ok;
+         durable = appended;
+         durableReady.notify_all();
+         releaseCallbacks(lock);
+         return ok;
+     }
+ 
+     // Recovery: read every intact frame of the log at `path`, in order. The callbacks
+     // return false to stop; an accrual's record goes to `onEntries` after `onAccrual`, and
+     // a closed interest period arrives as onAccrual({kNoRow, epoch}). Returns false if the
+     // file is missing, foreign or of another generation.
+     static constexpr std::uint32_t kNoRow = std::numeric_limits<std::uint32_t>::max();
+     static bool replay(const std::string &path, std::uint64_t generation,
+                        const std::function<bool(const std::vector<Entry>&)> &onEntries,
+                        const std::function<bool(const Creation&)> &onCreation,
+                        const std::function<bool(const Accrual&)> &onAccrual,
+                        const std::function<bool(const LimitChange&)> &onLimits) {
+         std::FILE *file = std::fopen(path.c_str(), "rb");
+         if (!file) {
+             return false;
+         }
+         std::vector<char> data;
+         char buffer[1 << 16];
+         for (std::size_t n; (n = std::fread(buffer, 1, sizeof(buffer), file)) > 0; ) {
+             data.insert(data.end(), buffer, buffer + n);
+         }
+         std::fclose(file);
+ 
+         std::int64_t scale = 0;
+         std::uint64_t fileGeneration = 0;
+         if (data.size() < kHeaderBytes || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+             return false;
+         }
+         std::memcpy(&scale, data.data() + 8, sizeof(scale));
+         std::memcpy(&fileGeneration, data.data() + 16, sizeof(fileGeneration));
+         if (scale != Money::scale || fileGeneration != generation) {
+             return false;
+         }
+ 
+         std::vector<Entry> entries;
+         for (std::size_t at = kHeaderBytes; at + 8 <= data.size(); ) {
+             std::uint32_t bytes, sum;
+             std::memcpy(&bytes, &data[at], sizeof(bytes));
+             std::memcpy(&sum, &data[at + 4], sizeof(sum));
+             const char *payload = data.data() + at + 8;
+             if (bytes == 0 || at + 8 + bytes > data.size() || checksum(payload, bytes) != sum) {
+                 break;  // torn tail
+             }
+             at += 8 + bytes;
+ 
+             const char *p = payload + 1;
+             if (payload[0] == static_cast<char>(WalRecord::Entries) && bytes >= 2) {
+                 std::size_t count = static_cast<unsigned char>(payload[1]);
+                 if (bytes != 2 + count * (sizeof(std::uint32_t) + sizeof(Transaction))) {
+                     break;
+                 }
+                 p = payload + 2;
+                 entries.resize(count);
+                 for (Entry &e : entries) {
+                     std::memcpy(&e.row, p, sizeof(e.row));
+                     std::memcpy(&e.tx, p + sizeof(e.row), sizeof(e.tx));
+                     p += sizeof(e.row) + sizeof(e.tx);
+                 }
+                 if (!onEntries(entries)) {
+                     break;
+                 }
+             } else if (payload[0] == static_cast<char>(WalRecord::AccountCreated)) {
+                 Creation c;
+                 std::uint32_t holderBytes = 0;
+                 const std::size_t fixed = 1 + sizeof(c.row) + sizeof(c.number) + sizeof(c.kind)
+                                         + 3 * sizeof(std::int64_t) + sizeof(holderBytes);
+                 if (bytes < fixed) {
+                     break;
+                 }
+                 std::memcpy(&c.row, p, sizeof(c.row));         p += sizeof(c.row);
+                 std::memcpy(&c.number, p, sizeof(c.number));   p += sizeof(c.number);
+                 std::memcpy(&c.kind, p, sizeof(c.kind));       p += sizeof(c.kind);
+                 std::memcpy(&c.balance, p, sizeof(c.balance)); p += sizeof(c.balance);
+                 std::memcpy(&c.rate, p, sizeof(c.rate));       p += sizeof(c.rate);
+                 std::memcpy(&c.limit, p, sizeof(c.limit));     p += sizeof(c.limit);
+                 std::memcpy(&holderBytes, p, sizeof(holderBytes)); p += sizeof(holderBytes);
+                 if (bytes != fixed + holderBytes) {
+                     break;
+                 }
+                 c.holder.assign(p, holderBytes);
+                 if (!onCreation(c)) {
+                     break;
+                 }
+             } else if (payload[0] == static_cast<char>(WalRecord::Accrual)) {
+                 Accrual a;
+                 const std::size_t fixed = 1 + sizeof(a.row) + sizeof(a.epoch) + 1;
+                 if (bytes < fixed) {
+                     break;
+                 }
+                 std::memcpy(&a.row, p, sizeof(a.row));     p += sizeof(a.row);
+                 std::memcpy(&a.epoch, p, sizeof(a.epoch)); p += sizeof(a.epoch);
+                 std::size_t count = static_cast<unsigned char>(*p++);
+                 if (count > 1 || bytes != fixed + count * (sizeof(std::uint32_t) + sizeof(Transaction))) {
+                     break;
+                 }
+                 if (!onAccrual(a)) {
+                     break;
+                 }
+                 if (count == 1) {
+                     entries.resize(1);
+                     std::memcpy(&entries[0].row, p, sizeof(entries[0].row));
+                     std::memcpy(&entries[0].tx, p + sizeof(entries[0].row), sizeof(entries[0].tx));
+                     if (!onEntries(entries)) {
+                         break;
+                     }
+                 }
+             } else if (payload[0] == static_cast<char>(WalRecord::InterestEpoch)) {
+                 Accrual a{kNoRow, 0};
+                 if (bytes != 1 + sizeof(a.epoch)) {
+                     break;
+                 }
+                 std::memcpy(&a.epoch, p, sizeof(a.epoch));
+                 if (!onAccrual(a)) {
+                     break;
+                 }
+             } else if (payload[0] == static_cast<char>(WalRecord::Limits)) {
+                 LimitChange l;
+                 if (bytes != 1 + sizeof(l.row) + sizeof(l.dailyLimit) + sizeof(l.perWindow) + sizeof(l.sinceSequence)) {
+                     break;
+                 }
+                 std::memcpy(&l.row, p, sizeof(l.row));                     p += sizeof(l.row);
+                 std::memcpy(&l.dailyLimit, p, sizeof(l.dailyLimit));       p += sizeof(l.dailyLimit);
+                 std::memcpy(&l.perWindow, p, sizeof(l.perWindow));         p += sizeof(l.perWindow);
+                 std::memcpy(&l.sinceSequence, p, sizeof(l.sinceSequence));
+                 if (!onLimits(l)) {
+                     break;
+                 }
+             } else {
+                 break;
+             }
+         }
+         return true;
+     }
+ };
+ 
+ /******************************************************
+  * ColdHistory - Compressed tier for ledger segments
+  *   evicted from memory
+  *  - Records are packed in frames of kFrameRecords, one
+  *    column after another: id (as the gap from its
+  *    sequence), timestamp delta, type (a nibble),
+  *    amount, resulting balance, previous-record link
+  *    (as the gap back) and account row; every number a
+  *    zigzag varint. Typical records take 12-16 bytes,
+  *    against 44 in a hot segment
+  *  - Encoded frames stay in memory, or are appended to
+  *    a spill file (truncated on open) and read back
+  *    with pread; the index keeps 32 bytes per frame
+  *  - Reading decodes one whole frame; HistoryRange keeps
+  *    the last one, so a walk through nearby records
+  *    decodes each frame once
+  *  - Segments are added oldest first; nothing is ever
+  *    removed, and nothing is persisted in snapshots
+  *
+  * Thread safety:
+  *  - prepare() and frame() may overlap; publish() must
+  *    not overlap frame(). The Ledger prepares under its
+  *    open lock and publishes under its eviction lock
+  ******************************************************/
+ class ColdHistory {
+ public:
+     static constexpr std::size_t kFrameRecords = 128;
+ 
+     // One decoded frame: records [firstSeq, firstSeq + count)
+     struct Frame {
+         std::uint64_t firstSeq = 0;
+         std::size_t count = 0;
+         Transaction records[kFrameRecords];
+         std::uint64_t prevForAccount[kFrameRecords];
+         std::uint32_t accountRow[kFrameRecords];
+ 
+         bool holds(std::uint64_t seq) const { return seq >= firstSeq && seq - firstSeq < count; }
+         const Transaction& at(std::uint64_t seq) const { return records[seq - firstSeq]; }
+         std::uint64_t previous(std::uint64_t seq) const { return prevForAccount[seq - firstSeq]; }
+         std::uint32_t rowOf(std::uint64_t seq) const { return accountRow[seq - firstSeq]; }
+     };
+ 
+ private:
+     struct FrameRef {
+         std::uint64_t firstSeq;
+         std::uint64_t offset;   // into its chunk, or into the spill file
+         std::uint32_t length;
+         std::uint32_t count;
+         std::uint32_t chunk;    // index in `chunks` (in-memory tier)
+     };
+ 
+     std::vector<FrameRef> frames;   // ascending firstSeq, contiguous
+     std::vector<std::unique_ptr<char[]>> chunks;  // encoded frames of one add() each (in-memory tier)
+     std::uint64_t storedBytes;
+     std::size_t storedRecords;
+     int fd;                         // spill file, or -1 for the in-memory tier
+     bool failed;                    // a spill write failed; later segments are dropped
+ 
+     static std::uint64_t zigzag(std::int64_t v) {
+         return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63);
+     }
+     static std::int64_t unzigzag(std::uint64_t v) {
+         return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+     }
+ 
+     static constexpr std::size_t kMaxVarint = 10;
+     static constexpr std::size_t kMaxRecordBytes = 6 * kMaxVarint + 1;  // six varints and a type nibble
+ 
+     static void putVarint(char *&p, std::uint64_t v) {
+         while (v >= 0x80) {
+             *p++ = static_cast<char>(v | 0x80);
+             v >>= 7;
+         }
+         *p++ = static_cast<char>(v);
+     }
+ 
+     // Read one varint; false past `end` (a damaged frame)
+     static bool getVarint(const unsigned char *&p, const unsigned char *end, std::uint64_t &v) {
+         if (p < end && *p < 0x80) {
+             v = *p++;  // most gaps and links fit one byte
+             return true;
+         }
+         v = 0;
+         for (unsigned shift = 0; shift < 64 && p < end; shift += 7) {
+             unsigned char byte = *p++;
+             v |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+             if (!(byte & 0x80)) {
+                 return true;
+             }
+         }
+         return false;
+     }
+ 
+     // Write one frame at `out` (room for kMaxRecordBytes per record); returns its end
+     static char* encode(char *out, std::uint64_t firstSeq, const Transaction *records,
+                         const std::uint64_t *prev, const std::uint32_t *rows, std::size_t count) {
+         for (std::size_t i = 0; i < count; ++i) {
+             putVarint(out, zigzag(static_cast<std::int64_t>(records[i].id - (firstSeq + i))));
+         }
+         std::int64_t lastMicros = 0;
+         for (std::size_t i = 0; i < count; ++i) {
+             putVarint(out, zigzag(records[i].timestampMicros() - lastMicros));
+             lastMicros = records[i].timestampMicros();
+         }
+         for (std::size_t i = 0; i < count; i += 2) {
+             unsigned low = static_cast<unsigned>(records[i].type());
+             unsigned high = i + 1 < count ? static_cast<unsigned>(records[i + 1].type()) : 0;
+             *out++ = static_cast<char>(low | (high << 4));
+         }
+         for (std::size_t i = 0; i < count; ++i) {
+             putVarint(out, zigzag(records[i].amount.raw()));
+         }
+         for (std::size_t i = 0; i < count; ++i) {
+             putVarint(out, zigzag(records[i].resultingBalance.raw()));
+         }
+         for (std::size_t i = 0; i < count; ++i) {
+             // 0 marks the start of the chain (Ledger::kNoRecord); links always point back
+             putVarint(out, prev[i] == 0 ? 0 : firstSeq + i - prev[i]);
+         }
+         for (std::size_t i = 0; i < count; ++i) {
+             putVarint(out, rows[i]);
+         }
+         return out;
+     }
+ 
+     static bool decode(const unsigned char *p, const unsigned char *end, Frame &frame) {
+         std::uint64_t v;
+         std::uint64_t ids[kFrameRecords];
+         std::int64_t micros[kFrameRecords];
+         std::int64_t amounts[kFrameRecords];
+         std::size_t n = frame.count;
+         for (std::size_t i = 0; i < n; ++i) {
+             if (!getVarint(p, end, v)) {
+                 return false;
+             }
+             ids[i] = frame.firstSeq + i + static_cast<std::uint64_t>(unzigzag(v));
+         }
+         std::int64_t lastMicros = 0;
+         for (std::size_t i = 0; i < n; ++i) {
+             if (!getVarint(p, end, v)) {
+                 return false;
+             }
+             micros[i] = lastMicros += unzigzag(v);
+         }
+         const unsigned char *types = p;
+         if (static_cast<std::size_t>(end - p) < (n + 1) / 2) {
+             return false;
+         }
+         p += (n + 1) / 2;
+         for (std::size_t i = 0; i < n; ++i) {
+             if (!getVarint(p, end, v)) {
+                 return false;
+             }
+             amounts[i] = unzigzag(v);
+         }
+         for (std::size_t i = 0; i < n; ++i) {
+             if (!getVarint(p, end, v)) {
+                 return false;
+             }
+             TransactionType type = static_cast<TransactionType>((types[i / 2] >> (i % 2 * 4)) & 0x0F);
+             frame.records[i] = Transaction(type, Money::fromUnits(amounts[i]), Money::fromUnits(unzigzag(v)), ids[i], micros[i]);
+         }
+         for (std::size_t i = 0; i < n; ++i) {
+             if (!getVarint(p, end, v)) {
+                 return false;
+             }
+             frame.prevForAccount[i] = v == 0 ? 0 : frame.firstSeq + i - v;
+         }
+         for (std::size_t i = 0; i < n; ++i) {
+             if (!getVarint(p, end, v)) {
+                 return false;
+             }
+             frame.accountRow[i] = static_cast<std::uint32_t>(v);
+         }
+         return true;
+     }
+ 
+ public:
+     ColdHistory() : storedBytes(0), storedRecords(0), fd(-1), failed(false) {}
+ 
+     ~ColdHistory() {
+         if (fd >= 0) {
+             ::close(fd);
+         }
+     }
+ 
+     ColdHistory(const ColdHistory&) = delete;
+     ColdHistory& operator=(const ColdHistory&) = delete;
+ 
+     // Keep encoded frames in a file at `path` (created or truncated) instead of in memory
+     bool openSpillFile(const std::string &path) {
+         fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+         return fd >= 0;
+     }
+ 
+     // A segment encoded by prepare(), not yet visible to readers
+     class Batch {
+         friend class ColdHistory;
+         std::vector<FrameRef> frames;
+         std::unique_ptr<char[]> chunk;  // in-memory tier
+         std::uint64_t bytes = 0;
+         std::size_t records = 0;
+     };
+ 
+     // Encode `count` finished records starting at sequence `firstSeq` (after every segment
+     // added so far) and, for a spill file, write them out. Readers may run meanwhile; each
+     // prepare() must be followed by its publish() before the next one.
+     Batch prepare(std::uint64_t firstSeq, const Transaction *records, const std::uint64_t *prev,
+                   const std::uint32_t *rows, std::size_t count) const {
+         Batch batch;
+         if (failed || (!frames.empty() && firstSeq < frames.back().firstSeq + frames.back().count)) {
+             return batch;
+         }
+         std::unique_ptr<char[]> scratch(new char[count * kMaxRecordBytes]);
+         char *end = scratch.get();
+         std::uint64_t base = fd >= 0 ? storedBytes : 0;
+         std::uint32_t chunk = static_cast<std::uint32_t>(chunks.size());
+         for (std::size_t i = 0; i < count; i += kFrameRecords) {
+             std::size_t n = count - i < kFrameRecords ? count - i : kFrameRecords;
+             char *start = end;
+             end = encode(start, firstSeq + i, records + i, prev + i, rows + i, n);
+             batch.frames.push_back(FrameRef{firstSeq + i, base + static_cast<std::uint64_t>(start - scratch.get()),
+                                             static_cast<std::uint32_t>(end - start), static_cast<std::uint32_t>(n), chunk});
+         }
+         std::size_t size = static_cast<std::size_t>(end - scratch.get());
+         if (fd < 0) {
+             batch.chunk.reset(new char[size]);
+             std::memcpy(batch.chunk.get(), scratch.get(), size);
+         } else {
+             const char *data = scratch.get();
+             std::size_t left = size;
+             off_t at = static_cast<off_t>(storedBytes);
+             while (left > 0) {
+                 ssize_t n = ::pwrite(fd, data, left, at);
+                 if (n <= 0) {
+                     batch.frames.clear();  // dropped; publish() marks the tier failed
+                     batch.records = count;
+                     return batch;
+                 }
+                 data += n;
+                 left -= static_cast<std::size_t>(n);
+                 at += n;
+             }
+         }
+         batch.bytes = size;
+         batch.records = count;
+         return batch;
+     }
+ 
+     // Make a prepared segment readable (no frame() call may run concurrently)
+     void publish(Batch &batch) {
+         if (batch.frames.empty()) {
+             failed = failed || batch.records != 0;
+             return;
+         }
+         if (batch.chunk) {
+             chunks.push_back(std::move(batch.chunk));
+         }
+         frames.insert(frames.end(), batch.frames.begin(), batch.frames.end());
+         storedBytes += batch.bytes;
+         storedRecords += batch.records;
+     }
+ 
+     // prepare() and publish() in one step
+     void add(std::uint64_t firstSeq, const Transaction *records, const std::uint64_t *prev,
+              const std::uint32_t *rows, std::size_t count) {
+         Batch batch = prepare(firstSeq, records, prev, rows, count);
+         publish(batch);
+     }
+ 
+     // Decode the frame holding `seq`, or nullptr if this tier doesn't have it
+     std::shared_ptr<const Frame> frame(std::uint64_t seq) const {
+         if (frames.empty() || seq < frames.front().firstSeq) {
+             return nullptr;
+         }
+         auto ref = std::upper_bound(frames.begin(), frames.end(), seq,
+                                     [](std::uint64_t s, const FrameRef &f) { return s < f.firstSeq; }) - 1;
+         if (seq - ref->firstSeq >= ref->count) {
+             return nullptr;
+         }
+         std::vector<unsigned char> spilled;
+         const unsigned char *p = nullptr;
+         if (fd < 0) {
+             p = reinterpret_cast<const unsigned char*>(chunks[ref->chunk].get()) + ref->offset;
+         } else {
+             spilled.resize(ref->length);
+             if (::pread(fd, spilled.data(), ref->length, static_cast<off_t>(ref->offset)) != static_cast<ssize_t>(ref->length)) {
+                 return nullptr;
+             }
+             p = spilled.data();
+         }
+         std::shared_ptr<Frame> decoded = std::make_shared<Frame>();
+         decoded->firstSeq = ref->firstSeq;
+         decoded->count = ref->count;
+         return decode(p, p + ref->length, *decoded) ? decoded : nullptr;
+     }
+ 
+     std::uint64_t firstSequence() const { return frames.empty() ? 0 : frames.front().firstSeq; }
+     std::size_t records() const { return storedRecords; }
+     std::uint64_t encodedBytes() const { return storedBytes; }
+     // Resident memory: the in-memory frames plus the index
+     std::size_t memoryBytes() const {
+         return (fd < 0 ? storedBytes : 0) + chunks.capacity() * sizeof(chunks[0]) + frames.capacity() * sizeof(FrameRef);
+     }
+     bool spillFailed() const { return failed; }
+ };
+ 
+ /******************************************************
+  * Ledger - Bank-wide append-only transaction log
+  *  - Records live in fixed-size segments that are never
+  *    reallocated; a record's sequence number is its id
+  *  - Each record links to the previous record of the same
+  *    account, so per-account history is an intrusive chain
+  *  - Segments sit in a fixed ring; with a segment cap the
+  *    oldest one is evicted when a new one is needed (handed
+  *    to the spill handler first) and its storage is reused,
+  *    so steady-state appends never allocate
+  *  - With a hot age, opening a segment also evicts full
+  *    segments whose newest record is older than that, so
+  *    memory follows recent activity only
+  *  - With a cold tier, every evicted segment is encoded
+  *    into it and reads (find/previous through a
+  *    HistoryRange) continue there
+  *
+  * Thread safety:
+  *  - append() is lock-free apart from opening a segment
+  *  - Readers (find/previous) must hold readGuard(), which
+  *    keeps segments from being evicted underneath them
+  ******************************************************/
+ class Ledger {
+ public:
+     static constexpr std::uint64_t kNoRecord = 0;  // sequences start at 1
+     static constexpr unsigned kSegmentShift = 14;
+     static constexpr std::size_t kSegmentRecords = std::size_t(1) << kSegmentShift;
+     static constexpr std::size_t kRingSegments = std::size_t(1) << 16;  // hard cap on live segments
+ 
+     struct Segment {
+         Transaction records[kSegmentRecords];
+         std::uint64_t prevForAccount[kSegmentRecords];  // previous sequence of the same account
+         std::uint32_t accountRow[kSegmentRecords];
+         std::atomic<std::uint64_t> number;              // position in the segment sequence
+         std::atomic<std::size_t> written;               // records fully stored so far
+     };
+ 
+     // Receives a segment just before it is evicted: first sequence, segment, record count
+     typedef std::function<void(std::uint64_t, const Segment&, std::size_t)> SpillHandler;
+ 
+ private:
+     std::unique_ptr<std::atomic<Segment*>[]> ring;  // segment n lives at n % kRingSegments
+     std::atomic<std::uint64_t> nextSequence;
+     std::atomic<std::uint64_t> firstLiveSegment;
+     std::atomic<std::uint64_t> openedSegments;      // segments opened so far
+     std::atomic<std::size_t> maxSegments;           // 0 = unbounded (up to the ring size)
+     std::atomic<std::size_t> allocatedSegments;
+     std::mutex openMutex;                           // serializes opening and evicting
+     mutable std::shared_mutex evictionMutex;        // readers shared, eviction exclusive
+     SpillHandler spillHandler;
+     ColdHistory *cold;                              // receives evicted segments; may be null
+     std::atomic<std::int64_t> hotAgeMicros;         // 0 = evict by the segment cap only
+     const char *adoptedBegin;                       // externally owned segment storage
+     const char *adoptedEnd;                         // (a mapped snapshot), never deleted
+     WriteAheadLog *journal;                         // receives every appended record; may be null
+ 
+     static std::uint64_t segmentOf(std::uint64_t seq) { return (seq - 1) >> kSegmentShift; }
+     static std::size_t slotOf(std::uint64_t seq) { return static_cast<std::size_t>((seq - 1) & (kSegmentRecords - 1)); }
+ 
+     Segment* liveSegment(std::uint64_t number) const {
+         Segment *segment = ring[number % kRingSegments].load(std::memory_order_acquire);
+         return segment && segment->number.load(std::memory_order_acquire) == number ? segment : nullptr;
+     }
+ 
+     // Evict the oldest live segment and return its storage for reuse (openMutex held)
+     Segment* evictOldest() {
+         std::uint64_t victimNumber = firstLiveSegment.load(std::memory_order_relaxed);
+         Segment *victim = ring[victimNumber % kRingSegments].load(std::memory_order_relaxed);
+         // Writers that claimed a slot in the victim may still be storing it
+         while (victim->written.load(std::memory_order_acquire) != kSegmentRecords) {
+             std::this_thread::yield();
+         }
+         std::uint64_t firstSeq = (victimNumber << kSegmentShift) + 1;
+         ColdHistory::Batch batch;
+         if (cold) {
+             // Encode before taking the lock: readers keep using the victim meanwhile
+             batch = cold->prepare(firstSeq, victim->records, victim->prevForAccount, victim->accountRow, kSegmentRecords);
+         }
+         std::unique_lock<std::shared_mutex> exclusive(evictionMutex);
+         if (spillHandler) {
+             spillHandler(firstSeq, *victim, kSegmentRecords);
+         }
+         if (cold) {
+             cold->publish(batch);
+         }
+         ring[victimNumber % kRingSegments].store(nullptr, std::memory_order_relaxed);
+         firstLiveSegment.store(victimNumber + 1, std::memory_order_release);
+         return victim;
+     }
+ 
+     void release(Segment *segment) {
+         const char *bytes = reinterpret_cast<const char*>(segment);
+         if (bytes < adoptedBegin || bytes >= adoptedEnd) {
+             delete segment;
+         }
+         allocatedSegments.fetch_sub(1, std::memory_order_relaxed);
+     }
+ 
+     // Evict full segments older than the hot age, keeping the newest opened one; returns
+     // one's storage for reuse, or nullptr (openMutex held)
+     Segment* evictExpired() {
+         std::int64_t age = hotAgeMicros.load(std::memory_order_relaxed);
+         if (age <= 0) {
+             return nullptr;
+         }
+         std::int64_t horizon = currentTimeMicros() - age;
+         Segment *spare = nullptr;
+         for (;;) {
+             std::uint64_t oldest = firstLiveSegment.load(std::memory_order_relaxed);
+             if (oldest + 1 >= openedSegments.load(std::memory_order_relaxed)) {
+                 break;
+             }
+             const Segment *segment = ring[oldest % kRingSegments].load(std::memory_order_relaxed);
+             if (segment->written.load(std::memory_order_acquire) != kSegmentRecords
+                 || segment->records[kSegmentRecords - 1].timestampMicros() >= horizon) {
+                 break;
+             }
+             Segment *victim = evictOldest();
+             if (spare) {
+                 release(victim);
+             } else {
+                 spare = victim;
+             }
+         }
+         return spare;
+     }
+ 
+     // Open every segment up to and including `number`
+     Segment* openThrough(std::uint64_t number) {
+         std::lock_guard<std::mutex> guard(openMutex);
+         for (std::uint64_t next = openedSegments.load(std::memory_order_relaxed); next <= number; ++next) {
+             std::size_t cap = maxSegments.load(std::memory_order_relaxed);
+             if (cap == 0 || cap > kRingSegments) {
+                 cap = kRingSegments;
+             }
+             Segment *segment = evictExpired();  // reuse an expired segment's storage first
+             if (!segment && next - firstLiveSegment.load(std::memory_order_relaxed) >= cap) {
+                 segment = evictOldest();
+             } else if (!segment) {
+                 segment = new Segment;
+                 allocatedSegments.fetch_add(1, std::memory_order_relaxed);
+             }
+             // Reset the count before the number: a writer that matches the new number must see it
+             segment->written.store(0, std::memory_order_relaxed);
+             segment->number.store(next, std::memory_order_release);
+             ring[next % kRingSegments].store(segment, std::memory_order_release);
+             openedSegments.store(next + 1, std::memory_order_release);
+         }
+         return liveSegment(number);
+     }
+ 
+ public:
+     explicit Ledger(std::size_t segmentCap = 0)
+         : ring(new std::atomic<Segment*>[kRingSegments]),
+           nextSequence(1), firstLiveSegment(0), openedSegments(0),
+           maxSegments(segmentCap), allocatedSegments(0), cold(nullptr), hotAgeMicros(0),
+           adoptedBegin(nullptr), adoptedEnd(nullptr),
+           journal(nullptr) {
+         for (std::size_t i = 0; i < kRingSegments; ++i) {
+             ring[i].store(nullptr, std::memory_order_relaxed);
+         }
+     }
+ 
+     ~Ledger() {
+         for (std::size_t i = 0; i < kRingSegments; ++i) {
+             Segment *segment = ring[i].load(std::memory_order_relaxed);
+             const char *bytes = reinterpret_cast<const char*>(segment);
+             if (bytes < adoptedBegin || bytes >= adoptedEnd) {
+                 delete segment;
+             }
+         }
+     }
+ 
+     Ledger(const Ledger&) = delete;
+     Ledger& operator=(const Ledger&) = delete;
+ 
+     // Bound retained history to `cap` segments (0 = unbounded); takes effect on the next segment
+     void setSegmentCap(std::size_t cap) { maxSegments.store(cap, std::memory_order_relaxed); }
+ 
+     // Install before appending from several threads
+     void setSpillHandler(SpillHandler handler) { spillHandler = std::move(handler); }
+ 
+     // Journal every later append (install while no appends are in flight; nullptr = off)
+     void setJournal(WriteAheadLog *log) { journal = log; }
+ 
+     // Encode evicted segments into `tier` so their history stays readable (install before
+     // appending from several threads; nullptr = evicted history is gone)
+     void setColdTier(ColdHistory *tier) { cold = tier; }
+     const ColdHistory* coldTier() const { return cold; }
+ 
+     // Also evict segments whose records are all older than `age` (0 = off); takes effect
+     // as segments open
+     void setHotAge(std::chrono::microseconds age) { hotAgeMicros.store(age.count(), std::memory_order_relaxed); }
+ 
+ private:
+     // Store one claimed sequence
+     void store(std::uint64_t seq, std::uint32_t row, std::uint64_t prevSeq, TransactionType type,
+                Money amount, Money balance, std::int64_t micros) {
+         Segment *segment = liveSegment(segmentOf(seq));
+         if (!segment) {
+             segment = openThrough(segmentOf(seq));
+         }
+         std::size_t slot = slotOf(seq);
+         segment->records[slot] = Transaction(type, amount, balance, seq, micros);
+         segment->prevForAccount[slot] = prevSeq;
+         segment->accountRow[slot] = row;
+         segment->written.fetch_add(1, std::memory_order_release);
+     }
+ 
+ public:
+     // Append a record for `row`, linking it after `prevSeq`; returns the new sequence.
+     // Records of one account must be appended under that account's lock.
+     std::uint64_t append(std::uint32_t row, std::uint64_t prevSeq, TransactionType type, Money amount, Money balance) {
+         std::uint64_t seq = nextSequence.fetch_add(1, std::memory_order_relaxed);
+         std::int64_t micros = currentTimeMicros();
+         store(seq, row, prevSeq, type, amount, balance, micros);
+         if (journal) {
+             WriteAheadLog::Entry entry{row, Transaction(type, amount, balance, seq, micros)};
+             journal->appendEntries(&entry, 1);
+         }
+         return seq;
+     }
+ 
+     // Append the Interest record of a lazy settlement up to `epoch` (none when `amount` is
+     // zero) and journal both as one frame; returns the row's new history head
+     std::uint64_t appendAccrual(std::uint32_t row, std::uint64_t prevSeq, Money amount, Money balance, std::uint32_t epoch) {
+         std::uint64_t seq = prevSeq;
+         WriteAheadLog::Entry entry{row, Transaction()};
+         if (amount > Money()) {
+             seq = nextSequence.fetch_add(1, std::memory_order_relaxed);
+             std::int64_t micros = currentTimeMicros();
+             store(seq, row, prevSeq, TransactionType::Interest, amount, balance, micros);
+             entry.tx = Transaction(TransactionType::Interest, amount, balance, seq, micros);
+         }
+         if (journal) {
+             journal->appendAccrual(WriteAheadLog::Accrual{row, epoch}, amount > Money() ? &entry : nullptr);
+         }
+         return seq;
+     }
+ 
+     // Append a transfer as one paired record: the TransferOut leg gets sequence s and the
+     // TransferIn leg s + 1, with one timestamp. Both accounts' locks must be held.
+     std::uint64_t appendTransfer(std::uint32_t fromRow, std::uint64_t fromPrev, Money fromBalance,
+                                  std::uint32_t toRow, std::uint64_t toPrev, Money toBalance, Money amount) {
+         std::uint64_t seq = nextSequence.fetch_add(2, std::memory_order_relaxed);
+         std::int64_t micros = currentTimeMicros();
+         store(seq, fromRow, fromPrev, TransactionType::TransferOut, amount, fromBalance, micros);
+         store(seq + 1, toRow, toPrev, TransactionType::TransferIn, amount, toBalance, micros);
+         if (journal) {
+             // Both legs in one frame, so recovery never sees half a transfer
+             WriteAheadLog::Entry legs[2] = {
+                 {fromRow, Transaction(TransactionType::TransferOut, amount, fromBalance, seq, micros)},
+                 {toRow, Transaction(TransactionType::TransferIn, amount, toBalance, seq + 1, micros)}
+             };
+             journal->appendEntries(legs, 2);
+         }
+         return seq;
+     }
+ 
+     // Append two records of one row as s and s + 1 (a withdrawal and its fee), journaled as
+     // one frame; the second links to the first. Returns s + 1, the row's new history head.
+     std::uint64_t appendPair(std::uint32_t row, std::uint64_t prevSeq, TransactionType firstType, Money firstAmount,
+                              Money firstBalance, TransactionType secondType, Money secondAmount, Money secondBalance) {
+         std::uint64_t seq = nextSequence.fetch_add(2, std::memory_order_relaxed);
+         std::int64_t micros = currentTimeMicros();
+         store(seq, row, prevSeq, firstType, firstAmount, firstBalance, micros);
+         store(seq + 1, row, seq, secondType, secondAmount, secondBalance, micros);
+         if (journal) {
+             WriteAheadLog::Entry records[2] = {
+                 {row, Transaction(firstType, firstAmount, firstBalance, seq, micros)},
+                 {row, Transaction(secondType, secondAmount, secondBalance, seq + 1, micros)}
+             };
+             journal->appendEntries(records, 2);
+         }
+         return seq + 1;
+     }
+ 
+     // Recovery: store a known record at `seq` (not journaled). Records may be restored
+     // from several threads in any order; call resumeAt() once all are in.
+     void restore(std::uint64_t seq, std::uint32_t row, std::uint64_t prevSeq, const Transaction &tx) {
+         store(seq, row, prevSeq, tx.type(), tx.amount, tx.resultingBalance, tx.timestampMicros());
+     }
+ 
+     void resumeAt(std::uint64_t nextSeq) { nextSequence.store(nextSeq, std::memory_order_release); }
+ 
+     // Shared guard that keeps find()/previous() results valid
+     std::shared_lock<std::shared_mutex> readGuard() const {
+         return std::shared_lock<std::shared_mutex>(evictionMutex);
+     }
+ 
+     // Returns the record for seq, or nullptr if it was evicted or never written
+     const Transaction* find(std::uint64_t seq) const {
+         if (seq == kNoRecord || seq > lastSequence()) {
+             return nullptr;
+         }
+         const Segment *segment = liveSegment(segmentOf(seq));
+         return segment ? &segment->records[slotOf(seq)] : nullptr;
+     }
+ 
+     // Previous record of the same account (kNoRecord at the start of the chain); seq must be live
+     std::uint64_t previous(std::uint64_t seq) const {
+         return liveSegment(segmentOf(seq))->prevForAccount[slotOf(seq)];
+     }
+ 
+     // Table row of the account that owns seq; seq must be live
+     std::uint32_t accountRowOf(std::uint64_t seq) const {
+         return liveSegment(segmentOf(seq))->accountRow[slotOf(seq)];
+     }
+ 
+     // Decoded cold-tier frame holding an evicted seq, or nullptr (hold readGuard())
+     std::shared_ptr<const ColdHistory::Frame> coldFrame(std::uint64_t seq) const {
+         return cold && seq != kNoRecord && seq < firstRetained() ? cold->frame(seq) : nullptr;
+     }
+ 
+     // Oldest sequence still held in memory
+     std::uint64_t firstRetained() const { return (firstLiveSegment.load(std::memory_order_acquire) << kSegmentShift) + 1; }
+     std::uint64_t lastSequence() const { return nextSequence.load(std::memory_order_acquire) - 1; }
+     std::size_t retainedRecords() const {
+         std::uint64_t first = firstRetained(), last = lastSequence();
+         return last >= first ? static_cast<std::size_t>(last - first + 1) : 0;
+     }
+     std::size_t memoryBytes() const { return allocatedSegments.load(std::memory_order_relaxed) * sizeof(Segment); }
+ 
+     // Snapshot support: live segments are [firstLiveSegmentNumber(), openedSegmentCount())
+     std::uint64_t firstLiveSegmentNumber() const { return firstLiveSegment.load(std::memory_order_acquire); }
+     std::uint64_t openedSegmentCount() const { return openedSegments.load(std::memory_order_acquire); }
+     const Segment* segmentAt(std::uint64_t number) const { return liveSegment(number); }
+ 
+     // Whether `count` segments stored `stride` bytes apart from `base`, numbered from
+     // `firstSegment`, hold exactly the records before `nextSeq` that are still live, each
+     // linked to an earlier record of a row below `rows`. Checked before adopt().
+     static bool validImage(const char *base, std::size_t stride, std::uint64_t firstSegment, std::uint64_t count,
+                            std::uint64_t nextSeq, std::uint64_t rows) {
+         if (count > kRingSegments || firstSegment > (std::numeric_limits<std::uint64_t>::max() >> kSegmentShift) - kRingSegments
+             || nextSeq == 0) {
+             return false;
+         }
+         std::uint64_t last = nextSeq - 1;
+         if (last < (firstSegment << kSegmentShift) || last > ((firstSegment + count) << kSegmentShift)) {
+             return false;
+         }
+         for (std::uint64_t i = 0; i < count; ++i) {
+             const Segment *segment = reinterpret_cast<const Segment*>(base + i * stride);
+             std::uint64_t start = (firstSegment + i) << kSegmentShift;  // sequence before the first slot
+             std::uint64_t expected = last > start ? std::min<std::uint64_t>(last - start, kSegmentRecords) : 0;
+             if (segment->number.load(std::memory_order_relaxed) != firstSegment + i
+                 || segment->written.load(std::memory_order_relaxed) != expected) {
+                 return false;
+             }
+             for (std::size_t slot = 0; slot < expected; ++slot) {
+                 if (segment->records[slot].id != start + slot + 1 || segment->prevForAccount[slot] > start + slot
+                     || segment->accountRow[slot] >= rows) {
+                     return false;
+                 }
+             }
+         }
+         return true;
+     }
+ 
+     // Take `count` live segments stored `stride` bytes apart from `base`, numbered from
+     // `firstSegment`, and continue sequencing at `nextSeq` (empty ledger only).
+     // The memory must outlive the ledger; check it with validImage() first.
+     void adopt(char *base, std::size_t stride, std::uint64_t firstSegment, std::uint64_t count, std::uint64_t nextSeq) {
+         std::lock_guard<std::mutex> guard(openMutex);
+         for (std::uint64_t i = 0; i < count; ++i) {
+             Segment *segment = reinterpret_cast<Segment*>(base + i * stride);
+             ring[(firstSegment + i) % kRingSegments].store(segment, std::memory_order_release);
+         }
+         adoptedBegin = base;
+         adoptedEnd = base + count * stride;
+         allocatedSegments.store(static_cast<std::size_t>(count), std::memory_order_relaxed);
+         firstLiveSegment.store(firstSegment, std::memory_order_release);
+         openedSegments.store(firstSegment + count, std::memory_order_release);
+         nextSequence.store(nextSeq, std::memory_order_release);
+     }
+ };
+ 
+ /******************************************************
+  * History queries - Lazy views of one account's chain
+  *  - A HistoryRange walks the chain newest to oldest
+  *    from a starting sequence and yields the records a
+  *    HistoryFilter accepts; nothing is copied, and only
+  *    the records visited are touched
+  *  - Records evicted into the ledger's cold tier are
+  *    read from there, one decoded frame at a time
+  *  - The range holds the ledger's read guard while it
+  *    lives, so segment eviction (and appends that must
+  *    open a segment) waits for it: keep ranges short;
+  *    Bank::historyPage copies a page out instead
+  ******************************************************/
+ struct HistoryFilter {
+     std::uint32_t typeMask = ~0u;  // bit (1 << TransactionType) set for each accepted type
+     Money minAmount = Money::fromUnits(std::numeric_limits<std::int64_t>::min());
+     Money maxAmount = Money::fromUnits(std::numeric_limits<std::int64_t>::max());
+     std::int64_t fromMicros = std::numeric_limits<std::int64_t>::min();  // inclusive time window
+     std::int64_t toMicros = std::numeric_limits<std::int64_t>::max();
+ 
+     static std::uint32_t bit(TransactionType type) { return 1u << static_cast<unsigned>(type); }
+ 
+     bool matches(const Transaction &tx) const {
+         std::int64_t micros = tx.timestampMicros();
+         return (typeMask & bit(tx.type())) != 0 && tx.amount >= minAmount && tx.amount <= maxAmount
+             && micros >= fromMicros && micros <= toMicros;
+     }
+ };
+ 
+ class HistoryRange {
+ public:
+     class iterator {
+     private:
+         const Ledger *ledger;
+         const HistoryFilter *filter;
+         std::uint64_t seq;        // current record, or where the walk stopped
+         const Transaction *tx;    // nullptr at the end
+         std::shared_ptr<const ColdHistory::Frame> frame;  // last cold-tier frame decoded
+ 
+         // The record at s, from memory or the cold tier
+         const Transaction* lookup(std::uint64_t s) {
+             if (const Transaction *hot = ledger->find(s)) {
+                 return hot;
+             }
+             if (!frame || !frame->holds(s)) {
+                 frame = ledger->coldFrame(s);
+             }
+             return frame ? &frame->at(s) : nullptr;
+         }
+ 
+         std::uint64_t previousOf(std::uint64_t s) const {
+             return frame && frame->holds(s) ? frame->previous(s) : ledger->previous(s);
+         }
+ 
+         // Advance to the first accepted record at or before seq
+         void settle() {
+             while ((tx = lookup(seq)) != nullptr && !filter->matches(*tx)) {
+                 seq = previousOf(seq);
+             }
+         }
+ 
+     public:
+         iterator() : ledger(nullptr), filter(nullptr), seq(Ledger::kNoRecord), tx(nullptr) {}
+         iterator(const Ledger *l, const HistoryFilter *f, std::uint64_t start) : ledger(l), filter(f), seq(start), tx(nullptr) {
+             if (ledger) {
+                 settle();
+             }
+         }
+ 
+         const Transaction& operator*() const { return *tx; }
+         const Transaction* operator->() const { return tx; }
+         iterator& operator++() {
+             seq = previousOf(seq);
+             settle();
+             return *this;
+         }
+         bool operator==(const iterator &o) const { return tx == o.tx; }
+         bool operator!=(const iterator &o) const { return tx != o.tx; }
+ 
+         // Ledger sequence of the current record
+         std::uint64_t sequence() const { return seq; }
+         // Sequence just before the current record in this account's chain (kNoRecord at its start)
+         std::uint64_t older() const { return previousOf(seq); }
+         // At the end: true if the chain continued into history that is gone (evicted, and
+         // not in the cold tier)
+         bool truncated() const { return tx == nullptr && seq != Ledger::kNoRecord; }
+     };
+ 
+ private:
+     const Ledger *ledger = nullptr;
+     std::shared_lock<std::shared_mutex> guard;
+     std::uint64_t start = Ledger::kNoRecord;
+     HistoryFilter filter;
+ 
+ public:
+     HistoryRange() {}
+     // `first` must be a sequence of the account's chain (its head for the newest record)
+     HistoryRange(const Ledger &l, std::uint64_t first, const HistoryFilter &f)
+         : ledger(&l), guard(l.readGuard()), start(first), filter(f) {}
+ 
+     iterator begin() const { return iterator(ledger, &filter, start); }
+     iterator end() const { return iterator(); }
+ };
+ 
+ // One page of a paginated history query
+ struct HistoryPage {
+     static constexpr std::uint64_t kNewest = std::numeric_limits<std::uint64_t>::max();  // cursor: start at the latest record
+ 
+     std::vector<Transaction> records;              // newest first
+     std::uint64_t nextCursor = Ledger::kNoRecord;  // cursor for the next (older) page; kNoRecord when done
+     bool truncated = false;                        // the walk ran into evicted history
+ };
+ 
+ // One history line, as printed by the menu
+ inline void printTransaction(std::ostream &out, const Transaction &tx) {
+     out << "  [" << transactionTypeName(tx.type()) << "]  Amount: $"
+         << tx.amount
+         << "  => Balance After: $"
+         << tx.resultingBalance
+         << "  (#" << tx.id << " at " << formatTimestamp(tx.timestampMicros()) << " UTC)\n";
+ }
+ 
+ /******************************************************
+  * AccountKind - Closed set of account types
+  *  - One per product below; the tag is stored in the
+  *    table's kind column, snapshots and the log
+  ******************************************************/
+ enum class AccountKind : std::uint8_t {
+     Savings,
+     Checking,
+     MoneyMarket,
+     FixedTerm
+ };
+ 
+ /******************************************************
+  * Account products - Rules composed at compile time
+  *  - A product is Product<Kind, Withdrawals, Overdraft,
+  *    Fees, Interest>; each policy is a stateless type
+  *    whose constants say what the product allows
+  *  - Product<...>::rules() folds the policies into one
+  *    constexpr ProductRules row; kProductRules holds one
+  *    row per AccountKind, in tag order (checked below)
+  *  - AccountOps, the totals and the interest paths read
+  *    a row's rules by its kind tag: a lookup of constants,
+  *    not a virtual call or a switch per product, so batch
+  *    loops run the same code whatever products they mix
+  *  - A new product is an AccountKind, a Product alias and
+  *    its kProductRules row: it uses the table's rate and
+  *    limit columns as its policies need and shares the
+  *    existing account views
+  ******************************************************/
+ // Withdrawal limits: the most one withdrawal or transfer debit may move
+ struct UnlimitedWithdrawals {
+     static constexpr Money kCap = Money::fromUnits(std::numeric_limits<std::int64_t>::max());
+ };
+ 
+ template <std::int64_t WholeUnits>
+ struct WithdrawalCap {
+     static constexpr Money kCap = Money::fromUnits(WholeUnits * Money::scale);
+ };
+ 
+ // Overdraft: whether the row's overdraft-limit column extends its funds
+ struct NoOverdraft {
+     static constexpr bool kOverdraft = false;
+ };
+ 
+ struct LimitOverdraft {
+     static constexpr bool kOverdraft = true;
+ };
+ 
+ // Fees: charged on each withdrawal, logged as its own Fee record
+ template <std::int64_t WholeUnits>
+ struct WithdrawalFee {
+     static constexpr Money kFee = Money::fromUnits(WholeUnits * Money::scale);
+ };
+ 
+ typedef WithdrawalFee<0> NoFees;
+ 
+ // Interest: whether the row's rate column earns interest
+ struct NoInterest {
+     static constexpr bool kInterest = false;
+ };
+ 
+ struct RateInterest {
+     static constexpr bool kInterest = true;
+ };
+ 
+ struct ProductRules {
+     AccountKind kind;
+     const char *name;       // lower case, as in "3 savings"
+     const char *banner;     // heading of the account display
+     Money withdrawalCap;    // UnlimitedWithdrawals::kCap if none
+     Money withdrawalFee;
+     bool overdraft;         // overdraft-limit column applies
+     bool interest;          // rate column applies
+     TxStatus overdrawn;     // status for a debit beyond the available funds
+ };
+ 
+ template <AccountKind Kind, class Withdrawals, class Overdraft, class Fees, class Interest>
+ struct Product {
+     static constexpr AccountKind kKind = Kind;
+ 
+     static constexpr ProductRules rules(const char *name, const char *banner) {
+         return ProductRules{Kind, name, banner, Withdrawals::kCap, Fees::kFee, Overdraft::kOverdraft, Interest::kInterest,
+                             Overdraft::kOverdraft ? TxStatus::OverdraftExceeded : TxStatus::InsufficientFunds};
+     }
+ };
+ 
+ typedef Product<AccountKind::Savings,     UnlimitedWithdrawals,  NoOverdraft,    NoFees,            RateInterest> SavingsProduct;
+ typedef Product<AccountKind::Checking,    UnlimitedWithdrawals,  LimitOverdraft, NoFees,            NoInterest>   CheckingProduct;
+ typedef Product<AccountKind::MoneyMarket, WithdrawalCap<10000>,  NoOverdraft,    NoFees,            RateInterest> MoneyMarketProduct;
+ typedef Product<AccountKind::FixedTerm,   UnlimitedWithdrawals,  NoOverdraft,    WithdrawalFee<25>, RateInterest> FixedTermProduct;  // fee: early-withdrawal penalty
+ 
+ constexpr ProductRules kProductRules[] = {
+     SavingsProduct::rules("savings", "----- SAVINGS ACCOUNT -----"),
+     CheckingProduct::rules("checking", "---- CHECKING ACCOUNT ----"),
+     MoneyMarketProduct::rules("money market", "--- MONEY MARKET ACCOUNT ---"),
+     FixedTermProduct::rules("fixed-term", "---- FIXED-TERM DEPOSIT ----")
+ };
+ 
+ constexpr std::size_t kAccountKinds = sizeof(kProductRules) / sizeof(kProductRules[0]);
+ 
+ constexpr bool productRulesInKindOrder() {
+     for (std::size_t i = 0; i < kAccountKinds; ++i) {
+         if (static_cast<std::size_t>(kProductRules[i].kind) != i) {
+             return false;
+         }
+     }
+     return true;
+ }
+ 
+ static_assert(productRulesInKindOrder(), "kProductRules must list one row per AccountKind, in tag order");
+ 
+ inline const ProductRules& productRules(AccountKind kind) {
+     return kProductRules[static_cast<std::size_t>(kind)];
+ }
+ 
+ inline bool isAccountKind(std::uint8_t tag) {
+     return tag < kAccountKinds;
+ }
+ 
+ /******************************************************
+  * WithdrawalLimits - Per-account daily and velocity
+  *   limits on debits (withdrawals, transfer debits)
+  *  - dailyLimit: the most an account may pay out per UTC
+  *    day; windowLimit: the most debits per velocity
+  *    window (one length per bank, a minute by default).
+  *    Zero means no limit
+  *  - Usage is one 64-bit word per rule, so it is read and
+  *    written whole: (day << 48) | amount paid out that
+  *    day, and (window << 32) | debits in that window. A
+  *    word stamped with an earlier day or window counts
+  *    as zero, so counters never need resetting
+  *  - Only rows with a limit keep usage, from the moment
+  *    a limit is set; fees don't count
+  ******************************************************/
+ struct LimitWindows {
+     std::uint64_t day;     // UTC day number, low 16 bits
+     std::uint64_t window;  // velocity window number, low 32 bits
+ };
+ 
+ struct WithdrawalLimits {
+     static constexpr unsigned kDayShift = 48;
+     static constexpr std::uint64_t kUsedMask = (std::uint64_t(1) << kDayShift) - 1;
+     static constexpr unsigned kWindowShift = 32;
+     static constexpr std::uint64_t kCountMask = (std::uint64_t(1) << kWindowShift) - 1;
+     static constexpr std::int64_t kMaxDailyLimit = static_cast<std::int64_t>(kUsedMask);  // Money units
+     static constexpr std::int64_t kMicrosPerDay = std::int64_t(86400) * 1000000;
+ 
+     static LimitWindows at(std::int64_t micros, std::int64_t windowMicros) {
+         return LimitWindows{static_cast<std::uint64_t>(micros / kMicrosPerDay) & 0xFFFF,
+                             static_cast<std::uint64_t>(micros / windowMicros) & kCountMask};
+     }
+ 
+     static std::int64_t usedToday(std::uint64_t usage, LimitWindows now) {
+         return (usage >> kDayShift) == now.day ? static_cast<std::int64_t>(usage & kUsedMask) : 0;
+     }
+ 
+     static std::uint64_t debitsInWindow(std::uint64_t usage, LimitWindows now) {
+         return (usage >> kWindowShift) == now.window ? usage & kCountMask : 0;
+     }
+ 
+     // Usage words after one more debit of `amount` units (each count saturates)
+     static std::uint64_t dailyAfter(std::uint64_t usage, LimitWindows now, std::int64_t amount) {
+         std::uint64_t used = static_cast<std::uint64_t>(usedToday(usage, now)) + static_cast<std::uint64_t>(amount);
+         return (now.day << kDayShift) | (used < kUsedMask ? used : kUsedMask);
+     }
+ 
+     static std::uint64_t windowAfter(std::uint64_t usage, LimitWindows now) {
+         std::uint64_t count = debitsInWindow(usage, now) + 1;
+         return (now.window << kWindowShift) | (count < kCountMask ? count : kCountMask);
+     }
+ 
+     // The limit a debit of `amount` (> 0) would break given the usage so far, or Ok
+     static TxStatus check(std::int64_t dailyLimit, std::uint32_t windowLimit, std::uint64_t dailyUsage,
+                           std::uint64_t windowUsage, std::int64_t amount, LimitWindows now) {
+         if (dailyLimit != 0 && amount > dailyLimit - usedToday(dailyUsage, now)) {
+             return TxStatus::DailyLimitExceeded;
+         }
+         if (windowLimit != 0 && debitsInWindow(windowUsage, now) >= windowLimit) {
+             return TxStatus::VelocityLimitExceeded;
+         }
+         return TxStatus::Ok;
+     }
+ };
+ 
+ /******************************************************
+  * SegmentedColumn - Growable array with stable storage
+  *  - Rows live in fixed-size segments reached through a
+  *    fixed directory, so growing never moves a row and
+  *    readers can index while a writer appends
+  *  - Each segment is contiguous, so batch kernels run
+  *    segment by segment
+  *  - Growth (ensure) is single-writer
+  *  - Leading segments may be adopted from external memory
+  *    (a mapped snapshot); those are never freed here
+  ******************************************************/
+ template <typename T>
+ class SegmentedColumn {
+ public:
+     static constexpr unsigned kSegmentShift = 14;
+     static constexpr std::size_t kSegmentRows = std::size_t(1) << kSegmentShift;
+     static constexpr std::size_t kMaxSegments = std::size_t(1) << 14;
+     static constexpr std::size_t kMaxRows = kSegmentRows * kMaxSegments;
+ 
+ private:
+     std::unique_ptr<std::atomic<T*>[]> directory;
+     std::size_t adoptedSegments;  // directory[0, adoptedSegments) is externally owned
+ 
+ public:
+     SegmentedColumn() : directory(new std::atomic<T*>[kMaxSegments]), adoptedSegments(0) {
+         for (std::size_t i = 0; i < kMaxSegments; ++i) {
+             directory[i].store(nullptr, std::memory_order_relaxed);
+         }
+     }
+ 
+     ~SegmentedColumn() {
+         for (std::size_t i = adoptedSegments; i < kMaxSegments; ++i) {
+             delete[] directory[i].load(std::memory_order_relaxed);
+         }
+     }
+ 
+     // Use `segments` consecutive full segments starting at `base` as this column's first
+     // segments (empty column only). The memory must outlive the column.
+     void adopt(T *base, std::size_t segments) {
+         for (std::size_t i = 0; i < segments && i < kMaxSegments; ++i) {
+             directory[i].store(base + i * kSegmentRows, std::memory_order_release);
+         }
+         adoptedSegments = segments;
+     }
+ 
+     SegmentedColumn(const SegmentedColumn&) = delete;
+     SegmentedColumn& operator=(const SegmentedColumn&) = delete;
+ 
+     // Allocate the segment holding `row` if needed (row < kMaxRows)
+     void ensure(std::size_t row) {
+         std::atomic<T*> &slot = directory[row >> kSegmentShift];
+         if (!slot.load(std::memory_order_relaxed)) {
+             slot.store(new T[kSegmentRows](), std::memory_order_release);
+         }
+     }
+ 
+     // Allocate every segment needed for `rows` rows
+     void reserve(std::size_t rows) {
+         for (std::size_t row = 0; row < rows && row < kMaxRows; row += kSegmentRows) {
+             ensure(row);
+         }
+     }
+ 
+     T& operator[](std::size_t row) {
+         return directory[row >> kSegmentShift].load(std::memory_order_acquire)[row & (kSegmentRows - 1)];
+     }
+     const T& operator[](std::size_t row) const {
+         return directory[row >> kSegmentShift].load(std::memory_order_acquire)[row & (kSegmentRows - 1)];
+     }
+ 
+     // Contiguous storage of one segment
+     T* segment(std::size_t index) { return directory[index].load(std::memory_order_acquire); }
+     const T* segment(std::size_t index) const { return directory[index].load(std::memory_order_acquire); }
+ };
+ 
+ /******************************************************
+  * BalanceAggregates - Bank-wide totals kept up to date
+  *  - Every balance change adds its delta to one of
+  *    kThreadShards cache-line-sized partial sums (the
+  *    caller's thread shard), so writers don't contend
+  *  - Reads merge the shards: O(shards), not O(accounts)
+  *  - Each total is exact once writers are quiet; during
+  *    trading a read sees every completed update, but a
+  *    transfer may be visible on one side only
+  ******************************************************/
+ struct BankTotals {
+     Money depositsHeld;        // sum of positive balances
+     Money overdrawn;           // sum of balances below zero (as a positive amount)
+     Money overdraftLimits;     // overdraft credit extended across accounts whose product has one
+     Money projectedInterest;   // what one interest run would credit to interest-bearing accounts now
+     std::int64_t accountsOfKind[kAccountKinds];
+     std::int64_t overdrawnAccounts;
+ 
+     Money totalBalance() const { return depositsHeld - overdrawn; }
+     std::int64_t accounts(AccountKind kind) const { return accountsOfKind[static_cast<std::size_t>(kind)]; }
+     std::int64_t accountCount() const {
+         std::int64_t total = 0;
+         for (std::int64_t count : accountsOfKind) {
+             total += count;
+         }
+         return total;
+     }
+ };
+ 
+ class BalanceAggregates {
+ private:
+     enum Field { DepositsHeld, Overdrawn, OverdraftLimits, ProjectedInterest, OverdrawnAccounts, KindCounts,
+                  kFields = KindCounts + kAccountKinds };
+ 
+     struct alignas(64) Shard {
+         std::atomic<std::int64_t> sums[kFields];
+     };
+ 
+     std::unique_ptr<Shard[]> shards;
+ 
+     void add(Field field, std::int64_t delta) {
+         if (delta != 0) {
+             shards[threadShard()].sums[field].fetch_add(delta, std::memory_order_relaxed);
+         }
+     }
+ 
+     static std::int64_t positivePart(Money m) { return m > Money() ? m.raw() : 0; }
+ 
+ public:
+     BalanceAggregates() : shards(new Shard[kThreadShards]) { clear(); }
+ 
+     void clear() {
+         for (std::size_t s = 0; s < kThreadShards; ++s) {
+             for (auto &sum : shards[s].sums) {
+                 sum.store(0, std::memory_order_relaxed);
+             }
+         }
+     }
+ 
+     // A new row with its opening balance
+     void addAccount(AccountKind kind, Money balance, Rate rate, Money limit) {
+         add(static_cast<Field>(KindCounts + static_cast<int>(kind)), 1);
+         if (productRules(kind).overdraft) {
+             add(OverdraftLimits, limit.raw());
+         }
+         changeBalance(kind, rate, Money(), balance);
+     }
+ 
+     // A row's balance moved from `before` to `after` (row lock held)
+     void changeBalance(AccountKind kind, Rate rate, Money before, Money after) {
+         add(DepositsHeld, positivePart(after) - positivePart(before));
+         if (before < Money() || after < Money()) {
+             add(Overdrawn, positivePart(-after) - positivePart(-before));
+             add(OverdrawnAccounts, static_cast<std::int64_t>(after < Money()) - static_cast<std::int64_t>(before < Money()));
+         }
+         if (productRules(kind).interest) {
+             add(ProjectedInterest, applyRate(after, rate).raw() - applyRate(before, rate).raw());
+         }
+     }
+ 
+     BankTotals totals() const {
+         std::int64_t sums[kFields] = {};
+         for (std::size_t s = 0; s < kThreadShards; ++s) {
+             for (std::size_t f = 0; f < kFields; ++f) {
+                 sums[f] += shards[s].sums[f].load(std::memory_order_relaxed);
+             }
+         }
+         BankTotals t;
+         t.depositsHeld = Money::fromUnits(sums[DepositsHeld]);
+         t.overdrawn = Money::fromUnits(sums[Overdrawn]);
+         t.overdraftLimits = Money::fromUnits(sums[OverdraftLimits]);
+         t.projectedInterest = Money::fromUnits(sums[ProjectedInterest]);
+         for (std::size_t k = 0; k < kAccountKinds; ++k) {
+             t.accountsOfKind[k] = sums[KindCounts + k];
+         }
+         t.overdrawnAccounts = sums[OverdrawnAccounts];
+         return t;
+     }
+ };
+ 
+ /******************************************************
+  * NamePool - Interned, read-only account holder names
+  *  - Each distinct name is stored once in an append-only
+  *    character arena and named by a 32-bit handle; the
+  *    account table keeps the handle instead of a string
+  *  - A handle doubles as the customer id: its entry heads
+  *    the chain of rows held under that name
+  *
+  * Thread safety:
+  *  - intern() and find() lock one of kStripes stripes,
+  *    picked by the name's hash, so parallel imports
+  *    rarely contend
+  *  - entry() and text() are lock-free; a handle may be
+  *    read by any thread it was handed to
+  ******************************************************/
+ class NamePool {
+ public:
+     static constexpr std::uint32_t kNone = std::numeric_limits<std::uint32_t>::max();
+     static constexpr unsigned kStripeBits = 4;
+     static constexpr std::size_t kStripes = std::size_t(1) << kStripeBits;
+     static constexpr unsigned kLocalBits = 32 - kStripeBits;  // names per stripe: 2^28
+ 
+     struct Entry {
+         const char *text;
+         std::uint32_t length;
+         std::atomic<std::uint32_t> newestRow;  // newest row held under the name + 1, 0 = none
+     };
+ 
+ private:
+     // Entries live in blocks that double in size, so handles stay valid as the pool grows
+     static constexpr unsigned kFirstBlockBits = 8;
+     static constexpr std::size_t kBlocks = kLocalBits - kFirstBlockBits + 1;
+     static constexpr std::size_t kArenaBytes = 64 * 1024;
+ 
+     struct alignas(64) Stripe {
+         std::mutex mutex;
+         std::atomic<Entry*> blocks[kBlocks];
+         std::uint32_t count = 0;
+         std::vector<std::uint64_t> slots;              // open addressing: hash << 32 | local index + 1, 0 = empty
+         std::vector<std::unique_ptr<char[]>> arenas;
+         char *arenaNext = nullptr;
+         std::size_t arenaLeft = 0;
+         std::size_t bytes = 0;                         // arenas and entry blocks
+ 
+         Stripe() {
+             for (auto &block : blocks) {
+                 block.store(nullptr, std::memory_order_relaxed);
+             }
+         }
+         ~Stripe() {
+             for (auto &block : blocks) {
+                 delete[] block.load(std::memory_order_relaxed);
+             }
+         }
+     };
+ 
+     std::unique_ptr<Stripe[]> stripes;
+ 
+     static std::uint64_t hashOf(const char *text, std::size_t length) {
+         std::uint64_t hash = 14695981039346656037ull;
+         for (std::size_t i = 0; i < length; ++i) {
+             hash = (hash ^ static_cast<unsigned char>(text[i])) * 1099511628211ull;
+         }
+         return hash;
+     }
+ 
+     static std::uint32_t handleOf(std::size_t stripe, std::uint32_t local) {
+         return static_cast<std::uint32_t>(stripe << kLocalBits) | local;
+     }
+ 
+     // Block and offset of a stripe-local index
+     static unsigned blockOf(std::uint32_t local, std::size_t &offset) {
+         std::uint64_t biased = static_cast<std::uint64_t>(local) + (std::uint64_t(1) << kFirstBlockBits);
+         unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(biased));
+         offset = static_cast<std::size_t>(biased - (std::uint64_t(1) << msb));
+         return msb - kFirstBlockBits;
+     }
+ 
+     static Entry& at(const Stripe &stripe, std::uint32_t local) {
+         std::size_t offset;
+         unsigned block = blockOf(local, offset);
+         return stripe.blocks[block].load(std::memory_order_acquire)[offset];
+     }
+ 
+     // Slot holding `text`, or the empty slot where it belongs (stripe lock held). Slots keep
+     // the hash's low half, so only a likely match touches the entry and its text
+     static std::size_t probe(const Stripe &stripe, std::uint64_t hash, const char *text, std::size_t length) {
+         std::size_t mask = stripe.slots.size() - 1;
+         std::uint64_t tag = hash << 32;
+         for (std::size_t slot = static_cast<std::size_t>(hash) & mask; ; slot = (slot + 1) & mask) {
+             std::uint64_t held = stripe.slots[slot];
+             if (held == 0) {
+                 return slot;
+             }
+             if ((held & ~std::uint64_t(0xffffffffu)) == tag) {
+                 const Entry &entry = at(stripe, static_cast<std::uint32_t>(held) - 1);
+                 if (entry.length == length && std::memcmp(entry.text, text, length) == 0) {
+                     return slot;
+                 }
+             }
+         }
+     }
+ 
+     // Grow the slot array to at least `minimum` (stripe lock held); the stored hash halves
+     // place the slots without rehashing any text
+     static void grow(Stripe &stripe, std::size_t minimum = 0) {
+         std::size_t size = std::max<std::size_t>(stripe.slots.size() * 2, 64);
+         while (size < minimum) {
+             size *= 2;
+         }
+         std::vector<std::uint64_t> old(size, 0);
+         old.swap(stripe.slots);
+         std::size_t mask = size - 1;
+         for (std::uint64_t held : old) {
+             if (held != 0) {
+                 std::size_t slot = static_cast<std::size_t>(held >> 32) & mask;
+                 while (stripe.slots[slot] != 0) {
+                     slot = (slot + 1) & mask;
+                 }
+                 stripe.slots[slot] = held;
+             }
+         }
+     }
+ 
+     static const char* store(Stripe &stripe, const char *text, std::size_t length) {
+         if (length == 0) {
+             return "";
+         }
+         if (length > kArenaBytes / 4) {
+             stripe.arenas.emplace_back(new char[length]);
+             stripe.bytes += length;
+             std::memcpy(stripe.arenas.back().get(), text, length);
+             return stripe.arenas.back().get();
+         }
+         if (stripe.arenaLeft < length) {
+             stripe.arenas.emplace_back(new char[kArenaBytes]);
+             stripe.bytes += kArenaBytes;
+             stripe.arenaNext = stripe.arenas.back().get();
+             stripe.arenaLeft = kArenaBytes;
+         }
+         char *copy = stripe.arenaNext;
+         std::memcpy(copy, text, length);
+         stripe.arenaNext += length;
+         stripe.arenaLeft -= length;
+         return copy;
+     }
+ 
+ public:
+     NamePool() : stripes(new Stripe[kStripes]) {}
+ 
+     NamePool(const NamePool&) = delete;
+     NamePool& operator=(const NamePool&) = delete;
+ 
+     // Handle of `text`, adding it on first use
+     std::uint32_t intern(const char *text, std::size_t length) {
+         std::uint64_t hash = hashOf(text, length);
+         std::size_t index = static_cast<std::size_t>(hash >> (64 - kStripeBits));
+         Stripe &stripe = stripes[index];
+         std::lock_guard<std::mutex> guard(stripe.mutex);
+         if (stripe.slots.empty()) {
+             grow(stripe);
+         }
+         std::size_t slot = probe(stripe, hash, text, length);
+         if (stripe.slots[slot] != 0) {
+             return handleOf(index, static_cast<std::uint32_t>(stripe.slots[slot]) - 1);
+         }
+ 
+         std::uint32_t local = stripe.count;
+         std::size_t offset;
+         unsigned block = blockOf(local, offset);
+         Entry *entries = stripe.blocks[block].load(std::memory_order_relaxed);
+         if (entries == nullptr) {
+             std::size_t blockSize = std::size_t(1) << (kFirstBlockBits + block);
+             entries = new Entry[blockSize];
+             stripe.bytes += blockSize * sizeof(Entry);
+             stripe.blocks[block].store(entries, std::memory_order_release);
+         }
+         Entry &entry = entries[offset];
+         entry.text = store(stripe, text, length);
+         entry.length = static_cast<std::uint32_t>(length);
+         entry.newestRow.store(0, std::memory_order_relaxed);
+         stripe.slots[slot] = hash << 32 | (local + 1);
+         if (++stripe.count * 4 > stripe.slots.size() * 3) {
+             grow(stripe);
+         }
+         return handleOf(index, local);
+     }
+     std::uint32_t intern(const std::string &text) { return intern(text.data(), text.size()); }
+ 
+     // Handle of `text`, or kNone when it was never interned
+     std::uint32_t find(const std::string &text) const {
+         std::uint64_t hash = hashOf(text.data(), text.size());
+         std::size_t index = static_cast<std::size_t>(hash >> (64 - kStripeBits));
+         Stripe &stripe = stripes[index];
+         std::lock_guard<std::mutex> guard(stripe.mutex);
+         if (stripe.slots.empty()) {
+             return kNone;
+         }
+         std::uint64_t held = stripe.slots[probe(stripe, hash, text.data(), text.size())];
+         return held == 0 ? kNone : handleOf(index, static_cast<std::uint32_t>(held) - 1);
+     }
+ 
+     // Size the hash slots for about `names` more distinct names, so bulk loads don't rehash
+     void reserve(std::size_t names) {
+         for (std::size_t s = 0; s < kStripes; ++s) {
+             std::lock_guard<std::mutex> guard(stripes[s].mutex);
+             std::size_t wanted = (stripes[s].count + names / kStripes + 1) * 4 / 3 + 1;
+             if (wanted > stripes[s].slots.size()) {
+                 grow(stripes[s], wanted);
+             }
+         }
+     }
+ 
+     Entry& entry(std::uint32_t handle) { return at(stripes[handle >> kLocalBits], handle & ((1u << kLocalBits) - 1)); }
+     const Entry& entry(std::uint32_t handle) const { return at(stripes[handle >> kLocalBits], handle & ((1u << kLocalBits) - 1)); }
+ 
+     std::string text(std::uint32_t handle) const {
+         const Entry &e = entry(handle);
+         return std::string(e.text, e.length);
+     }
+ 
+     // Distinct names and the bytes held for them (arenas, entries, hash slots)
+     std::size_t size() const {
+         std::size_t names = 0;
+         for (std::size_t s = 0; s < kStripes; ++s) {
+             std::lock_guard<std::mutex> guard(stripes[s].mutex);
+             names += stripes[s].count;
+         }
+         return names;
+     }
+     std::size_t memoryBytes() const {
+         std::size_t bytes = 0;
+         for (std::size_t s = 0; s < kStripes; ++s) {
+             std::lock_guard<std::mutex> guard(stripes[s].mutex);
+             bytes += stripes[s].bytes + stripes[s].slots.capacity() * sizeof(std::uint64_t);
+         }
+         return bytes;
+     }
+ };
+ 
+ /******************************************************
+  * SegmentVersions - Copy-on-write versions of the
+  *   mutable row state (balance, accrued epoch), one
+  *   table segment at a time, for read views
+  *  - Opening a view bumps the view version (with every
+  *    row lock held, so it is a consistent cut) and pins
+  *    it in one of kMaxViews slots
+  *  - The first write to a segment after a view opened
+  *    copies the segment first, tagged with the version;
+  *    later writes to it take the fast path (one compare)
+  *  - A view at version V reads the oldest copy tagged
+  *    >= V, or the live segment if nothing was written
+  *    since V opened
+  *  - Reclamation is epoch based: a copy is kept while a
+  *    pinned version falls in (next older copy, its own
+  *    version]; others can't be read by any view and are
+  *    freed on the segment's next freeze or when a view
+  *    closes
+  *
+  * Thread safety:
+  *  - freeze() expects a row lock of the segment (or
+  *    every row lock) to be held, as for the write itself
+  *  - read() and the view slots may be used from any thread
+  ******************************************************/
+ class SegmentVersions {
+ public:
+     static constexpr std::size_t kSegmentRows = SegmentedColumn<int>::kSegmentRows;
+     static constexpr std::size_t kMaxSegments = SegmentedColumn<int>::kMaxSegments;
+     static constexpr std::size_t kMaxViews = 64;
+ 
+ private:
+     static constexpr std::uint64_t kOpening = std::numeric_limits<std::uint64_t>::max();  // slot claimed, version pending
+ 
+     struct Copy {
+         std::uint64_t version;
+         std::unique_ptr<Copy> older;
+         Money balances[kSegmentRows];
+         std::uint32_t accruedEpochs[kSegmentRows];
+     };
+ 
+     struct Segment {
+         SpinLock lock;                        // serializes freezes, reads and reclamation
+         std::atomic<std::uint64_t> frozenAt;  // view version of the last freeze
+         std::unique_ptr<Copy> newest;         // copies, newest first
+ 
+         Segment() : frozenAt(0) {}
+     };
+ 
+     std::unique_ptr<std::atomic<Segment*>[]> directory;  // allocated on a segment's first freeze or view read
+     std::size_t allocated;                               // segments in the directory (under directoryMutex)
+     std::mutex directoryMutex;
+     std::atomic<std::uint64_t> version;                  // newest view version
+     std::atomic<std::uint64_t> slots[kMaxViews];         // pinned versions, 0 = free
+     std::atomic<std::size_t> copies;                     // copies alive, across segments
+ 
+     Segment* segmentFor(std::size_t index) {
+         Segment *segment = directory[index].load(std::memory_order_acquire);
+         if (!segment) {
+             std::lock_guard<std::mutex> guard(directoryMutex);
+             segment = directory[index].load(std::memory_order_relaxed);
+             if (!segment) {
+                 segment = new Segment;
+                 directory[index].store(segment, std::memory_order_release);
+                 allocated = allocated > index + 1 ? allocated : index + 1;
+             }
+         }
+         return segment;
+     }
+ 
+     // Pinned versions in ascending order into `out` (kMaxViews entries); returns the count
+     std::size_t pinned(std::uint64_t *out) const {
+         std::size_t count = 0;
+         for (const auto &slot : slots) {
+             std::uint64_t v = slot.load(std::memory_order_acquire);
+             if (v != 0 && v != kOpening) {
+                 out[count++] = v;
+             }
+         }
+         std::sort(out, out + count);
+         return count;
+     }
+ 
+     // Drop the copies no open view can read (segment lock held): a copy serves the views
+     // pinned after the next older copy's version and up to its own
+     void reclaim(Segment &segment, const std::uint64_t *views, std::size_t count) {
+         std::unique_ptr<Copy> *link = &segment.newest;
+         while (*link) {
+             Copy *copy = link->get();
+             std::uint64_t after = copy->older ? copy->older->version : 0;
+             const std::uint64_t *first = std::upper_bound(views, views + count, after);
+             if (first != views + count && *first <= copy->version) {
+                 link = &copy->older;
+             } else {
+                 std::unique_ptr<Copy> dead = std::move(*link);
+                 *link = std::move(dead->older);
+                 copies.fetch_sub(1, std::memory_order_relaxed);
+             }
+         }
+     }
+ 
+ public:
+     SegmentVersions() : directory(new std::atomic<Segment*>[kMaxSegments]), allocated(0), version(0), copies(0) {
+         for (std::size_t i = 0; i < kMaxSegments; ++i) {
+             directory[i].store(nullptr, std::memory_order_relaxed);
+         }
+         for (auto &slot : slots) {
+             slot.store(0, std::memory_order_relaxed);
+         }
+     }
+ 
+     ~SegmentVersions() {
+         for (std::size_t i = 0; i < kMaxSegments; ++i) {
+             delete directory[i].load(std::memory_order_relaxed);
+         }
+     }
+ 
+     SegmentVersions(const SegmentVersions&) = delete;
+     SegmentVersions& operator=(const SegmentVersions&) = delete;
+ 
+     // Claim a view slot, waiting while all kMaxViews are in use; pair with open()
+     std::size_t claimSlot() {
+         for (;;) {
+             for (std::size_t i = 0; i < kMaxViews; ++i) {
+                 std::uint64_t expected = 0;
+                 if (slots[i].compare_exchange_strong(expected, kOpening, std::memory_order_acq_rel)) {
+                     return i;
+                 }
+             }
+             std::this_thread::yield();
+         }
+     }
+ 
+     // Pin a new version in `slot` and return it (every row lock held)
+     std::uint64_t open(std::size_t slot) {
+         std::uint64_t v = version.load(std::memory_order_relaxed) + 1;
+         version.store(v, std::memory_order_release);
+         slots[slot].store(v, std::memory_order_release);
+         return v;
+     }
+ 
+     // Unpin a view and free the copies it was the last reader of
+     void close(std::size_t slot) {
+         slots[slot].store(0, std::memory_order_release);
+         if (copies.load(std::memory_order_relaxed) == 0) {
+             return;
+         }
+         std::uint64_t views[kMaxViews];
+         std::size_t count = pinned(views);
+         std::size_t segments;
+         {
+             std::lock_guard<std::mutex> guard(directoryMutex);
+             segments = allocated;
+         }
+         for (std::size_t i = 0; i < segments; ++i) {
+             if (Segment *segment = directory[i].load(std::memory_order_acquire)) {
+                 std::lock_guard<SpinLock> guard(segment->lock);
+                 reclaim(*segment, views, count);
+             }
+         }
+     }
+ 
+     // Before writing a row of segment `index`: true if a view opened since the segment
+     // was last frozen, so freeze() must run first (the write path's only cost otherwise)
+     bool needsFreeze(std::size_t index) const {
+         std::uint64_t current = version.load(std::memory_order_acquire);
+         const Segment *segment = directory[index].load(std::memory_order_acquire);
+         return (segment ? segment->frozenAt.load(std::memory_order_acquire) : 0) != current;
+     }
+ 
+     // Preserve the segment's first `rows` (published) rows for the open views that haven't
+     // seen a copy of it yet
+     void freeze(std::size_t index, const Money *liveBalances, const std::uint32_t *liveEpochs, std::size_t rows) {
+         std::uint64_t current = version.load(std::memory_order_acquire);
+         Segment &segment = *segmentFor(index);
+         std::lock_guard<SpinLock> guard(segment.lock);
+         std::uint64_t frozen = segment.frozenAt.load(std::memory_order_relaxed);
+         if (frozen == current) {
+             return;  // another writer of the segment got here first
+         }
+         std::uint64_t views[kMaxViews];
+         std::size_t count = pinned(views);
+         reclaim(segment, views, count);
+         if (count != 0 && views[count - 1] > frozen) {
+             // Views opened since the last freeze see the segment as it is now
+             std::unique_ptr<Copy> copy(new Copy);
+             copy->version = current;
+             std::memcpy(copy->balances, liveBalances, rows * sizeof(Money));
+             std::memcpy(copy->accruedEpochs, liveEpochs, rows * sizeof(std::uint32_t));
+             copy->older = std::move(segment.newest);
+             segment.newest = std::move(copy);
+             copies.fetch_add(1, std::memory_order_relaxed);
+         }
+         segment.frozenAt.store(current, std::memory_order_release);
+     }
+ 
+     // Copy the first `rows` rows of segment `index`, as of view version `v`, into the
+     // output arrays (rows beyond the view's own may still be being stored)
+     void read(std::size_t index, std::uint64_t v, const Money *liveBalances, const std::uint32_t *liveEpochs,
+               std::size_t rows, Money *balances, std::uint32_t *epochs) {
+         Segment &segment = *segmentFor(index);
+         std::lock_guard<SpinLock> guard(segment.lock);
+         if (segment.frozenAt.load(std::memory_order_relaxed) < v) {
+             // Not written since the view opened; writers wait on the lock to freeze it first
+             std::memcpy(balances, liveBalances, rows * sizeof(Money));
+             std::memcpy(epochs, liveEpochs, rows * sizeof(std::uint32_t));
+             return;
+         }
+         const Copy *copy = segment.newest.get();
+         while (copy->older && copy->older->version >= v) {
+             copy = copy->older.get();
+         }
+         std::memcpy(balances, copy->balances, rows * sizeof(Money));
+         std::memcpy(epochs, copy->accruedEpochs, rows * sizeof(std::uint32_t));
+     }
+ 
+     // Copies currently kept for open views
+     std::size_t copyCount() const { return copies.load(std::memory_order_relaxed); }
+     std::size_t copyBytes() const { return copyCount() * sizeof(Copy); }
+ };
+ 
+ /******************************************************
+  * AccountTable - Columnar (struct-of-arrays) account store
+  *  - One row per account, one array per field, stored in
+  *    contiguous SegmentedColumn segments
+  *  - Balance-only passes stream a single column instead of
+  *    dragging names and histories through cache
+  *  - Holder names are interned in a NamePool; each row
+  *    keeps a 32-bit handle and a link to the previous row
+  *    of the same holder, so a holder's accounts are one
+  *    chain walk away (not snapshot columns: rebuilt on load)
+  *  - interestRate is 0 for checking rows, overdraftLimit
+  *    is 0 for savings rows
+  *
+  * Thread safety:
+  *  - Rows are appended by a single writer and become
+  *    visible to readers once published
+  *  - balance and historyHead of a row may only be touched
+  *    while holding lockFor(row); rows are striped across
+  *    kLockStripes spinlocks; withdrawal limits and usage
+  *    are written under it too, but may be read without it
+  *  - Whole-segment scans hold every stripe (AllRowsGuard)
+  *  - Balance and accrued-epoch writes go through the
+  *    setters (or beforeSegmentWrite), which keep the
+  *    copy-on-write versions open ReadViews read
+  ******************************************************/
+ class AccountTable {
+ public:
+     static constexpr std::size_t kMaxRows = SegmentedColumn<int>::kMaxRows;
+     static constexpr std::size_t kSegmentRows = SegmentedColumn<int>::kSegmentRows;
+     static constexpr std::size_t kLockStripes = 1024;
+     static constexpr std::size_t kColumns = 11;  // ids, kinds, balances, rates, limits, history heads, accrual epochs,
+                                                  // daily limits, velocity limits, daily usage, velocity usage
+     static constexpr std::int64_t kDefaultVelocityWindowMicros = std::int64_t(60) * 1000000;
+ 
+ private:
+     SegmentedColumn<int> ids;
+     SegmentedColumn<AccountKind> kinds;
+     SegmentedColumn<Money> balances;
+     SegmentedColumn<Rate> interestRates;
+     SegmentedColumn<Money> overdraftLimits;
+     SegmentedColumn<std::uint64_t> historyHeads;  // newest Ledger sequence per row
+     SegmentedColumn<std::uint32_t> accruedEpochs; // interest period each row is settled up to
+     // Withdrawal limits (see WithdrawalLimits). Atomic so lock-free pre-validation can
+     // read them while row-lock holders write; writes happen under the row lock
+     SegmentedColumn<std::atomic<std::int64_t>> dailyLimits;   // Money units per day, 0 = none
+     SegmentedColumn<std::atomic<std::uint32_t>> windowLimits; // debits per velocity window, 0 = none
+     SegmentedColumn<std::atomic<std::uint64_t>> dailyUsages;
+     SegmentedColumn<std::atomic<std::uint64_t>> windowUsages;
+     SegmentedColumn<std::uint32_t> holders;       // NamePool handle per row
+     SegmentedColumn<std::uint32_t> holderLinks;   // previous row of the same holder + 1, 0 = none
+     NamePool names;
+     std::atomic<std::size_t> published;          // rows visible to readers
+     std::size_t written;                         // rows stored by the writer
+     std::unique_ptr<SpinLock[]> locks;
+     BalanceAggregates aggregates;                // bank-wide totals over every stored row
+     std::atomic<std::uint32_t> epoch;            // interest periods closed so far
+     mutable SegmentVersions versions;            // balance versions kept for open ReadViews
+     std::atomic<std::size_t> limitedRows;        // rows with any withdrawal limit
+     std::atomic<std::int64_t> velocityWindowMicros;
+ 
+     static_assert(sizeof(std::atomic<std::int64_t>) == sizeof(std::int64_t) &&
+                   sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t) &&
+                   sizeof(std::atomic<std::uint64_t>) == sizeof(std::uint64_t),
+                   "limit columns are stored in snapshots as plain integers");
+ 
+ public:
+     AccountTable()
+         : published(0), written(0), locks(new SpinLock[kLockStripes]), epoch(0), limitedRows(0),
+           velocityWindowMicros(kDefaultVelocityWindowMicros) {}
+ 
+     // Store a new row (single writer) and return its index; it stays hidden until publishRows()
+     std::size_t addRow(int id, AccountKind kind, Money balance, Rate rate, Money limit, std::uint32_t holder) {
+         std::size_t row = written++;
+         ids.ensure(row);
+         kinds.ensure(row);
+         balances.ensure(row);
+         interestRates.ensure(row);
+         overdraftLimits.ensure(row);
+         historyHeads.ensure(row);
+         accruedEpochs.ensure(row);
+         dailyLimits.ensure(row);
+         windowLimits.ensure(row);
+         dailyUsages.ensure(row);
+         windowUsages.ensure(row);
+         holders.ensure(row);
+         holderLinks.ensure(row);
+         storeRow(row, id, kind, balance, rate, limit, holder);
+         return row;
+     }
+ 
+     // Claim `count` consecutive rows (single writer) and return the first; fill them with
+     // storeRow(), from any number of threads, before publishRows()
+     std::size_t addRows(std::size_t count) {
+         std::size_t first = written;
+         reserve(first + count);
+         written += count;
+         return first;
+     }
+ 
+     // Write every column of a claimed, unpublished row (distinct rows may be stored concurrently)
+     void storeRow(std::size_t row, int id, AccountKind kind, Money balance, Rate rate, Money limit, std::uint32_t holder) {
+         ids[row] = id;
+         kinds[row] = kind;
+         balances[row] = balance;
+         interestRates[row] = rate;
+         overdraftLimits[row] = limit;
+         historyHeads[row] = Ledger::kNoRecord;
+         accruedEpochs[row] = interestEpoch();
+         dailyLimits[row].store(0, std::memory_order_relaxed);
+         windowLimits[row].store(0, std::memory_order_relaxed);
+         dailyUsages[row].store(0, std::memory_order_relaxed);
+         windowUsages[row].store(0, std::memory_order_relaxed);
+         linkHolder(row, holder);
+         aggregates.addAccount(kind, balance, rate, limit);
+     }
+ 
+     // Set a row's holder and push the row onto that holder's chain (rows of one holder
+     // may be linked from several threads; the chain head is published with a CAS)
+     void linkHolder(std::size_t row, std::uint32_t holder) {
+         holders[row] = holder;
+         std::atomic<std::uint32_t> &newest = names.entry(holder).newestRow;
+         std::uint32_t head = newest.load(std::memory_order_relaxed);
+         do {
+             holderLinks[row] = head;
+         } while (!newest.compare_exchange_weak(head, static_cast<std::uint32_t>(row + 1),
+                                                std::memory_order_release, std::memory_order_relaxed));
+     }
+ 
+     // Make every row stored so far visible to readers
+     void publishRows() { published.store(written, std::memory_order_release); }
+ 
+     // Pre-allocate segments for `rows` rows in total (single writer)
+     void reserve(std::size_t rows) {
+         ids.reserve(rows);
+         kinds.reserve(rows);
+         balances.reserve(rows);
+         interestRates.reserve(rows);
+         overdraftLimits.reserve(rows);
+         historyHeads.reserve(rows);
+         accruedEpochs.reserve(rows);
+         dailyLimits.reserve(rows);
+         windowLimits.reserve(rows);
+         dailyUsages.reserve(rows);
+         windowUsages.reserve(rows);
+         holders.reserve(rows);
+         holderLinks.reserve(rows);
+     }
+ 
+     std::size_t size() const { return published.load(std::memory_order_acquire); }
+     std::size_t pendingSize() const { return written; }
+ 
+     // Row accessors
+     int id(std::size_t row) const { return ids[row]; }
+     AccountKind kind(std::size_t row) const { return kinds[row]; }
+     Money balance(std::size_t row) const { return balances[row]; }
+     Rate interestRate(std::size_t row) const { return interestRates[row]; }
+     Money overdraftLimit(std::size_t row) const { return overdraftLimits[row]; }
+     std::uint64_t& historyHead(std::size_t row) { return historyHeads[row]; }
+     std::uint32_t accruedEpoch(std::size_t row) const { return accruedEpochs[row]; }
+     std::uint32_t holder(std::size_t row) const { return holders[row]; }
+     const NamePool::Entry& holderEntry(std::size_t row) const { return names.entry(holders[row]); }
+     std::string holderName(std::size_t row) const { return names.text(holders[row]); }
+ 
+     // Holder names; a handle is also the customer id
+     NamePool& holderNames() { return names; }
+     const NamePool& holderNames() const { return names; }
+ 
+     // Rows of a holder, newest first: a chain of row + 1 values ending in 0. Rows stored
+     // but not yet published may appear; readers skip rows >= size()
+     std::size_t newestRowOf(std::uint32_t holder) const {
+         return names.entry(holder).newestRow.load(std::memory_order_acquire);
+     }
+     std::size_t previousRowOf(std::size_t row) const { return holderLinks[row]; }
+ 
+     // Balance writes keep the aggregates current (row lock held)
+     void setBalance(std::size_t row, Money value) {
+         beforeSegmentWrite(row / kSegmentRows);
+         Money before = balances[row];
+         balances[row] = value;
+         aggregates.changeBalance(kinds[row], interestRates[row], before, value);
+     }
+     void addToBalance(std::size_t row, Money delta) { setBalance(row, balances[row] + delta); }
+     // Credit `amount` unless the balance would leave Money's range (then false, unchanged)
+     bool creditBalance(std::size_t row, Money amount) {
+         Money sum;
+         if (!Money::tryAdd(balances[row], amount, sum)) {
+             return false;
+         }
+         setBalance(row, sum);
+         return true;
+     }
+ 
+     // Account for a balance already written through balanceSegment() (row lock held)
+     void noteBalanceWrite(std::size_t row, Money before) {
+         aggregates.changeBalance(kinds[row], interestRates[row], before, balances[row]);
+     }
+ 
+     BankTotals totals() const { return aggregates.totals(); }
+     std::uint64_t historyHead(std::size_t row) const { return historyHeads[row]; }
+ 
+     // Lazy interest: closing a period only bumps the epoch; each savings row catches up
+     // to it on its next access (AccountOps::settle), with its row lock held
+     std::uint32_t interestEpoch() const { return epoch.load(std::memory_order_acquire); }
+     void setInterestEpoch(std::uint32_t value) { epoch.store(value, std::memory_order_release); }
+     void setAccruedEpoch(std::size_t row, std::uint32_t value) {
+         beforeSegmentWrite(row / kSegmentRows);
+         accruedEpochs[row] = value;
+     }
+ 
+     // Preserve segment `index` for open ReadViews before any of its balances or accrued
+     // epochs change (a row lock of the segment, or every row lock, held)
+     void beforeSegmentWrite(std::size_t index) {
+         if (versions.needsFreeze(index)) {
+             std::size_t base = index * kSegmentRows;
+             std::size_t rows = size() > base ? size() - base : 0;
+             versions.freeze(index, balances.segment(index), accruedEpochs.segment(index),
+                             rows < kSegmentRows ? rows : kSegmentRows);
+         }
+     }
+ 
+     SegmentVersions& segmentVersions() const { return versions; }
+ 
+     // Withdrawal limits and usage. Reads are safe without the row lock (pre-validation);
+     // setLimits and countDebit need it
+     std::int64_t dailyLimit(std::size_t row) const { return dailyLimits[row].load(std::memory_order_relaxed); }
+     std::uint32_t windowLimit(std::size_t row) const { return windowLimits[row].load(std::memory_order_relaxed); }
+     bool hasLimits(std::size_t row) const { return dailyLimit(row) != 0 || windowLimit(row) != 0; }
+     std::uint64_t dailyUsage(std::size_t row) const { return dailyUsages[row].load(std::memory_order_relaxed); }
+     std::uint64_t windowUsage(std::size_t row) const { return windowUsages[row].load(std::memory_order_relaxed); }
+ 
+     void setLimits(std::size_t row, std::int64_t daily, std::uint32_t perWindow) {
+         bool had = hasLimits(row);
+         dailyLimits[row].store(daily, std::memory_order_relaxed);
+         windowLimits[row].store(perWindow, std::memory_order_relaxed);
+         bool has = hasLimits(row);
+         if (has != had) {
+             if (has) {
+                 limitedRows.fetch_add(1, std::memory_order_relaxed);
+             } else {
+                 limitedRows.fetch_sub(1, std::memory_order_relaxed);
+             }
+         }
+     }
+ 
+     // Record a debit of `amount` units against the row's usage (no-op without limits)
+     void countDebit(std::size_t row, std::int64_t amount, LimitWindows now) {
+         if (!hasLimits(row)) {
+             return;
+         }
+         dailyUsages[row].store(WithdrawalLimits::dailyAfter(dailyUsage(row), now, amount), std::memory_order_relaxed);
+         windowUsages[row].store(WithdrawalLimits::windowAfter(windowUsage(row), now), std::memory_order_relaxed);
+     }
+ 
+     // While no row has a limit, debits skip the clock and batches skip pre-validation
+     std::size_t limitedRowCount() const { return limitedRows.load(std::memory_order_relaxed); }
+ 
+     LimitWindows limitWindows(std::int64_t micros) const {
+         return WithdrawalLimits::at(micros, velocityWindowMicros.load(std::memory_order_relaxed));
+     }
+     void setVelocityWindow(std::int64_t micros) {
+         velocityWindowMicros.store(micros > 0 ? micros : 1, std::memory_order_relaxed);
+     }
+ 
+     // Stripe lock guarding a row's balance and history head
+     SpinLock& lockFor(std::size_t row) const { return locks[row & (kLockStripes - 1)]; }
+     SpinLock& stripe(std::size_t index) const { return locks[index]; }
+ 
+     // Raw segment access for batch scans (rows [index * kSegmentRows, ...))
+     const AccountKind* kindSegment(std::size_t index) const { return kinds.segment(index); }
+     Money* balanceSegment(std::size_t index) { return balances.segment(index); }
+     const Money* balanceSegment(std::size_t index) const { return balances.segment(index); }
+     const Rate* interestRateSegment(std::size_t index) const { return interestRates.segment(index); }
+     const Money* overdraftLimitSegment(std::size_t index) const { return overdraftLimits.segment(index); }
+     const std::uint32_t* accruedEpochSegment(std::size_t index) const { return accruedEpochs.segment(index); }
+ 
+     // Generic column access for snapshots, in kColumns order
+     static std::size_t columnRowBytes(std::size_t column) {
+         static const std::size_t bytes[kColumns] = {
+             sizeof(int), sizeof(AccountKind), sizeof(Money), sizeof(Rate), sizeof(Money), sizeof(std::uint64_t),
+             sizeof(std::uint32_t), sizeof(std::int64_t), sizeof(std::uint32_t), sizeof(std::uint64_t), sizeof(std::uint64_t)
+         };
+         return bytes[column];
+     }
+ 
+     const void* columnSegment(std::size_t column, std::size_t index) const {
+         switch (column) {
+             case 0: return ids.segment(index);
+             case 1: return kinds.segment(index);
+             case 2: return balances.segment(index);
+             case 3: return interestRates.segment(index);
+             case 4: return overdraftLimits.segment(index);
+             case 5: return historyHeads.segment(index);
+             case 6: return accruedEpochs.segment(index);
+             case 7: return dailyLimits.segment(index);
+             case 8: return windowLimits.segment(index);
+             case 9: return dailyUsages.segment(index);
+             default: return windowUsages.segment(index);
+         }
+     }
+ 
+     // Take `rows` published rows whose columns are laid out as full segments starting at
+     // bases[column] (empty table only); the memory must outlive the table. Row holders
+     // come from holderOf[row], interned in this table's pool
+     void adoptColumns(void *const bases[kColumns], std::size_t rows, const std::uint32_t *holderOf) {
+         std::size_t segments = (rows + kSegmentRows - 1) / kSegmentRows;
+         ids.adopt(static_cast<int*>(bases[0]), segments);
+         kinds.adopt(static_cast<AccountKind*>(bases[1]), segments);
+         balances.adopt(static_cast<Money*>(bases[2]), segments);
+         interestRates.adopt(static_cast<Rate*>(bases[3]), segments);
+         overdraftLimits.adopt(static_cast<Money*>(bases[4]), segments);
+         historyHeads.adopt(static_cast<std::uint64_t*>(bases[5]), segments);
+         accruedEpochs.adopt(static_cast<std::uint32_t*>(bases[6]), segments);
+         dailyLimits.adopt(static_cast<std::atomic<std::int64_t>*>(bases[7]), segments);
+         windowLimits.adopt(static_cast<std::atomic<std::uint32_t>*>(bases[8]), segments);
+         dailyUsages.adopt(static_cast<std::atomic<std::uint64_t>*>(bases[9]), segments);
+         windowUsages.adopt(static_cast<std::atomic<std::uint64_t>*>(bases[10]), segments);
+         written = rows;
+         // Totals, holder chains and the limited-row count aren't stored in the image; one
+         // pass rebuilds them
+         holders.reserve(rows);
+         holderLinks.reserve(rows);
+         aggregates.clear();
+         std::size_t limited = 0;
+         for (std::size_t row = 0; row < rows; ++row) {
+             linkHolder(row, holderOf[row]);
+             aggregates.addAccount(kinds[row], balances[row], interestRates[row], overdraftLimits[row]);
+             limited += hasLimits(row) ? 1 : 0;
+         }
+         limitedRows.store(limited, std::memory_order_relaxed);
+         publishRows();
+     }
+ };
+ 
+ /******************************************************
+  * AllRowsGuard - Holds every stripe lock of a table
+  *  - Taken in stripe order, so it never deadlocks with
+  *    single-row lockers
+  ******************************************************/
+ class AllRowsGuard {
+ private:
+     const AccountTable &table;
+ 
+ public:
+     explicit AllRowsGuard(const AccountTable &t) : table(t) {
+         for (std::size_t i = 0; i < AccountTable::kLockStripes; ++i) {
+             table.stripe(i).lock();
+         }
+     }
+ 
+     ~AllRowsGuard() {
+         for (std::size_t i = AccountTable::kLockStripes; i-- > 0; ) {
+             table.stripe(i).unlock();
+         }
+     }
+ 
+     AllRowsGuard(const AllRowsGuard&) = delete;
+     AllRowsGuard& operator=(const AllRowsGuard&) = delete;
+ };
+ 
+ /******************************************************
+  * AccountOps - Account rules over a table row
+  *  - Each rule reads the row's ProductRules (a constexpr
+  *    row picked by its AccountKind tag) instead of making
+  *    a virtual call; the rules inline into batch loops
+  *  - Every function expects the row lock to be held
+  ******************************************************/
+ struct AccountOps {
+     // Funds a row may withdraw: the balance, plus the overdraft limit if its product has one
+     // (saturated at the ends of Money's range rather than wrapping)
+     static Money availableFunds(const AccountTable &table, std::size_t row) {
+         Money funds = table.balance(row);
+         Money limit = table.overdraftLimit(row);
+         if (productRules(table.kind(row)).overdraft && !Money::tryAdd(funds, limit, funds)) {
+             funds = Money::fromUnits(limit > Money() ? std::numeric_limits<std::int64_t>::max()
+                                                      : std::numeric_limits<std::int64_t>::min() + 1);
+         }
+         return funds;
+     }
+ 
+     // Status for a withdrawal beyond availableFunds()
+     static TxStatus overdrawnStatus(const AccountTable &table, std::size_t row) {
+         return productRules(table.kind(row)).overdrawn;
+     }
+ 
+     // Current day and velocity window for a debit from `row`; the clock is read only if
+     // the row has a withdrawal limit
+     static LimitWindows debitWindows(const AccountTable &table, std::size_t row) {
+         return table.hasLimits(row) ? table.limitWindows(currentTimeMicros()) : LimitWindows{0, 0};
+     }
+ 
+     // Whether `row` may pay out `amount` (> 0) plus `fee`: Ok, or the first rule it breaks (the
+     // product's per-withdrawal cap, the row's withdrawal limits, then its funds)
+     static TxStatus checkDebit(const AccountTable &table, std::size_t row, Money amount, LimitWindows now,
+                                Money fee = Money()) {
+         if (amount > productRules(table.kind(row)).withdrawalCap) {
+             return TxStatus::WithdrawalLimitExceeded;
+         }
+         if (table.hasLimits(row)) {
+             TxStatus status = WithdrawalLimits::check(table.dailyLimit(row), table.windowLimit(row), table.dailyUsage(row),
+                                                       table.windowUsage(row), amount.raw(), now);
+             if (status != TxStatus::Ok) {
+                 return status;
+             }
+         }
+         // Compared without adding, so an amount near the top of the range can't wrap past the funds
+         Money funds = availableFunds(table, row);
+         return amount > funds || fee > funds - amount ? overdrawnStatus(table, row) : TxStatus::Ok;
+     }
+ 
+     // Count a debit that passed checkDebit() against the row's withdrawal limits
+     static void countDebit(AccountTable &table, std::size_t row, Money amount, LimitWindows now) {
+         table.countDebit(row, amount.raw(), now);
+     }
+ 
+     // Append a ledger record for a change already applied to `row`
+     static void log(AccountTable &table, Ledger &ledger, std::size_t row, TransactionType type, Money amount) {
+         std::uint64_t &head = table.historyHead(row);
+         head = ledger.append(static_cast<std::uint32_t>(row), head, type, amount, table.balance(row));
+     }
+ 
+     // Interest periods [from, to) add to `balance`, compounded one period at a time. If a
+     // period would take the balance beyond Money's range, `to` is lowered to that period.
+     static Money accruedInterest(Money balance, Rate rate, std::uint32_t from, std::uint32_t &to) {
+         Money total;
+         for (std::uint32_t period = from; period < to; ++period) {
+             Money interest = applyRate(balance, rate);
+             if (interest <= Money()) {
+                 break;  // the balance no longer grows, so later periods add nothing
+             }
+             if (!Money::tryAdd(balance, interest, balance)) {
+                 to = period;
+                 break;
+             }
+             total += interest;
+         }
+         return total;
+     }
+ 
+     // Bring an interest-bearing row up to the table's interest epoch, compounding one period
+     // at a time, and log the total as one Interest record; returns the interest credited.
+     // Every balance read or write calls this first, so closed periods cost nothing
+     // until an account is touched. Rows of products without interest are only stamped
+     static Money settle(AccountTable &table, Ledger &ledger, std::size_t row) {
+         return settleChecked(table, ledger, row).amount;
+     }
+ 
+     // Same, reporting BalanceOverflow if a period was left unpaid because its interest
+     // would take the balance beyond Money's range (the row stays behind the epoch)
+     static TxResult settleChecked(AccountTable &table, Ledger &ledger, std::size_t row) {
+         const std::uint32_t epoch = table.interestEpoch();
+         std::uint32_t from = table.accruedEpoch(row);
+         if (from >= epoch) {
+             return TxResult{TxStatus::Ok, Money()};
+         }
+         std::uint32_t through = epoch;
+         Money total;
+         if (productRules(table.kind(row)).interest) {
+             total = accruedInterest(table.balance(row), table.interestRate(row), from, through);
+             if (through == from) {
+                 return TxResult{TxStatus::BalanceOverflow, Money()};
+             }
+             Money balance = table.balance(row) + total;
+             table.setBalance(row, balance);
+             std::uint64_t &head = table.historyHead(row);
+             head = ledger.appendAccrual(static_cast<std::uint32_t>(row), head, total, balance, through);
+         }
+         table.setAccruedEpoch(row, through);
+         return TxResult{through == epoch ? TxStatus::Ok : TxStatus::BalanceOverflow, total};
+     }
+ 
+     static TxStatus deposit(AccountTable &table, Ledger &ledger, std::size_t row, Money amount) {
+         if (amount <= Money()) {
+             return TxStatus::InvalidAmount;
+         }
+         settle(table, ledger, row);
+         if (!table.creditBalance(row, amount)) {
+             return TxStatus::BalanceOverflow;
+         }
+         log(table, ledger, row, TransactionType::Deposit, amount);
+         return TxStatus::Ok;
+     }
+ 
+     // Within the product's per-withdrawal cap and its funds (the balance, plus the overdraft
+     // limit where it applies), covering any withdrawal fee, which is logged as a Fee record
+     static TxStatus withdraw(AccountTable &table, Ledger &ledger, std::size_t row, Money amount) {
+         if (amount <= Money()) {
+             return TxStatus::InvalidAmount;
+         }
+         settle(table, ledger, row);
+         Money fee = productRules(table.kind(row)).withdrawalFee;
+         LimitWindows now = debitWindows(table, row);
+         TxStatus status = checkDebit(table, row, amount, now, fee);
+         if (status != TxStatus::Ok) {
+             return status;
+         }
+         countDebit(table, row, amount, now);
+         table.addToBalance(row, -amount);
+         if (fee > Money()) {
+             Money afterWithdrawal = table.balance(row);
+             table.addToBalance(row, -fee);
+             std::uint64_t &head = table.historyHead(row);
+             head = ledger.appendPair(static_cast<std::uint32_t>(row), head, TransactionType::Withdrawal, amount, afterWithdrawal,
+                                      TransactionType::Fee, fee, table.balance(row));
+         } else {
+             log(table, ledger, row, TransactionType::Withdrawal, amount);
+         }
+         return TxStatus::Ok;
+     }
+ 
+     // Credit one period of interest to an interest-bearing row (amount is zero if none applied)
+     static TxResult creditInterest(AccountTable &table, Ledger &ledger, std::size_t row) {
+         if (!productRules(table.kind(row)).interest) {
+             return TxResult{TxStatus::NotSavingsAccount, Money()};
+         }
+         if (settleChecked(table, ledger, row).status != TxStatus::Ok) {
+             return TxResult{TxStatus::BalanceOverflow, Money()};
+         }
+         Money interest = applyRate(table.balance(row), table.interestRate(row));
+         if (interest > Money()) {
+             if (!table.creditBalance(row, interest)) {
+                 return TxResult{TxStatus::BalanceOverflow, Money()};
+             }
+             log(table, ledger, row, TransactionType::Interest, interest);
+         }
+         return TxResult{TxStatus::Ok, interest};
+     }
+ };
+ 
+ /******************************************************
+  * ReadView - Consistent point-in-time view of every
+  *   account, for reports that run while writes continue
+  *  - Opening one holds every row lock just long enough to
+  *    pin a version (O(stripes), not O(accounts)); after
+  *    that, deposits and transfers proceed and only copy a
+  *    segment on their first write to it after the open
+  *  - Balances are read a segment at a time into the
+  *    view's own buffer; pending lazy interest (periods
+  *    closed before the open) is included, so a balance
+  *    matches what getBalance() returned at that moment
+  *  - Rows created after the open are not in the view
+  *
+  * Thread safety:
+  *  - One view is used by one thread at a time; any number
+  *    of views may be open (up to kMaxViews at once; more
+  *    wait for a slot)
+  ******************************************************/
+ class ReadView {
+ public:
+     static constexpr std::size_t kMaxViews = SegmentVersions::kMaxViews;
+ 
+ private:
+     static constexpr std::size_t kNoSegment = std::numeric_limits<std::size_t>::max();
+ 
+     const AccountTable *table;
+     std::size_t slot;
+     std::uint64_t version;
+     std::size_t rows;
+     std::uint32_t epoch;
+     mutable std::unique_ptr<Money[]> balances;        // cachedSegment's balances as of the view
+     mutable std::unique_ptr<std::uint32_t[]> epochs;  // and its rows' accrued epochs
+     mutable std::size_t cachedSegment;
+ 
+     void load(std::size_t segment) const {
+         if (!balances) {
+             balances.reset(new Money[AccountTable::kSegmentRows]);
+             epochs.reset(new std::uint32_t[AccountTable::kSegmentRows]);
+         }
+         std::size_t base = segment * AccountTable::kSegmentRows;
+         std::size_t count = rows - base < AccountTable::kSegmentRows ? rows - base : AccountTable::kSegmentRows;
+         table->segmentVersions().read(segment, version, table->balanceSegment(segment), table->accruedEpochSegment(segment),
+                                       count, balances.get(), epochs.get());
+         cachedSegment = segment;
+     }
+ 
+ public:
+     explicit ReadView(const AccountTable &t)
+         : table(&t), slot(t.segmentVersions().claimSlot()), cachedSegment(kNoSegment) {
+         AllRowsGuard guard(t);
+         version = t.segmentVersions().open(slot);
+         rows = t.size();
+         epoch = t.interestEpoch();
+     }
+ 
+     ~ReadView() {
+         if (table) {
+             table->segmentVersions().close(slot);
+         }
+     }
+ 
+     ReadView(ReadView &&other) noexcept
+         : table(other.table), slot(other.slot), version(other.version), rows(other.rows), epoch(other.epoch),
+           balances(std::move(other.balances)), epochs(std::move(other.epochs)), cachedSegment(other.cachedSegment) {
+         other.table = nullptr;
+     }
+ 
+     ReadView(const ReadView&) = delete;
+     ReadView& operator=(const ReadView&) = delete;
+     ReadView& operator=(ReadView&&) = delete;
+ 
+     // Rows in the view, in creation order
+     std::size_t size() const { return rows; }
+     std::uint64_t viewVersion() const { return version; }
+ 
+     // Balance of `row` (< size()) when the view was opened, pending interest included
+     Money balance(std::size_t row) const {
+         std::size_t segment = row / AccountTable::kSegmentRows;
+         if (segment != cachedSegment) {
+             load(segment);
+         }
+         std::size_t offset = row % AccountTable::kSegmentRows;
+         Money value = balances[offset];
+         if (epochs[offset] < epoch && productRules(table->kind(row)).interest) {
+             std::uint32_t through = epoch;
+             value += AccountOps::accruedInterest(value, table->interestRate(row), epochs[offset], through);
+         }
+         return value;
+     }
+ 
+     // The other columns never change once a row is stored, so they are read live
+     int id(std::size_t row) const { return table->id(row); }
+     AccountKind kind(std::size_t row) const { return table->kind(row); }
+     Rate interestRate(std::size_t row) const { return table->interestRate(row); }
+     Money overdraftLimit(std::size_t row) const { return table->overdraftLimit(row); }
+     std::string holderName(std::size_t row) const { return table->holderName(row); }
+ 
+     // Sum of every balance in the view
+     Money totalBalance() const {
+         Money total;
+         for (std::size_t row = 0; row < rows; ++row) {
+             total += balance(row);
+         }
+         return total;
+     }
+ };
+ 
+ /******************************************************
+  * BankAccount - Base Class
+  *  - A view over one AccountTable row; the hot fields
+  *    (number, balance, rate, limit) and the interned
+  *    holder name live in the table
+  *
+  * Protected members:
+  *   table          : columnar store holding this account's row
+  *   ledger         : bank-wide log holding this account's history
+  *   row            : row index in the table
+  *   holderName()   : name of owner (interned; table.holderName)
+  *   balanceRef()   : current account balance (table column;
+  *                    written through the table's setters)
+  *
+  * The classes are an adapter over AccountOps: deposit and
+  * withdraw are plain calls that apply the row's kind rule,
+  * and only presentation (display) stays virtual. Bank's
+  * transaction path works on rows and never goes through
+  * these objects.
+  *
+  * Thread safety:
+  *  - Public operations take the row's stripe lock, so any
+  *    number of threads may call them concurrently
+  *  - Operations return a TxStatus and never print; only
+  *    the display functions write, to a caller-given stream
+  ******************************************************/
+ class BankAccount {
+ protected:
+     AccountTable &table;
+     Ledger &ledger;
+     std::size_t row;
+ 
+     std::string holderName() const { return table.holderName(row); }
+ 
+     Money balanceRef() const { return table.balance(row); }
+ 
+     SpinLock& rowLock() const { return table.lockFor(row); }
+ 
+     // Append a record for a balance change that was already applied (row lock held)
+     void logTransaction(TransactionType type, Money amount) {
+         AccountOps::log(table, ledger, row, type, amount);
+     }
+  
+ public:
+     // Constructor: the row must already exist in the table
+     BankAccount(AccountTable &accountTable, Ledger &bankLedger, std::size_t tableRow)
+         : table(accountTable), ledger(bankLedger), row(tableRow) {}
+ 
+     // Virtual destructor for proper cleanup of derived objects
+     virtual ~BankAccount() {}
+ 
+     // Deposit with logging
+     TxStatus deposit(Money amount) {
+         std::lock_guard<SpinLock> guard(rowLock());
+         return AccountOps::deposit(table, ledger, row, amount);
+     }
+ 
+     // Withdraw with logging; the row's kind decides the limit (overdraft for checking)
+     TxStatus withdraw(Money amount) {
+         std::lock_guard<SpinLock> guard(rowLock());
+         return AccountOps::withdraw(table, ledger, row, amount);
+     }
+ 
+     // Returns current balance
+     Money getBalance() const {
+         std::lock_guard<SpinLock> guard(rowLock());
+         AccountOps::settle(table, ledger, row);
+         return balanceRef();
+     }
+ 
+     // Returns account number
+     int getAccountNumber() const {
+         return table.id(row);
+     }
+ 
+     // Display with the current balance
+     void displayAccountInfo(std::ostream &out = std::cout) const {
+         displayAccountInfo(out, getBalance());
+     }
+ 
+     // Polymorphic display function – each derived class can override
+     // (`balance` is the one to show, e.g. from a ReadView)
+     virtual void displayAccountInfo(std::ostream &out, Money balance) const {
+         out << "Account Holder  : " << holderName() << "\n"
+                   << "Account Number  : " << getAccountNumber() << "\n"
+                   << "Current Balance : $" << balance << "\n";
+         const ProductRules &rules = productRules(table.kind(row));
+         if (rules.withdrawalCap < UnlimitedWithdrawals::kCap) {
+             out << "Withdrawal Cap  : $" << rules.withdrawalCap << "\n";
+         }
+         if (rules.withdrawalFee > Money()) {
+             out << "Withdrawal Fee  : $" << rules.withdrawalFee << "\n";
+         }
+         if (table.dailyLimit(row) != 0) {
+             out << "Daily Limit     : $" << Money::fromUnits(table.dailyLimit(row)) << "\n";
+         }
+         if (table.windowLimit(row) != 0) {
+             out << "Velocity Limit  : " << table.windowLimit(row) << " withdrawals per window\n";
+         }
+     }
+ 
+     // Show the transaction log
+     // (walks this account's chain in the ledger, printed oldest first; pending interest is settled first)
+     virtual void showTransactionHistory(std::ostream &out = std::cout) const {
+         std::uint64_t head;
+         {
+             std::lock_guard<SpinLock> guard(rowLock());
+             AccountOps::settle(table, ledger, row);
+             head = table.historyHead(row);
+         }
+         if (head == Ledger::kNoRecord) {
+             out << "No transactions recorded for this account.\n";
+             return;
+         }
+ 
+         // Records reachable from the head are complete; copy them while eviction is held off
+         std::vector<Transaction> chain;
+         bool truncated;
+         {
+             HistoryRange range(ledger, head, HistoryFilter());
+             HistoryRange::iterator it = range.begin();
+             for (; it != range.end(); ++it) {
+                 chain.push_back(*it);
+             }
+             truncated = it.truncated();
+         }
+ 
+         out << "Transaction History for Account #" << getAccountNumber() << ":\n";
+         if (truncated) {
+             out << "  (older records evicted from the ledger)\n";
+         }
+         for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+             printTransaction(out, *it);
+         }
+     }
+ };
+ 
+ /******************************************************
+  * SavingsAccount - Derived Class
+  *  - Inherits from BankAccount
+  *  - Has an additional interest rate
+  *  - Offers interest application method
+  *  - The view of every interest-bearing product (savings,
+  *    money market, fixed-term); the product's rules and
+  *    display banner come from its kind
+  ******************************************************/
+ class SavingsAccount : public BankAccount {
+ private:
+     // e.g., 0.03 for 3% annual interest; stored in the table's rate column
+     Rate interestRate() const { return table.interestRate(row); }
+ 
+ public:
+     SavingsAccount(AccountTable &accountTable, Ledger &bankLedger, std::size_t tableRow)
+         : BankAccount(accountTable, bankLedger, tableRow) {}
+ 
+     // Apply interest to the current balance
+     // (kept for existing callers; handleInterest() computes and credits under the row lock)
+     TxResult applyInterest() {
+         return handleInterest();
+     }
+ 
+     // A specialized method to deposit interest directly in the log
+     // to keep the naming more accurate. This function isn't standard
+     // but shows extended usage.
+     TxStatus depositInterest(Money interest) {
+         if (interest <= Money()) {
+             return TxStatus::InvalidAmount;
+         }
+         std::lock_guard<SpinLock> guard(rowLock());
+         AccountOps::settle(table, ledger, row);
+         if (!table.creditBalance(row, interest)) {
+             return TxStatus::BalanceOverflow;
+         }
+         // Log through the base class so the record is labeled "Interest"
+         // (and the balance is only credited once)
+         logTransaction(TransactionType::Interest, interest);
+         return TxStatus::Ok;
+     }
+ 
+     using BankAccount::displayAccountInfo;
+ 
+     // Overridden display
+     void displayAccountInfo(std::ostream &out, Money balance) const override {
+         out << productRules(table.kind(row)).banner << "\n";
+         BankAccount::displayAccountInfo(out, balance);
+         out << "Interest Rate   : " << std::fixed << std::setprecision(2) << (interestRate().toDouble() * 100) << "%\n";
+     }
+ 
+     // Let's finalize a single convenient function to handle interest:
+     // (result amount is zero when there was no interest to apply)
+     TxResult handleInterest() {
+         // Compute and credit under one lock so a concurrent withdrawal can't slip in between
+         std::lock_guard<SpinLock> guard(rowLock());
+         return AccountOps::creditInterest(table, ledger, row);
+     }
+ };
+ 
+ /******************************************************
+  * CheckingAccount - Derived Class
+  *  - Inherits from BankAccount
+  *  - Has an overdraft limit
+  *  - Withdrawals may use it (AccountOps::withdraw)
+  *  - The view of products without interest
+  ******************************************************/
+ class CheckingAccount : public BankAccount {
+ private:
+     // The extra limit when balance is insufficient; stored in the table's limit column
+     Money overdraftLimit() const { return table.overdraftLimit(row); }
+ 
+ public:
+     CheckingAccount(AccountTable &accountTable, Ledger &bankLedger, std::size_t tableRow)
+         : BankAccount(accountTable, bankLedger, tableRow) {}
+ 
+     using BankAccount::displayAccountInfo;
+ 
+     // Overridden display
+     void displayAccountInfo(std::ostream &out, Money balance) const override {
+         out << productRules(table.kind(row)).banner << "\n";
+         BankAccount::displayAccountInfo(out, balance);
+         out << "Overdraft Limit : $" << overdraftLimit() << "\n";
+     }
+ };
+ 
+ /******************************************************
+  * ObjectPool - Typed Slab Allocator
+  *  - Constructs objects of one type in large slabs
+  *  - Pointers stay valid for the pool's lifetime
+  *  - Slabs grow geometrically and are freed in bulk
+  ******************************************************/
+ template <typename T>
+ class ObjectPool {
+ private:
+     struct Slab {
+         T *storage;
+         std::size_t capacity;
+         std::size_t used;
+     };
+ 
+     static constexpr std::size_t kMinSlabObjects = 256;
+ 
+     std::vector<Slab> slabs;
+     std::size_t totalCapacity;
+ 
+     void addSlab(std::size_t capacity) {
+         void *raw = ::operator new(capacity * sizeof(T), std::align_val_t(alignof(T)));
+         slabs.push_back(Slab{static_cast<T*>(raw), capacity, 0});
+         totalCapacity += capacity;
+     }
+ 
+ public:
+     ObjectPool() : totalCapacity(0) {}
+     ObjectPool(const ObjectPool&) = delete;
+     ObjectPool& operator=(const ObjectPool&) = delete;
+ 
+     ~ObjectPool() {
+         for (auto &slab : slabs) {
+             for (std::size_t i = 0; i < slab.used; ++i) {
+                 slab.storage[i].~T();
+             }
+             ::operator delete(slab.storage, std::align_val_t(alignof(T)));
+         }
+     }
+ 
+     // Construct a new object in the current slab, opening a new one when full
+     template <typename... Args>
+     T* create(Args&&... args) {
+         if (slabs.empty() || slabs.back().used == slabs.back().capacity) {
+             addSlab(totalCapacity > kMinSlabObjects ? totalCapacity : kMinSlabObjects);
+         }
+         Slab &slab = slabs.back();
+         T *obj = new (slab.storage + slab.used) T(std::forward<Args>(args)...);
+         ++slab.used;
+         return obj;
+     }
+ 
+     // Make room for `count` more objects with at most one allocation
+     void reserve(std::size_t count) {
+         std::size_t available = slabs.empty() ? 0 : slabs.back().capacity - slabs.back().used;
+         if (count > available) {
+             addSlab(count > kMinSlabObjects ? count : kMinSlabObjects);
+         }
+     }
+ 
+     // Objects the allocated slabs can hold
+     std::size_t capacity() const { return totalCapacity; }
+ 
+     // Bulk construction: storage for `count` contiguous objects. Construct all of them
+     // (placement new, from any threads), then commitRun(count); no create() in between.
+     T* reserveRun(std::size_t count) {
+         reserve(count);
+         return slabs.empty() ? nullptr : slabs.back().storage + slabs.back().used;
+     }
+     void commitRun(std::size_t count) {
+         if (count != 0) {
+             slabs.back().used += count;
+         }
+     }
+ };
+ 
+ /******************************************************
+  * AccountIndex - Open-Addressing Hash Index
+  *  - Maps accountNumber -> AccountTable row in O(1)
+  *  - Linear probing over a power-of-two slot array
+  *  - Grows at 50% load; entries are never removed
+  *
+  * Thread safety:
+  *  - find() is lock-free and may run alongside insert()
+  *  - insert()/reserve() are single-writer
+  *  - A slot is one atomic word (key, row + 1) written
+  *    once, so readers never see a torn entry
+  *  - Growing publishes a new slot array; retired arrays
+  *    are kept until the index is destroyed so readers
+  *    still probing them never touch freed memory
+  ******************************************************/
+ class AccountIndex {
+ private:
+     struct Table {
+         std::size_t capacity;
+         std::unique_ptr<std::atomic<std::uint64_t>[]> slots;  // 0 marks an empty slot
+ 
+         explicit Table(std::size_t cap) : capacity(cap), slots(new std::atomic<std::uint64_t>[cap]) {
+             for (std::size_t i = 0; i < cap; ++i) {
+                 slots[i].store(0, std::memory_order_relaxed);
+             }
+         }
+     };
+ 
+     std::vector<std::unique_ptr<Table>> tables;  // tables.back() is current
+     std::atomic<Table*> current;
+     std::size_t count;
+ 
+     static std::uint64_t pack(int key, std::size_t row) {
+         return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(key)) << 32) | (row + 1);
+     }
+     static int keyOf(std::uint64_t slot) { return static_cast<int>(static_cast<std::uint32_t>(slot >> 32)); }
+     static std::size_t rowOf(std::uint64_t slot) { return static_cast<std::size_t>(slot & 0xFFFFFFFFu) - 1; }
+ 
+     static void place(Table &table, std::uint64_t entry) {
+         std::size_t mask = table.capacity - 1;
+         std::size_t i = hashKey(keyOf(entry)) & mask;
+         while (table.slots[i].load(std::memory_order_relaxed) != 0) {
+             i = (i + 1) & mask;
+         }
+         table.slots[i].store(entry, std::memory_order_release);
+     }
+ 
+     // Copy into a larger slot array (capacity must be a power of two) and publish it
+     void rehash(std::size_t newCapacity) {
+         Table *old = current.load(std::memory_order_relaxed);
+         std::unique_ptr<Table> grown(new Table(newCapacity));
+         for (std::size_t i = 0; i < old->capacity; ++i) {
+             std::uint64_t entry = old->slots[i].load(std::memory_order_relaxed);
+             if (entry != 0) {
+                 place(*grown, entry);
+             }
+         }
+         current.store(grown.get(), std::memory_order_release);
+         tables.push_back(std::move(grown));
+     }
+ 
+ public:
+     static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+ 
+     // Mix the bits so sequential account numbers spread across the table
+     static std::size_t hashKey(int key) {
+         std::uint64_t x = static_cast<std::uint32_t>(key);
+         x ^= x >> 33;
+         x *= 0xff51afd7ed558ccdULL;
+         x ^= x >> 33;
+         return static_cast<std::size_t>(x);
+     }
+ 
+     AccountIndex() : count(0) {
+         tables.emplace_back(new Table(16));
+         current.store(tables.back().get(), std::memory_order_relaxed);
+     }
+ 
+     // Returns the row stored under key, or npos
+     std::size_t find(int key) const {
+         const Table *table = current.load(std::memory_order_acquire);
+         std::size_t mask = table->capacity - 1;
+         for (std::size_t i = hashKey(key) & mask; ; i = (i + 1) & mask) {
+             std::uint64_t entry = table->slots[i].load(std::memory_order_acquire);
+             if (entry == 0) {
+                 return npos;
+             }
+             if (keyOf(entry) == key) {
+                 return rowOf(entry);
+             }
+         }
+     }
+ 
+     // Inserts key -> row; returns false (and stores nothing) if key already exists
+     bool insert(int key, std::size_t row) {
+         if (find(key) != npos) {
+             return false;
+         }
+         if ((count + 1) * 2 > current.load(std::memory_order_relaxed)->capacity) {
+             rehash(current.load(std::memory_order_relaxed)->capacity * 2);
+         }
+         place(*current.load(std::memory_order_relaxed), pack(key, row));
+         ++count;
+         return true;
+     }
+ 
+     // Pre-size the table for an expected number of accounts
+     void reserve(std::size_t expected) {
+         std::size_t capacity = current.load(std::memory_order_relaxed)->capacity;
+         std::size_t wanted = capacity;
+         while (expected * 2 > wanted) {
+             wanted *= 2;
+         }
+         if (wanted != capacity) {
+             rehash(wanted);
+         }
+     }
+ 
+     std::size_t size() const {
+         return count;
+     }
+ };
+ 
+ /******************************************************
+  * Interest Kernel
+  *  - interest[i] = applyRate(balance[i], rate[i])
+  *  - balance[i] += interest[i], unless that leaves Money's
+  *    range: then nothing is posted (interest[i] = 0)
+  *  - Rows with a zero rate (checking) post nothing, so the
+  *    kernel can run over the whole column without a kind check
+  *
+  * The SIMD paths are exact: a lane is taken only when the
+  * balance and rate are non-negative and their product is
+  * below 2^52, so every double in the lane holds an exact
+  * integer. The quotient is rounded to nearest, then the
+  * remainder r = p - q * scale (also exact) nudges q by one
+  * where the configured rounding mode disagrees. Any group
+  * with an out-of-range lane falls back to applyRate().
+  ******************************************************/
+ #if defined(__AVX2__) || (defined(__ARM_NEON) && defined(__aarch64__))
+ // Bounds on the exact remainder: q is raised when r passes kRoundUpAt
+ // (kRoundUpInclusive selects >= over >) and lowered when r < kRoundDownBelow
+ constexpr double kRateScaleD = static_cast<double>(Rate::scale);
+ constexpr double kRoundUpAt = kInterestRounding == RoundingMode::TowardZero ? kRateScaleD : kRateScaleD / 2;
+ constexpr bool kRoundUpInclusive = kInterestRounding != RoundingMode::HalfEven;
+ constexpr double kRoundDownBelow = kInterestRounding == RoundingMode::TowardZero ? 0.0 : -kRateScaleD / 2;
+ constexpr std::int64_t kExactLaneLimit = std::int64_t(1) << 51;
+ constexpr double kExactProductLimit = 4503599627370496.0;  // 2^52
+ #endif
+ 
+ // Scalar form of one lane
+ inline void postInterestRow(Money &balance, Rate rate, Money &interest) {
+     interest = applyRate(balance, rate);
+     if (!Money::tryAdd(balance, interest, balance)) {
+         interest = Money();
+     }
+ }
+ 
+ inline void postInterestColumns(Money *balances, const Rate *rates, Money *interest, std::size_t n) {
+     std::size_t i = 0;
+ #if defined(__AVX2__)
+     // 1.5 * 2^52: adding it to a double in (-2^51, 2^51) rounds to an integer
+     // whose low mantissa bits equal the int64 value, in both directions
+     const __m256i magicBits = _mm256_set1_epi64x(0x4338000000000000LL);
+     const __m256d magic = _mm256_castsi256_pd(magicBits);
+     const __m256i minusOne = _mm256_set1_epi64x(-1);
+     const __m256i laneLimit = _mm256_set1_epi64x(kExactLaneLimit);
+     const __m256d productLimit = _mm256_set1_pd(kExactProductLimit);
+     const __m256d scale = _mm256_set1_pd(kRateScaleD);
+     const __m256d upAt = _mm256_set1_pd(kRoundUpAt);
+     const __m256d downBelow = _mm256_set1_pd(kRoundDownBelow);
+     const __m256d one = _mm256_set1_pd(1.0);
+     for (; i + 4 <= n; i += 4) {
+         __m256i bal = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(balances + i));
+         __m256i rate = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rates + i));
+         __m256i inRange = _mm256_and_si256(
+             _mm256_and_si256(_mm256_cmpgt_epi64(bal, minusOne), _mm256_cmpgt_epi64(laneLimit, bal)),
+             _mm256_and_si256(_mm256_cmpgt_epi64(rate, minusOne), _mm256_cmpgt_epi64(laneLimit, rate)));
+         __m256d balD = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(bal, magicBits)), magic);
+         __m256d rateD = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(rate, magicBits)), magic);
+         __m256d product = _mm256_mul_pd(balD, rateD);
+         __m256d exact = _mm256_and_pd(_mm256_castsi256_pd(inRange),
+                                       _mm256_cmp_pd(product, productLimit, _CMP_LT_OQ));
+         if (_mm256_movemask_pd(exact) != 0xF) {
+             for (std::size_t j = i; j < i + 4; ++j) {
+                 postInterestRow(balances[j], rates[j], interest[j]);
+             }
+             continue;
+         }
+         __m256d q = _mm256_sub_pd(_mm256_add_pd(_mm256_div_pd(product, scale), magic), magic);
+         __m256d r = _mm256_sub_pd(product, _mm256_mul_pd(q, scale));
+         __m256d up = kRoundUpInclusive ? _mm256_cmp_pd(r, upAt, _CMP_GE_OQ) : _mm256_cmp_pd(r, upAt, _CMP_GT_OQ);
+         __m256d down = _mm256_cmp_pd(r, downBelow, _CMP_LT_OQ);
+         q = _mm256_sub_pd(_mm256_add_pd(q, _mm256_and_pd(up, one)), _mm256_and_pd(down, one));
+         __m256i amt = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(q, magic)), magicBits);
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(interest + i), amt);
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(balances + i), _mm256_add_epi64(bal, amt));
+     }
+ #elif defined(__ARM_NEON) && defined(__aarch64__)
+     const int64x2_t zero = vdupq_n_s64(0);
+     const int64x2_t laneLimit = vdupq_n_s64(kExactLaneLimit);
+     const float64x2_t productLimit = vdupq_n_f64(kExactProductLimit);
+     const float64x2_t scale = vdupq_n_f64(kRateScaleD);
+     const float64x2_t upAt = vdupq_n_f64(kRoundUpAt);
+     const float64x2_t downBelow = vdupq_n_f64(kRoundDownBelow);
+     const float64x2_t one = vdupq_n_f64(1.0);
+     for (; i + 2 <= n; i += 2) {
+         int64x2_t bal = vld1q_s64(reinterpret_cast<const std::int64_t*>(balances + i));
+         int64x2_t rate = vld1q_s64(reinterpret_cast<const std::int64_t*>(rates + i));
+         uint64x2_t inRange = vandq_u64(vandq_u64(vcgeq_s64(bal, zero), vcltq_s64(bal, laneLimit)),
+                                        vandq_u64(vcgeq_s64(rate, zero), vcltq_s64(rate, laneLimit)));
+         float64x2_t product = vmulq_f64(vcvtq_f64_s64(bal), vcvtq_f64_s64(rate));
+         uint64x2_t exact = vandq_u64(inRange, vcltq_f64(product, productLimit));
+         if ((vgetq_lane_u64(exact, 0) & vgetq_lane_u64(exact, 1)) == 0) {
+             for (std::size_t j = i; j < i + 2; ++j) {
+                 postInterestRow(balances[j], rates[j], interest[j]);
+             }
+             continue;
+         }
+         float64x2_t q = vrndnq_f64(vdivq_f64(product, scale));
+         float64x2_t r = vsubq_f64(product, vmulq_f64(q, scale));
+         uint64x2_t up = kRoundUpInclusive ? vcgeq_f64(r, upAt) : vcgtq_f64(r, upAt);
+         uint64x2_t down = vcltq_f64(r, downBelow);
+         q = vsubq_f64(vaddq_f64(q, vreinterpretq_f64_u64(vandq_u64(up, vreinterpretq_u64_f64(one)))),
+                       vreinterpretq_f64_u64(vandq_u64(down, vreinterpretq_u64_f64(one))));
+         int64x2_t amt = vcvtq_s64_f64(q);
+         vst1q_s64(reinterpret_cast<std::int64_t*>(interest + i), amt);
+         vst1q_s64(reinterpret_cast<std::int64_t*>(balances + i), vaddq_s64(bal, amt));
+     }
+ #endif
+     for (; i < n; ++i) {
+         postInterestRow(balances[i], rates[i], interest[i]);
+     }
+ }
+ 
+ /******************************************************
+  * Limit Kernel - Pre-validation of a batch's requests
+  *  - One LimitLanes group holds up to kLanes requests as
+  *    parallel int64 columns gathered from the table: the
+  *    amount, whether it is a debit (-1) and whether it
+  *    needs a positive amount (-1), the product's cap, and
+  *    the row's limits and usage words
+  *  - checkLimitLanes tests every lane at once for the
+  *    rules a request breaks on its own and returns one
+  *    bit per lane and rule; it never branches per lane
+  *  - A zero limit means none: such lanes compare against
+  *    INT64_MAX instead
+  ******************************************************/
+ struct LimitLanes {
+     static constexpr std::size_t kLanes = 64;
+ 
+     std::int64_t amount[kLanes];
+     std::int64_t debit[kLanes];    // -1 for a withdrawal, else 0
+     std::int64_t checked[kLanes];  // -1 if the amount must be positive, else 0
+     std::int64_t cap[kLanes];      // the product's per-withdrawal cap
+     std::int64_t dailyLimit[kLanes];
+     std::int64_t dailyUsage[kLanes];
+     std::int64_t windowLimit[kLanes];
+     std::int64_t windowUsage[kLanes];
+ };
+ 
+ struct LimitMasks {
+     std::uint64_t invalid;  // amount not positive
+     std::uint64_t overCap;  // more than the product allows in one withdrawal
+     std::uint64_t overDay;  // beyond what is left of the daily limit
+     std::uint64_t overRate; // no debits left in the velocity window
+ 
+     std::uint64_t any() const { return invalid | overCap | overDay | overRate; }
+ };
+ 
+ inline LimitMasks checkLimitLanes(const LimitLanes &lanes, std::size_t n, LimitWindows now) {
+     LimitMasks masks{0, 0, 0, 0};
+     std::size_t i = 0;
+ #if defined(__AVX2__)
+     const __m256i zero = _mm256_setzero_si256();
+     const __m256i unlimited = _mm256_set1_epi64x(std::numeric_limits<std::int64_t>::max());
+     const __m256i usedMask = _mm256_set1_epi64x(static_cast<std::int64_t>(WithdrawalLimits::kUsedMask));
+     const __m256i countMask = _mm256_set1_epi64x(static_cast<std::int64_t>(WithdrawalLimits::kCountMask));
+     const __m256i day = _mm256_set1_epi64x(static_cast<std::int64_t>(now.day));
+     const __m256i window = _mm256_set1_epi64x(static_cast<std::int64_t>(now.window));
+     for (; i + 4 <= n; i += 4) {
+         __m256i amount = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes.amount + i));
+         __m256i debit = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes.debit + i));
+         __m256i checked = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes.checked + i));
+         __m256i cap = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes.cap + i));
+         __m256i dailyLimit = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes.dailyLimit + i));
+         __m256i dailyUsage = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes.dailyUsage + i));
+         __m256i windowLimit = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes.windowLimit + i));
+         __m256i windowUsage = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lanes.windowUsage + i));
+         // Usage stamped with an earlier day or window counts as zero
+         __m256i used = _mm256_and_si256(_mm256_and_si256(dailyUsage, usedMask),
+                                         _mm256_cmpeq_epi64(_mm256_srli_epi64(dailyUsage, WithdrawalLimits::kDayShift), day));
+         __m256i count = _mm256_and_si256(_mm256_and_si256(windowUsage, countMask),
+                                          _mm256_cmpeq_epi64(_mm256_srli_epi64(windowUsage, WithdrawalLimits::kWindowShift), window));
+         dailyLimit = _mm256_or_si256(dailyLimit, _mm256_and_si256(_mm256_cmpeq_epi64(dailyLimit, zero), unlimited));
+         windowLimit = _mm256_or_si256(windowLimit, _mm256_and_si256(_mm256_cmpeq_epi64(windowLimit, zero), unlimited));
+         __m256i invalid = _mm256_andnot_si256(_mm256_cmpgt_epi64(amount, zero), checked);
+         __m256i overCap = _mm256_and_si256(_mm256_cmpgt_epi64(amount, cap), debit);
+         __m256i overDay = _mm256_and_si256(_mm256_cmpgt_epi64(amount, _mm256_sub_epi64(dailyLimit, used)), debit);
+         __m256i overRate = _mm256_andnot_si256(_mm256_cmpgt_epi64(windowLimit, count), debit);
+         masks.invalid |= static_cast<std::uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(invalid))) << i;
+         masks.overCap |= static_cast<std::uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(overCap))) << i;
+         masks.overDay |= static_cast<std::uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(overDay))) << i;
+         masks.overRate |= static_cast<std::uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(overRate))) << i;
+     }
+ #elif defined(__ARM_NEON) && defined(__aarch64__)
+     const int64x2_t zero = vdupq_n_s64(0);
+     const int64x2_t unlimited = vdupq_n_s64(std::numeric_limits<std::int64_t>::max());
+     const uint64x2_t usedMask = vdupq_n_u64(WithdrawalLimits::kUsedMask);
+     const uint64x2_t countMask = vdupq_n_u64(WithdrawalLimits::kCountMask);
+     const uint64x2_t day = vdupq_n_u64(now.day);
+     const uint64x2_t window = vdupq_n_u64(now.window);
+     for (; i + 2 <= n; i += 2) {
+         int64x2_t amount = vld1q_s64(lanes.amount + i);
+         uint64x2_t debit = vreinterpretq_u64_s64(vld1q_s64(lanes.debit + i));
+         uint64x2_t checked = vreinterpretq_u64_s64(vld1q_s64(lanes.checked + i));
+         int64x2_t cap = vld1q_s64(lanes.cap + i);
+         int64x2_t dailyLimit = vld1q_s64(lanes.dailyLimit + i);
+         uint64x2_t dailyUsage = vreinterpretq_u64_s64(vld1q_s64(lanes.dailyUsage + i));
+         int64x2_t windowLimit = vld1q_s64(lanes.windowLimit + i);
+         uint64x2_t windowUsage = vreinterpretq_u64_s64(vld1q_s64(lanes.windowUsage + i));
+         int64x2_t used = vreinterpretq_s64_u64(vandq_u64(vandq_u64(dailyUsage, usedMask),
+                                                          vceqq_u64(vshrq_n_u64(dailyUsage, WithdrawalLimits::kDayShift), day)));
+         int64x2_t count = vreinterpretq_s64_u64(vandq_u64(vandq_u64(windowUsage, countMask),
+                                                           vceqq_u64(vshrq_n_u64(windowUsage, WithdrawalLimits::kWindowShift), window)));
+         dailyLimit = vbslq_s64(vceqq_s64(dailyLimit, zero), unlimited, dailyLimit);
+         windowLimit = vbslq_s64(vceqq_s64(windowLimit, zero), unlimited, windowLimit);
+         uint64x2_t invalid = vbicq_u64(checked, vcgtq_s64(amount, zero));
+         uint64x2_t overCap = vandq_u64(vcgtq_s64(amount, cap), debit);
+         uint64x2_t overDay = vandq_u64(vcgtq_s64(amount, vsubq_s64(dailyLimit, used)), debit);
+         uint64x2_t overRate = vbicq_u64(debit, vcgtq_s64(windowLimit, count));
+         masks.invalid |= ((vgetq_lane_u64(invalid, 0) & 1) | (vgetq_lane_u64(invalid, 1) & 2)) << i;
+         masks.overCap |= ((vgetq_lane_u64(overCap, 0) & 1) | (vgetq_lane_u64(overCap, 1) & 2)) << i;
+         masks.overDay |= ((vgetq_lane_u64(overDay, 0) & 1) | (vgetq_lane_u64(overDay, 1) & 2)) << i;
+         masks.overRate |= ((vgetq_lane_u64(overRate, 0) & 1) | (vgetq_lane_u64(overRate, 1) & 2)) << i;
+     }
+ #endif
+     for (; i < n; ++i) {
+         std::uint64_t debit = lanes.debit[i] != 0;
+         std::uint64_t dailyUsage = static_cast<std::uint64_t>(lanes.dailyUsage[i]);
+         std::uint64_t windowUsage = static_cast<std::uint64_t>(lanes.windowUsage[i]);
+         std::int64_t used = WithdrawalLimits::usedToday(dailyUsage, now);
+         std::int64_t count = static_cast<std::int64_t>(WithdrawalLimits::debitsInWindow(windowUsage, now));
+         std::int64_t dailyLimit = lanes.dailyLimit[i] != 0 ? lanes.dailyLimit[i] : std::numeric_limits<std::int64_t>::max();
+         std::int64_t windowLimit = lanes.windowLimit[i] != 0 ? lanes.windowLimit[i] : std::numeric_limits<std::int64_t>::max();
+         masks.invalid |= static_cast<std::uint64_t>(lanes.checked[i] != 0 && lanes.amount[i] <= 0) << i;
+         masks.overCap |= (debit & static_cast<std::uint64_t>(lanes.amount[i] > lanes.cap[i])) << i;
+         masks.overDay |= (debit & static_cast<std::uint64_t>(lanes.amount[i] > dailyLimit - used)) << i;
+         masks.overRate |= (debit & static_cast<std::uint64_t>(count >= windowLimit)) << i;
+     }
+     return masks;
+ }
+ 
+ /******************************************************
+  * Span - Non-owning view of a contiguous array
+  *  - Minimal stand-in for C++20 std::span
+  ******************************************************/
+ template <typename T>
+ class Span {
+ private:
+     T *ptr;
+     std::size_t count;
+ 
+ public:
+     Span() : ptr(nullptr), count(0) {}
+     Span(T *data, std::size_t size) : ptr(data), count(size) {}
+     template <typename U, typename Alloc>
+     Span(const std::vector<U, Alloc> &v) : ptr(v.data()), count(v.size()) {}
+ 
+     T* begin() const { return ptr; }
+     T* end() const { return ptr + count; }
+     T& operator[](std::size_t i) const { return ptr[i]; }
+     std::size_t size() const { return count; }
+     bool empty() const { return count == 0; }
+ };
+ 
+ /******************************************************
+  * TxRequest - One operation in a submitted batch
+  *  - amount is ignored for Interest
+  ******************************************************/
+ enum class TxOp : std::uint8_t {
+     Deposit,
+     Withdraw,
+     Interest
+ };
+ 
+ struct TxRequest {
+     int accountNumber;
+     TxOp op;
+     Money amount;
+ };
+ 
+ /******************************************************
+  * BatchValidation - Result of pre-validating a batch
+  *  - One status per request: Ok if it passed, else the
+  *    rule it breaks on its own (see Bank::prevalidateBatch)
+  *  - Passing is not acceptance: applying the batch still
+  *    checks every request against the balance and the
+  *    usage of earlier requests
+  ******************************************************/
+ class BatchValidation {
+ private:
+     std::vector<TxStatus> statuses;
+     std::size_t rejected = 0;
+ 
+ public:
+     void reset(std::size_t requests) {
+         statuses.assign(requests, TxStatus::Ok);
+         rejected = 0;
+     }
+ 
+     void reject(std::size_t request, TxStatus status) {
+         rejected += statuses[request] == TxStatus::Ok ? 1 : 0;
+         statuses[request] = status;
+     }
+ 
+     bool accepted(std::size_t request) const { return statuses[request] == TxStatus::Ok; }
+     TxStatus status(std::size_t request) const { return statuses[request]; }
+     std::size_t size() const { return statuses.size(); }
+     std::size_t rejectedCount() const { return rejected; }
+ };
+ 
+ /******************************************************
+  * InterestRunReport - Result of a batch interest run
+  ******************************************************/
+ struct InterestRunReport {
+     std::size_t accountsCredited;  // rows that received a positive amount
+     Money totalInterest;
+     double seconds;
+     double accountsPerSecond;      // accounts scanned per second
+ };
+ 
+ /******************************************************
+  * Metrics - Optional hot-path counters and latencies
+  *  - Event counters and log-linear (HDR-style) latency
+  *    histograms, kept in cache-line-aligned shards of
+  *    relaxed atomics; each thread records into its own
+  *    shard, so recording takes no lock and shares no
+  *    cache line with other threads
+  *  - collect() merges the shards on the reader side
+  *  - The Bank only records (and reads the clock) while
+  *    a BankMetrics is attached; detached cost is one
+  *    relaxed pointer load per operation
+  ******************************************************/
+ enum class MetricCounter : std::uint8_t {
+     Deposits,
+     Withdrawals,
+     OverdraftWithdrawals,  // successful withdrawals that left a checking account below zero
+     Transfers,
+     InterestCredits,
+     InsufficientFunds,     // "Amount exceeds available balance"
+     OverdraftExceeded,     // "Amount exceeds overdraft limit"
+     AccountNotFound,
+     InvalidAmount,
+     DuplicateTransactions, // retries rejected by the client transaction id filter
+     LimitExceeded,         // per-withdrawal cap, daily or velocity limit
+     OtherRejections,       // same account, not a savings account, not durable, ...
+     Count
+ };
+ 
+ inline const char* metricCounterName(MetricCounter counter) {
+     switch (counter) {
+         case MetricCounter::Deposits:             return "deposit";
+         case MetricCounter::Withdrawals:          return "withdrawal";
+         case MetricCounter::OverdraftWithdrawals: return "overdraft_withdrawal";
+         case MetricCounter::Transfers:            return "transfer";
+         case MetricCounter::InterestCredits:      return "interest";
+         case MetricCounter::InsufficientFunds:    return "insufficient_funds";
+         case MetricCounter::OverdraftExceeded:    return "overdraft_exceeded";
+         case MetricCounter::AccountNotFound:      return "account_not_found";
+         case MetricCounter::InvalidAmount:        return "invalid_amount";
+         case MetricCounter::DuplicateTransactions: return "duplicate_transaction";
+         case MetricCounter::LimitExceeded:        return "limit_exceeded";
+         case MetricCounter::OtherRejections:      return "other_rejection";
+         case MetricCounter::Count:                break;
+     }
+     return "unknown";
+ }
+ 
+ // Timed operations; Batch is one applyBatch/applyBatchParallel call
+ enum class MetricOp : std::uint8_t { Deposit, Withdraw, Transfer, Interest, Batch, Count };
+ 
+ inline const char* metricOpName(MetricOp op) {
+     switch (op) {
+         case MetricOp::Deposit:  return "deposit";
+         case MetricOp::Withdraw: return "withdraw";
+         case MetricOp::Transfer: return "transfer";
+         case MetricOp::Interest: return "interest";
+         case MetricOp::Batch:    return "batch";
+         case MetricOp::Count:    break;
+     }
+     return "unknown";
+ }
+ 
+ inline MetricOp metricOpOf(TxOp op) {
+     switch (op) {
+         case TxOp::Deposit:  return MetricOp::Deposit;
+         case TxOp::Withdraw: return MetricOp::Withdraw;
+         case TxOp::Interest: return MetricOp::Interest;
+     }
+     return MetricOp::Deposit;
+ }
+ 
+ // Latency buckets in nanoseconds: one bucket per value below 16, then each power of two
+ // split into 16 equal sub-buckets (relative error under 1/16), up to 2^36 ns (~69 s)
+ struct LatencyBuckets {
+     static constexpr unsigned kSubBits = 4;
+     static constexpr unsigned kSub = 1u << kSubBits;
+     static constexpr unsigned kMaxBits = 36;
+     static constexpr std::size_t kCount = (kMaxBits - kSubBits + 1) * kSub;
+ 
+     static std::size_t bucketOf(std::uint64_t nanos) {
+         if (nanos < kSub) {
+             return static_cast<std::size_t>(nanos);
+         }
+         unsigned msb = 63 - static_cast<unsigned>(__builtin_clzll(nanos));
+         unsigned shift = msb - kSubBits;
+         std::size_t bucket = (shift + 1) * kSub + ((nanos >> shift) & (kSub - 1));
+         return bucket < kCount ? bucket : kCount - 1;
+     }
+ 
+     // Smallest value that falls in `bucket`
+     static std::uint64_t lowerBound(std::size_t bucket) {
+         if (bucket < kSub) {
+             return bucket;
+         }
+         unsigned shift = static_cast<unsigned>(bucket / kSub) - 1;
+         return (static_cast<std::uint64_t>(kSub) + bucket % kSub) << shift;
+     }
+ };
+ 
+ // Merged view of a BankMetrics plus the Bank's size gauges
+ struct MetricsSnapshot {
+     static constexpr std::size_t kCounters = static_cast<std::size_t>(MetricCounter::Count);
+     static constexpr std::size_t kOps = static_cast<std::size_t>(MetricOp::Count);
+ 
+     std::uint64_t counters[kCounters] = {};
+     std::vector<std::uint64_t> latency[kOps];  // bucket counts (LatencyBuckets), empty if not recorded
+     std::uint64_t latencyCount[kOps] = {};
+     std::uint64_t latencySumNanos[kOps] = {};
+ 
+     std::size_t accounts = 0;
+     std::size_t ledgerRecords = 0;   // records retained in memory
+     std::size_t ledgerBytes = 0;     // ledger segments allocated
+     std::size_t coldRecords = 0;     // records in the cold tier
+     std::size_t coldBytes = 0;       // cold-tier memory (encoded frames unless spilled, and the index)
+     std::size_t accountBytes = 0;    // table columns, views, account objects, holder names
+     double bytesPerAccount = 0.0;    // (accountBytes + ledgerBytes) / accounts
+ 
+     std::uint64_t counter(MetricCounter c) const { return counters[static_cast<std::size_t>(c)]; }
+ 
+     // Latency at quantile p (0..1), reported as the upper edge of its bucket; 0 if none recorded
+     double percentileNanos(MetricOp op, double p) const {
+         std::size_t o = static_cast<std::size_t>(op);
+         if (latencyCount[o] == 0) {
+             return 0.0;
+         }
+         std::uint64_t rank = static_cast<std::uint64_t>(p * (latencyCount[o] - 1)) + 1, seen = 0;
+         for (std::size_t b = 0; b < latency[o].size(); ++b) {
+             seen += latency[o][b];
+             if (seen >= rank) {
+                 return static_cast<double>(b + 1 < LatencyBuckets::kCount ? LatencyBuckets::lowerBound(b + 1)
+                                                                           : LatencyBuckets::lowerBound(b));
+             }
+         }
+         return static_cast<double>(LatencyBuckets::lowerBound(LatencyBuckets::kCount - 1));
+     }
+ 
+     // Prometheus text exposition format (version 0.0.4)
+     void writePrometheus(std::ostream &out) const {
+         std::ios::fmtflags flags = out.flags();
+         std::streamsize precision = out.precision();
+         out << std::defaultfloat << std::setprecision(9);
+         out << "# HELP bank_events_total Bank operations by outcome.\n"
+             << "# TYPE bank_events_total counter\n";
+         for (std::size_t c = 0; c < kCounters; ++c) {
+             out << "bank_events_total{event=\"" << metricCounterName(static_cast<MetricCounter>(c)) << "\"} "
+                 << counters[c] << "\n";
+         }
+ 
+         // Export every power-of-two bucket edge (each falls on a sub-bucket boundary)
+         out << "# HELP bank_op_latency_seconds Latency of Bank operations.\n"
+             << "# TYPE bank_op_latency_seconds histogram\n";
+         for (std::size_t o = 0; o < kOps; ++o) {
+             const char *name = metricOpName(static_cast<MetricOp>(o));
+             std::uint64_t cumulative = 0;
+             std::size_t b = 0;
+             for (unsigned bits = LatencyBuckets::kSubBits + 3; bits <= LatencyBuckets::kMaxBits; ++bits) {
+                 std::size_t edge = (bits - LatencyBuckets::kSubBits + 1) * LatencyBuckets::kSub;
+                 for (; b < edge && b < latency[o].size(); ++b) {
+                     cumulative += latency[o][b];
+                 }
+                 out << "bank_op_latency_seconds_bucket{op=\"" << name << "\",le=\""
+                     << static_cast<double>(std::uint64_t(1) << bits) * 1e-9 << "\"} " << cumulative << "\n";
+             }
+             out << "bank_op_latency_seconds_bucket{op=\"" << name << "\",le=\"+Inf\"} " << latencyCount[o] << "\n"
+                 << "bank_op_latency_seconds_sum{op=\"" << name << "\"} " << latencySumNanos[o] * 1e-9 << "\n"
+                 << "bank_op_latency_seconds_count{op=\"" << name << "\"} " << latencyCount[o] << "\n";
+         }
+ 
+         out << "# TYPE bank_accounts gauge\nbank_accounts " << accounts << "\n"
+             << "# TYPE bank_ledger_records gauge\nbank_ledger_records " << ledgerRecords << "\n"
+             << "# TYPE bank_ledger_bytes gauge\nbank_ledger_bytes " << ledgerBytes << "\n"
+             << "# TYPE bank_ledger_cold_records gauge\nbank_ledger_cold_records " << coldRecords << "\n"
+             << "# TYPE bank_ledger_cold_bytes gauge\nbank_ledger_cold_bytes " << coldBytes << "\n"
+             << "# TYPE bank_account_bytes gauge\nbank_account_bytes " << accountBytes << "\n"
+             << "# TYPE bank_bytes_per_account gauge\nbank_bytes_per_account " << bytesPerAccount << "\n";
+         out.flags(flags);
+         out.precision(precision);
+     }
+ };
+ 
+ class BankMetrics {
+ public:
+     static constexpr std::size_t kShards = kThreadShards;
+     static constexpr std::size_t kCounters = MetricsSnapshot::kCounters;
+     static constexpr std::size_t kOps = MetricsSnapshot::kOps;
+ 
+ private:
+     struct alignas(64) Shard {
+         std::atomic<std::uint64_t> counters[kCounters];
+         std::atomic<std::uint64_t> latencySum[kOps];
+         std::atomic<std::uint64_t> latency[kOps][LatencyBuckets::kCount];
+     };
+ 
+     std::unique_ptr<Shard[]> shards;
+ 
+     // The calling thread's shard (shared past kShards threads; every cell is an atomic add)
+     Shard& local() { return shards[threadShard()]; }
+ 
+     static MetricCounter outcomeCounter(MetricOp op, TxStatus status) {
+         switch (status) {
+             case TxStatus::Ok:
+                 return op == MetricOp::Deposit  ? MetricCounter::Deposits
+                      : op == MetricOp::Withdraw ? MetricCounter::Withdrawals
+                      : op == MetricOp::Transfer ? MetricCounter::Transfers : MetricCounter::InterestCredits;
+             case TxStatus::InsufficientFunds: return MetricCounter::InsufficientFunds;
+             case TxStatus::OverdraftExceeded: return MetricCounter::OverdraftExceeded;
+             case TxStatus::AccountNotFound:   return MetricCounter::AccountNotFound;
+             case TxStatus::InvalidAmount:     return MetricCounter::InvalidAmount;
+             case TxStatus::DuplicateTransaction: return MetricCounter::DuplicateTransactions;
+             case TxStatus::WithdrawalLimitExceeded:
+             case TxStatus::DailyLimitExceeded:
+             case TxStatus::VelocityLimitExceeded: return MetricCounter::LimitExceeded;
+             default:                          return MetricCounter::OtherRejections;
+         }
+     }
+ 
+ public:
+     BankMetrics() : shards(new Shard[kShards]) {
+         for (std::size_t s = 0; s < kShards; ++s) {
+             for (auto &c : shards[s].counters) {
+                 c.store(0, std::memory_order_relaxed);
+             }
+             for (std::size_t o = 0; o < kOps; ++o) {
+                 shards[s].latencySum[o].store(0, std::memory_order_relaxed);
+                 for (auto &b : shards[s].latency[o]) {
+                     b.store(0, std::memory_order_relaxed);
+                 }
+             }
+         }
+     }
+     BankMetrics(const BankMetrics&) = delete;
+     BankMetrics& operator=(const BankMetrics&) = delete;
+ 
+     void count(MetricCounter counter, std::uint64_t n = 1) {
+         local().counters[static_cast<std::size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+     }
+ 
+     // Count the outcome of one operation (Ok by op, rejections by status)
+     void countOutcome(MetricOp op, TxStatus status) { count(outcomeCounter(op, status)); }
+ 
+     void recordLatency(MetricOp op, std::uint64_t nanos) {
+         Shard &shard = local();
+         std::size_t o = static_cast<std::size_t>(op);
+         shard.latency[o][LatencyBuckets::bucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+         shard.latencySum[o].fetch_add(nanos, std::memory_order_relaxed);
+     }
+ 
+     void record(MetricOp op, TxStatus status, std::uint64_t nanos) {
+         countOutcome(op, status);
+         recordLatency(op, nanos);
+     }
+ 
+     // Merge every shard into `out` (counters and histograms only). Runs alongside recording;
+     // each cell is read once, so totals are exact for everything recorded before the call.
+     void collect(MetricsSnapshot &out) const {
+         for (std::size_t o = 0; o < kOps; ++o) {
+             out.latency[o].assign(LatencyBuckets::kCount, 0);
+         }
+         for (std::size_t s = 0; s < kShards; ++s) {
+             const Shard &shard = shards[s];
+             for (std::size_t c = 0; c < kCounters; ++c) {
+                 out.counters[c] += shard.counters[c].load(std::memory_order_relaxed);
+             }
+             for (std::size_t o = 0; o < kOps; ++o) {
+                 out.latencySumNanos[o] += shard.latencySum[o].load(std::memory_order_relaxed);
+                 for (std::size_t b = 0; b < LatencyBuckets::kCount; ++b) {
+                     std::uint64_t n = shard.latency[o][b].load(std::memory_order_relaxed);
+                     out.latency[o][b] += n;
+                     out.latencyCount[o] += n;
+                 }
+             }
+         }
+     }
+ };
+ 
+ /******************************************************
+  * MetricsEndpoint - Minimal HTTP /metrics responder
+  *  - One background thread on 127.0.0.1:<port>
+  *  - Answers "GET /metrics" with the text a caller-
+  *    supplied writer produces; anything else is a 404
+  *  - One request per connection; stop() joins
+  ******************************************************/
+ class MetricsEndpoint {
+ private:
+     int listenFd = -1;
+     std::atomic<bool> stopping{false};
+     std::function<void(std::ostream&)> writer;
+     std::thread server;
+ 
+     static void sendAll(int fd, const std::string &data) {
+         for (std::size_t at = 0; at < data.size(); ) {
+             ssize_t n = ::send(fd, data.data() + at, data.size() - at, MSG_NOSIGNAL);
+             if (n <= 0) {
+                 return;
+             }
+             at += static_cast<std::size_t>(n);
+         }
+     }
+ 
+     void serve() {
+         while (!stopping.load(std::memory_order_acquire)) {
+             pollfd waiting{listenFd, POLLIN, 0};
+             if (::poll(&waiting, 1, 100) <= 0) {
+                 continue;
+             }
+             int client = ::accept(listenFd, nullptr, nullptr);
+             if (client < 0) {
+                 continue;
+             }
+             char request[1024];
+             ssize_t n = ::recv(client, request, sizeof(request) - 1, 0);
+             std::string response;
+             if (n > 0 && std::strncmp(request, "GET /metrics", 12) == 0) {
+                 std::ostringstream body;
+                 writer(body);
+                 response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                          + std::to_string(body.str().size()) + "\r\nConnection: close\r\n\r\n" + body.str();
+             } else {
+                 response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+             }
+             sendAll(client, response);
+             ::close(client);
+         }
+     }
+ 
+ public:
+     MetricsEndpoint() {}
+     MetricsEndpoint(const MetricsEndpoint&) = delete;
+     MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+     ~MetricsEndpoint() { stop(); }
+ 
+     // Listen on loopback `port` and serve `write` output; false if the port can't be bound
+     bool start(std::uint16_t port, std::function<void(std::ostream&)> write) {
+         if (listenFd >= 0) {
+             return false;
+         }
+         int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+         if (fd < 0) {
+             return false;
+         }
+         int reuse = 1;
+         ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+         sockaddr_in address{};
+         address.sin_family = AF_INET;
+         address.sin_port = htons(port);
+         address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+         if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 16) != 0) {
+             ::close(fd);
+             return false;
+         }
+         listenFd = fd;
+         writer = std::move(write);
+         stopping.store(false, std::memory_order_release);
+         server = std::thread([this] { serve(); });
+         return true;
+     }
+ 
+     void stop() {
+         if (listenFd < 0) {
+             return;
+         }
+         stopping.store(true, std::memory_order_release);
+         server.join();
+         ::close(listenFd);
+         listenFd = -1;
+     }
+ };
+ 
+ /******************************************************
+  * Snapshot - Versioned binary image of a Bank
+  *  - Written in one sequential pass: header page, then
+  *    each table column as full segments, then the live
+  *    ledger segments, then the holder-name blob
+  *  - Every section is page-aligned and stored in the
+  *    in-memory layout, so loading maps the file
+  *    (MAP_PRIVATE) and points the table and ledger at it
+  *    directly; changes after loading are copy-on-write
+  *    and never reach the file
+  *  - Host byte order and struct layout; the header records
+  *    both and loading rejects a mismatch
+  *  - A 64-bit FNV-1a checksum covers the whole file (with
+  *    the checksum field zeroed), and loading checks every
+  *    ledger position and row reference before use, so a
+  *    damaged image fails with BadFormat instead of loading
+  ******************************************************/
+ enum class SnapshotStatus : std::uint8_t {
+     Ok,
+     IoError,          // could not open, write, stat or map the file
+     BadFormat,        // not a snapshot, truncated or damaged
+     LayoutMismatch,   // written by a build with another version, scale or layout
+     BankNotEmpty      // snapshots load into an empty Bank only
+ };
+ 
+ struct SnapshotHeader {
+     static constexpr char kMagic[8] = {'B', 'A', 'N', 'K', 'S', 'N', 'A', 'P'};
+     static constexpr std::uint32_t kVersion = 5;  // 2: adds logGeneration; 3: adds interest accrual epochs;
+                                                   // 4: adds withdrawal limits and usage; 5: adds checksum
+     static constexpr std::uint64_t kChecksumSeed = 14695981039346656037ull;  // FNV-1a offset basis
+     static constexpr std::uint32_t kByteOrderMark = 0x01020304;
+     static constexpr std::size_t kPageBytes = 4096;
+ 
+     char magic[8];
+     std::uint32_t version;
+     std::uint32_t byteOrderMark;
+     // Layout of this build
+     std::int64_t moneyScale;
+     std::int64_t rateScale;
+     std::uint64_t tableSegmentRows;
+     std::uint64_t ledgerSegmentRecords;
+     std::uint64_t ledgerSegmentBytes;  // sizeof(Ledger::Segment)
+     std::uint64_t ledgerSegmentStride; // ledgerSegmentBytes rounded up to a page
+     // Contents
+     std::uint64_t rows;
+     std::uint64_t columnOffset[AccountTable::kColumns];
+     std::uint64_t ledgerNextSequence;
+     std::uint64_t ledgerFirstSegment;
+     std::uint64_t ledgerSegments;
+     std::uint64_t ledgerOffset;
+     std::uint64_t holderOffset;        // (rows + 1) uint64 offsets, then the characters
+     std::uint64_t holderBytes;
+     std::uint64_t fileBytes;
+     std::uint64_t logGeneration;       // write-ahead log generation that continues this image
+     std::uint64_t interestEpoch;       // interest periods closed (rows settle up to it lazily)
+     std::uint64_t checksum;            // FNV-1a of the file with this field zeroed
+ 
+     // Continue a 64-bit FNV-1a hash over `bytes` more bytes
+     static std::uint64_t hashBytes(std::uint64_t hash, const void *data, std::size_t bytes) {
+         const unsigned char *p = static_cast<const unsigned char*>(data);
+         for (std::size_t i = 0; i < bytes; ++i) {
+             hash = (hash ^ p[i]) * 1099511628211ull;
+         }
+         return hash;
+     }
+ 
+     static std::uint64_t pageAlign(std::uint64_t offset) {
+         return (offset + kPageBytes - 1) & ~std::uint64_t(kPageBytes - 1);
+     }
+ 
+     // Header describing this build's layout, with empty contents
+     static SnapshotHeader forThisBuild() {
+         SnapshotHeader h;
+         std::memset(&h, 0, sizeof(h));
+         std::memcpy(h.magic, kMagic, sizeof(kMagic));
+         h.version = kVersion;
+         h.byteOrderMark = kByteOrderMark;
+         h.moneyScale = Money::scale;
+         h.rateScale = Rate::scale;
+         h.tableSegmentRows = AccountTable::kSegmentRows;
+         h.ledgerSegmentRecords = Ledger::kSegmentRecords;
+         h.ledgerSegmentBytes = sizeof(Ledger::Segment);
+         h.ledgerSegmentStride = pageAlign(sizeof(Ledger::Segment));
+         return h;
+     }
+ 
+     bool sameLayout(const SnapshotHeader &other) const {
+         return version == other.version && byteOrderMark == other.byteOrderMark
+             && moneyScale == other.moneyScale && rateScale == other.rateScale
+             && tableSegmentRows == other.tableSegmentRows
+             && ledgerSegmentRecords == other.ledgerSegmentRecords
+             && ledgerSegmentBytes == other.ledgerSegmentBytes
+             && ledgerSegmentStride == other.ledgerSegmentStride;
+     }
+ };
+ 
+ static_assert(sizeof(SnapshotHeader) <= SnapshotHeader::kPageBytes, "snapshot header fits in its page");
+ 
+ // Buffered sequential writer that tracks the file offset
+ class SnapshotWriter {
+ private:
+     std::FILE *file;
+     std::uint64_t offset;
+     std::uint64_t hash;  // of every byte written so far
+     bool failed;
+ 
+ public:
+     explicit SnapshotWriter(const std::string &path)
+         : file(std::fopen(path.c_str(), "wb")), offset(0), hash(SnapshotHeader::kChecksumSeed), failed(file == nullptr) {
+         if (file) {
+             std::setvbuf(file, nullptr, _IOFBF, std::size_t(1) << 20);
+         }
+     }
+ 
+     ~SnapshotWriter() {
+         if (file) {
+             std::fclose(file);
+         }
+     }
+ 
+     SnapshotWriter(const SnapshotWriter&) = delete;
+     SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+ 
+     void write(const void *data, std::size_t bytes) {
+         if (!failed && bytes != 0 && std::fwrite(data, 1, bytes, file) != bytes) {
+             failed = true;
+         }
+         hash = SnapshotHeader::hashBytes(hash, data, bytes);
+         offset += bytes;
+     }
+ 
+     std::uint64_t checksum() const { return hash; }
+ 
+     // Overwrite bytes already written at `at` (the header, once the checksum is known)
+     void rewrite(std::uint64_t at, const void *data, std::size_t bytes) {
+         if (!failed && (std::fflush(file) != 0 || std::fseek(file, static_cast<long>(at), SEEK_SET) != 0
+                         || std::fwrite(data, 1, bytes, file) != bytes)) {
+             failed = true;
+         }
+     }
+ 
+     // Zero-fill up to `target`
+     void padTo(std::uint64_t target) {
+         static const char zeros[SnapshotHeader::kPageBytes] = {};
+         while (offset < target) {
+             std::uint64_t gap = target - offset;
+             write(zeros, gap < sizeof(zeros) ? static_cast<std::size_t>(gap) : sizeof(zeros));
+         }
+     }
+ 
+     // Flush, sync and close; returns false if any write failed
+     bool finish() {
+         if (!file) {
+             return false;
+         }
+         failed = std::fflush(file) != 0 || !syncFile(::fileno(file)) || failed;
+         failed = std::fclose(file) != 0 || failed;
+         file = nullptr;
+         return !failed;
+     }
+ };
+ 
+ // Read-write private mapping of a whole file, unmapped on destruction
+ class MappedFile {
+ private:
+     char *base;
+     std::size_t length;
+ 
+ public:
+     MappedFile() : base(nullptr), length(0) {}
+ 
+     ~MappedFile() {
+         if (base) {
+             ::munmap(base, length);
+         }
+     }
+ 
+     MappedFile(const MappedFile&) = delete;
+     MappedFile& operator=(const MappedFile&) = delete;
+ 
+     bool open(const std::string &path) {
+         int fd = ::open(path.c_str(), O_RDONLY);
+         if (fd < 0) {
+             return false;
+         }
+         struct stat info;
+         bool ok = ::fstat(fd, &info) == 0 && info.st_size > 0;
+         if (ok) {
+             void *mapped = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+             ok = mapped != MAP_FAILED;
+             if (ok) {
+                 base = static_cast<char*>(mapped);
+                 length = static_cast<std::size_t>(info.st_size);
+             }
+         }
+         ::close(fd);  // the mapping stays valid
+         return ok;
+     }
+ 
+     char* data() const { return base; }
+     std::size_t size() const { return length; }
+ };
+ 
+ /******************************************************
+  * Account import - Bulk CSV onboarding
+  *  - One account per line:
+  *      holder,number,kind,balance,terms
+  *    kind is "savings" or "checking" (or S / C); terms is
+  *    the interest rate (savings) or overdraft limit
+  *    (checking); decimals are exact, never via double
+  *  - holder may be double-quoted ("" for a quote);
+  *    fields don't span lines; '#' lines and a leading
+  *    "holder,..." header are skipped
+  *  - The file is mapped and parsed in place: a parsed
+  *    record points into the mapping, and the holder is
+  *    copied once, into its account
+  ******************************************************/
+ struct ImportRecord {
+     std::uint64_t holderOffset;  // into the file
+     std::uint32_t holderLength;
+     std::uint32_t line;          // 1-based, within its chunk
+     int number;
+     AccountKind kind;
+     bool holderEscaped;          // quoted holder containing ""
+     bool accepted;               // set once duplicates are resolved
+     Money balance;
+     std::int64_t terms;          // Rate units (savings) or Money units (checking)
+ };
+ 
+ struct ImportReport {
+     bool fileRead;                  // false if the file is missing or empty
+     TxStatus status;                // Ok, CapacityExceeded (nothing imported) or NotDurable
+     std::size_t accepted;           // accounts created
+     std::size_t malformed;          // lines that didn't parse
+     std::size_t duplicates;         // numbers already in the bank or earlier in the file
+     std::size_t firstRejectedLine;  // 1-based; 0 if every line was accepted
+     double seconds;
+     double accountsPerSecond;
+ };
+ 
+ // Exact "[-]digits[.digits]" in units of `scale` (a power of ten); rejects junk, overflow,
+ // and more fraction digits than the scale can hold
+ inline bool parseScaled(const char *p, const char *end, std::int64_t scale, std::int64_t &out) {
+     bool negative = p != end && *p == '-';
+     p += negative;
+     if (p == end || *p == '.') {
+         return false;
+     }
+     std::int64_t units = 0;
+     for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+         if (__builtin_mul_overflow(units, 10, &units) || __builtin_add_overflow(units, *p - '0', &units)) {
+             return false;
+         }
+     }
+     std::int64_t fraction = scale;
+     if (__builtin_mul_overflow(units, scale, &units)) {
+         return false;
+     }
+     if (p != end && *p == '.') {
+         for (++p; p != end && *p >= '0' && *p <= '9'; ++p) {
+             fraction /= 10;
+             if (fraction == 0) {
+                 return false;
+             }
+             if (__builtin_add_overflow(units, (*p - '0') * fraction, &units)) {
+                 return false;
+             }
+         }
+     }
+     if (p != end) {
+         return false;
+     }
+     out = negative ? -units : units;
+     return true;
+ }
+ 
+ // Parse one line (without its newline) into `r`; false if malformed
+ inline bool parseImportLine(const char *base, const char *p, const char *end, ImportRecord &r) {
+     auto trim = [](const char *&b, const char *&e) {
+         while (b != e && (*b == ' ' || *b == '\t')) {
+             ++b;
+         }
+         while (e != b && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) {
+             --e;
+         }
+     };
+     auto nextField = [&](const char *&b, const char *&e) {
+         b = p;
+         while (p != end && *p != ',') {
+             ++p;
+         }
+         e = p;
+         if (p != end) {
+             ++p;
+         }
+         trim(b, e);
+     };
+ 
+     // Holder, optionally quoted
+     while (p != end && (*p == ' ' || *p == '\t')) {
+         ++p;
+     }
+     const char *holder = p, *holderEnd;
+     r.holderEscaped = false;
+     if (p != end && *p == '"') {
+         holder = ++p;
+         for (;; ++p) {
+             if (p == end) {
+                 return false;
+             }
+             if (*p == '"') {
+                 if (p + 1 != end && p[1] == '"') {
+                     r.holderEscaped = true;
+                     ++p;
+                 } else {
+                     break;
+                 }
+             }
+         }
+         holderEnd = p++;
+         while (p != end && (*p == ' ' || *p == '\t')) {
+             ++p;
+         }
+         if (p == end || *p != ',') {
+             return false;
+         }
+         ++p;
+     } else {
+         const char *b;
+         nextField(b, holderEnd);
+         holder = b;
+     }
+     r.holderOffset = static_cast<std::uint64_t>(holder - base);
+     r.holderLength = static_cast<std::uint32_t>(holderEnd - holder);
+ 
+     const char *b, *e;
+     std::int64_t number;
+     nextField(b, e);
+     if (!parseScaled(b, e, 1, number) || number < std::numeric_limits<int>::min() || number > std::numeric_limits<int>::max()) {
+         return false;
+     }
+     r.number = static_cast<int>(number);
+ 
+     nextField(b, e);
+     auto is = [&](const char *word) {  // case-insensitive compare of the current field
+         std::size_t n = std::strlen(word);
+         if (static_cast<std::size_t>(e - b) != n) {
+             return false;
+         }
+         for (std::size_t i = 0; i < n; ++i) {
+             if ((b[i] | 0x20) != word[i]) {
+                 return false;
+             }
+         }
+         return true;
+     };
+     if (is("savings") || is("s")) {
+         r.kind = AccountKind::Savings;
+     } else if (is("checking") || is("c")) {
+         r.kind = AccountKind::Checking;
+     } else {
+         return false;
+     }
+ 
+     std::int64_t balance;
+     nextField(b, e);
+     if (!parseScaled(b, e, Money::scale, balance)) {
+         return false;
+     }
+     r.balance = Money::fromUnits(balance);
+     nextField(b, e);
+     bool lastField = p == end;
+     return parseScaled(b, e, r.kind == AccountKind::Savings ? Rate::scale : Money::scale, r.terms) && lastField;
+ }
+ 
+ // Holder text of a parsed record
+ inline std::string importHolder(const char *base, const ImportRecord &r) {
+     const char *p = base + r.holderOffset;
+     std::string holder(p, r.holderLength);
+     if (r.holderEscaped) {
+         std::size_t out = 0;
+         for (std::size_t i = 0; i < holder.size(); ++i, ++out) {
+             holder[out] = holder[i];
+             i += holder[i] == '"';  // "" -> "
+         }
+         holder.resize(out);
+     }
+     return holder;
+ }
+ 
+ // Concurrent set of account numbers that keeps, per number, the smallest record ordinal
+ // that used it, so the first occurrence in the file wins whatever the thread timing
+ class ImportKeySet {
+ private:
+     std::size_t mask;
+     std::unique_ptr<std::atomic<std::uint64_t>[]> slots;  // (key << 32) | (ordinal + 1); 0 = empty
+ 
+     static std::uint64_t pack(int key, std::uint32_t ordinal) {
+         return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(key)) << 32) | (static_cast<std::uint64_t>(ordinal) + 1);
+     }
+     static int keyOf(std::uint64_t slot) { return static_cast<int>(static_cast<std::uint32_t>(slot >> 32)); }
+     static std::uint32_t ordinalOf(std::uint64_t slot) { return static_cast<std::uint32_t>(slot) - 1; }
+ 
+ public:
+     explicit ImportKeySet(std::size_t expected) {
+         std::size_t capacity = 16;
+         while (capacity < expected * 2) {
+             capacity *= 2;
+         }
+         mask = capacity - 1;
+         slots.reset(new std::atomic<std::uint64_t>[capacity]);
+         for (std::size_t i = 0; i < capacity; ++i) {
+             slots[i].store(0, std::memory_order_relaxed);
+         }
+     }
+ 
+     void claim(int key, std::uint32_t ordinal) {
+         std::uint64_t mine = pack(key, ordinal);
+         for (std::size_t i = AccountIndex::hashKey(key) & mask; ; i = (i + 1) & mask) {
+             std::uint64_t current = slots[i].load(std::memory_order_relaxed);
+             for (;;) {
+                 if (current != 0 && keyOf(current) != key) {
+                     break;  // another key: keep probing
+                 }
+                 if (current != 0 && ordinalOf(current) <= ordinal) {
+                     return;
+                 }
+                 if (slots[i].compare_exchange_weak(current, mine, std::memory_order_relaxed)) {
+                     return;
+                 }
+             }
+         }
+     }
+ 
+     // Smallest ordinal claimed for `key` (the key must have been claimed)
+     std::uint32_t owner(int key) const {
+         for (std::size_t i = AccountIndex::hashKey(key) & mask; ; i = (i + 1) & mask) {
+             std::uint64_t current = slots[i].load(std::memory_order_relaxed);
+             if (current != 0 && keyOf(current) == key) {
+                 return ordinalOf(current);
+             }
+         }
+     }
+ };
+ 
+ /******************************************************
+  * DedupFilter - Time-windowed set of recent client
+  *   transaction ids, so retried operations apply once
+  *  - Ids hash to one of kStripes stripes; each stripe
+  *    keeps two generations. New ids join the current
+  *    one; once it is `window` old (or full) the older
+  *    generation is dropped and a new one starts, so an
+  *    id is remembered for at least `window`, unless more
+  *    than `capacity` ids arrive within one window
+  *  - The set is exact: ids live in cache-line buckets of
+  *    kBucketSlots, each slot tagged with its generation,
+  *    and an id only ever sits in its home bucket or the
+  *    next one (flagged in the home bucket). A check reads
+  *    one cache line, whichever generation holds the id,
+  *    so no approximate filter is needed in front
+  *  - Memory is fixed when the filter is built: 37 to 73
+  *    bytes per id of capacity (bucket counts round up to
+  *    powers of two), whatever the rate
+  *  - Id 0 (kUntracked) is never remembered
+  *
+  * Thread safety:
+  *  - claim() and release() lock the id's stripe
+  *    (a SpinLock); any number of threads may call them
+  ******************************************************/
+ class DedupFilter {
+ public:
+     static constexpr std::uint64_t kUntracked = 0;
+     static constexpr unsigned kStripeBits = 6;
+     static constexpr std::size_t kStripes = std::size_t(1) << kStripeBits;
+     static constexpr std::size_t kBucketSlots = 7;
+ 
+ private:
+     static constexpr unsigned kClockInterval = 64;  // claims between clock reads
+ 
+     struct alignas(64) Bucket {
+         std::uint64_t ids[kBucketSlots];  // 0 = empty
+         std::uint8_t generation;          // bit i set: ids[i] belongs to generation 1, else 0
+         std::uint8_t overflow;            // bit g set: an id of generation g homed here is in the next bucket
+     };
+     static_assert(sizeof(Bucket) == 64, "a bucket is one cache line");
+ 
+     struct Stripe {
+         SpinLock lock;
+         std::unique_ptr<Bucket[]> buckets;
+         std::size_t count[2] = {0, 0};    // ids per generation
+         unsigned current = 0;             // generation taking new ids
+         unsigned untilClock = 0;          // claims left before the clock is read again
+         std::int64_t startedAt = 0;       // steady-clock ns when `current` started
+     };
+ 
+     std::chrono::nanoseconds window;
+     std::size_t stripeCapacity;           // ids per generation per stripe
+     std::size_t mask;                     // buckets per stripe - 1
+     std::unique_ptr<Stripe[]> stripes;
+ 
+     static std::uint64_t mix(std::uint64_t x) {
+         x ^= x >> 30;
+         x *= 0xBF58476D1CE4E5B9ull;
+         x ^= x >> 27;
+         x *= 0x94D049BB133111EBull;
+         return x ^ (x >> 31);
+     }
+ 
+     static std::int64_t nowNanos() {
+         return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+     }
+ 
+     Stripe& stripeOf(std::uint64_t h) const { return stripes[h >> (64 - kStripeBits)]; }
+ 
+     // Slot holding `id` in its home bucket or the next one, or nullptr (stripe lock held)
+     std::uint64_t* find(Stripe &s, std::uint64_t id, std::uint64_t h) const {
+         Bucket &home = s.buckets[h & mask];
+         for (std::uint64_t &slot : home.ids) {
+             if (slot == id) {
+                 return &slot;
+             }
+         }
+         if (home.overflow) {
+             for (std::uint64_t &slot : s.buckets[(h + 1) & mask].ids) {
+                 if (slot == id) {
+                     return &slot;
+                 }
+             }
+         }
+         return nullptr;
+     }
+ 
+     // Place `id` in the current generation; false if both candidate buckets are full
+     bool insert(Stripe &s, std::uint64_t id, std::uint64_t h) {
+         for (std::size_t probe = 0; probe < 2; ++probe) {
+             Bucket &b = s.buckets[(h + probe) & mask];
+             for (std::size_t i = 0; i < kBucketSlots; ++i) {
+                 if (b.ids[i] == 0) {
+                     b.ids[i] = id;
+                     b.generation = static_cast<std::uint8_t>((b.generation & ~(1u << i)) | (s.current << i));
+                     s.buckets[h & mask].overflow |= static_cast<std::uint8_t>(probe << s.current);
+                     ++s.count[s.current];
+                     return true;
+                 }
+             }
+         }
+         return false;
+     }
+ 
+     // Drop the older generation and make it the current one (stripe lock held)
+     void rotate(Stripe &s, std::int64_t now) {
+         unsigned dropped = s.current ^ 1;
+         if (s.count[dropped] != 0) {
+             for (std::size_t b = 0; b <= mask; ++b) {
+                 Bucket &bucket = s.buckets[b];
+                 unsigned keep = dropped ? ~bucket.generation : bucket.generation;
+                 for (std::size_t i = 0; i < kBucketSlots; ++i) {
+                     bucket.ids[i] &= std::uint64_t(0) - ((keep >> i) & 1u);  // branch-free: tags are random
+                 }
+                 bucket.overflow &= static_cast<std::uint8_t>(~(1u << dropped));
+             }
+         }
+         s.count[dropped] = 0;
+         s.current = dropped;
+         s.startedAt = now;
+     }
+ 
+     void maybeRotate(Stripe &s) {
+         if (s.untilClock-- != 0) {
+             return;
+         }
+         s.untilClock = kClockInterval - 1;
+         std::int64_t now = nowNanos();
+         std::int64_t age = now - s.startedAt;
+         if (age >= window.count()) {
+             rotate(s, now);
+             if (age >= 2 * window.count()) {
+                 rotate(s, now);  // both generations have expired
+             }
+         }
+     }
+ 
+ public:
+     // Remember ids for at least `window`, up to `capacity` ids per window
+     DedupFilter(std::chrono::nanoseconds idWindow, std::size_t capacity)
+         : window(idWindow), stripes(new Stripe[kStripes]) {
+         stripeCapacity = (capacity + kStripes - 1) / kStripes;
+         std::size_t buckets = 4;
+         while (buckets * kBucketSlots < stripeCapacity * 4) {
+             buckets *= 2;  // both generations at capacity fill at most half the slots
+         }
+         mask = buckets - 1;
+         std::int64_t now = nowNanos();
+         for (std::size_t i = 0; i < kStripes; ++i) {
+             stripes[i].buckets.reset(new Bucket[buckets]());
+             stripes[i].startedAt = now;
+         }
+     }
+ 
+     static bool tracks(std::uint64_t id) { return id != kUntracked; }
+ 
+     // Record `id`; false if it was already seen within the window (a duplicate)
+     bool claim(std::uint64_t id) {
+         std::uint64_t h = mix(id);
+         Stripe &s = stripeOf(h);
+         std::lock_guard<SpinLock> guard(s.lock);
+         maybeRotate(s);
+         if (find(s, id, h)) {
+             return false;
+         }
+         if (s.count[s.current] >= stripeCapacity || !insert(s, id, h)) {
+             // Full before the window ended (or an unlucky cluster): the window shrinks
+             rotate(s, nowNanos());
+             if (!insert(s, id, h)) {
+                 rotate(s, nowNanos());
+                 insert(s, id, h);
+             }
+         }
+         return true;
+     }
+ 
+     // Forget a claimed id (its operation was rejected), so a retry may run
+     void release(std::uint64_t id) {
+         std::uint64_t h = mix(id);
+         Stripe &s = stripeOf(h);
+         std::lock_guard<SpinLock> guard(s.lock);
+         if (std::uint64_t *slot = find(s, id, h)) {
+             *slot = 0;
+         }
+     }
+ 
+     // Run `op` (returning a TxStatus) at most once per tracked id: a duplicate returns
+     // DuplicateTransaction without running it; a rejected attempt releases the id, so a
+     // corrected retry can run. NotDurable keeps the id: the change was applied in memory.
+     template <typename Op>
+     TxStatus applyOnce(std::uint64_t id, Op &&op) {
+         if (!tracks(id)) {
+             return op();
+         }
+         if (!claim(id)) {
+             return TxStatus::DuplicateTransaction;
+         }
+         TxStatus status = op();
+         if (status != TxStatus::Ok && status != TxStatus::NotDurable) {
+             release(id);
+         }
+         return status;
+     }
+ 
+     std::size_t memoryBytes() const {
+         return sizeof(*this) + kStripes * (sizeof(Stripe) + (mask + 1) * sizeof(Bucket));
+     }
+ };
+ 
+ /******************************************************
+  * Bank Class
+  *  - Manages a list of BankAccounts (including derived).
+  *  - Offers methods to create accounts, find accounts,
+  *    and handle deposits/withdrawals.
+  *  - Keeps an AccountIndex in sync for O(1) lookups.
+  *  - Owns one ObjectPool per account type.
+  *  - Hot fields live in an AccountTable; BankAccount
+  *    objects are views over its rows.
+  *  - All transactions go to one bank-wide Ledger.
+  *  - Operations return TxStatus/TxResult and never print;
+  *    diagnostics go to an optional asynchronous LogSink.
+  *
+  * Thread safety:
+  *  - Every public method may be called from any thread
+  *  - Lookups are lock-free; balance updates take one
+  *    stripe spinlock; account creation is serialized by
+  *    createMutex and publishes the row before indexing it
+  ******************************************************/
+ class Bank {
+ private:
+     std::unique_ptr<MappedFile> snapshot;  // mapped snapshot backing table/ledger rows; outlives them
+     AccountTable table;
+     std::unique_ptr<ColdHistory> coldHistory;  // evicted history (enableColdHistory); outlives the ledger
+     Ledger ledger;
+     ObjectPool<SavingsAccount> savingsPool;
+     ObjectPool<CheckingAccount> checkingPool;
+     SegmentedColumn<BankAccount*> views;  // row -> account view, in creation order
+     AccountIndex index;                   // accountNumber -> row
+     mutable std::mutex createMutex;       // serializes account creation (and snapshots)
+     std::unique_ptr<WriteAheadLog> wal;   // durability log; null until enableDurability()
+     std::string checkpointPath;           // snapshot that the log continues
+     std::uint64_t logGeneration = 0;      // generation of the log that continues the state
+     std::atomic<LogSink*> logSink{nullptr};  // diagnostics; nullptr = off
+     std::atomic<BankMetrics*> metrics{nullptr};  // counters and latencies; nullptr = off
+ 
+     // Legs of cross-bank transfers between prepare and commit/abort (see ShardedBank)
+     struct PreparedTransfer {
+         std::size_t row;
+         Money amount;
+         bool debit;  // funds already taken from the row; a credit is applied on commit
+     };
+     std::mutex transferMutex;
+     std::unordered_map<std::uint64_t, PreparedTransfer> preparedTransfers;
+     std::unique_ptr<DedupFilter> dedup;   // client transaction ids (enableDeduplication)
+     std::unique_ptr<MetricsEndpoint> metricsEndpoint;  // declared last: stops before the rest is torn down
+ 
+     static std::uint64_t monotonicNanos() {
+         return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count());
+     }
+ 
+     // Start time for a timed operation; the clock is only read while metrics are attached
+     static std::uint64_t metricsStart(const BankMetrics *m) { return m ? monotonicNanos() : 0; }
+ 
+     // Run `op` through the dedup filter, if one is enabled; a duplicate is noted and counted
+     // like any other rejection
+     template <typename Op>
+     TxStatus once(std::uint64_t clientTxId, MetricOp metricOp, LogEvent event, int account, Money amount, Op &&op) {
+         if (!dedup) {
+             return op();
+         }
+         TxStatus status = dedup->applyOnce(clientTxId, op);
+         if (status == TxStatus::DuplicateTransaction) {
+             note(event, status, account, amount);
+             if (BankMetrics *m = metrics.load(std::memory_order_relaxed)) {
+                 m->countOutcome(metricOp, status);
+             }
+         }
+         return status;
+     }
+ 
+     // Record an operation's outcome and latency if metrics were attached when it started
+     static TxStatus recordMetric(BankMetrics *m, MetricOp op, TxStatus status, std::uint64_t start) {
+         if (m) {
+             m->record(op, status, monotonicNanos() - start);
+         }
+         return status;
+     }
+ 
+     // Count a successful withdrawal or transfer that left a (checking) row below zero (row lock held)
+     void noteOverdraft(std::size_t row) const {
+         if (table.balance(row) < Money()) {
+             if (BankMetrics *m = metrics.load(std::memory_order_relaxed)) {
+                 m->count(MetricCounter::OverdraftWithdrawals);
+             }
+         }
+     }
+ 
+     // Credit the TransferIn of a prepared leg already taken out of preparedTransfers; if the
+     // balance can't hold it, put the leg back and return false
+     bool creditPrepared(std::uint64_t transferId, const PreparedTransfer &leg) {
+         {
+             std::lock_guard<SpinLock> guard(table.lockFor(leg.row));
+             AccountOps::settle(table, ledger, leg.row);
+             if (table.creditBalance(leg.row, leg.amount)) {
+                 AccountOps::log(table, ledger, leg.row, TransactionType::TransferIn, leg.amount);
+                 return true;
+             }
+         }
+         note(LogEvent::Transfer, TxStatus::BalanceOverflow, table.id(leg.row), leg.amount);
+         std::lock_guard<std::mutex> guard(transferMutex);
+         preparedTransfers[transferId] = leg;
+         return false;
+     }
+ 
+     // Queue a diagnostic record if a sink is attached (never blocks)
+     void note(LogEvent event, TxStatus status, int account, Money amount = Money(), int otherAccount = 0) const {
+         if (LogSink *sink = logSink.load(std::memory_order_acquire)) {
+             sink->push(LogRecord{currentTimeMicros(), amount, account, otherAccount, event, status});
+         }
+     }
+ 
+     // With a write-ahead log attached, wait until everything appended so far (which
+     // includes the caller's records) is durable. Called without any lock held.
+     TxStatus awaitDurable(TxStatus status) {
+         if (status == TxStatus::Ok && wal) {
+             if (DeferredDurability *scope = DeferredDurability::current()) {
+                 scope->defer(wal.get(), wal->appendedPosition());
+             } else if (!wal->waitDurable(wal->appendedPosition())) {
+                 return TxStatus::NotDurable;
+             }
+         }
+         return status;
+     }
+ 
+     // Batch form: Ok entries become NotDurable if the log write failed
+     std::vector<TxStatus> awaitDurable(std::vector<TxStatus> statuses) {
+         if (wal && awaitDurable(TxStatus::Ok) != TxStatus::Ok) {
+             for (TxStatus &status : statuses) {
+                 if (status == TxStatus::Ok) {
+                     status = TxStatus::NotDurable;
+                 }
+             }
+         }
+         return statuses;
+     }
+ 
+     // Journal a creation just stored at `row` (createMutex held)
+     void journalCreation(std::size_t row) {
+         if (wal) {
+             wal->appendCreation(WriteAheadLog::Creation{
+                 static_cast<std::uint32_t>(row), table.id(row), static_cast<std::uint8_t>(table.kind(row)),
+                 table.balance(row).raw(), table.interestRate(row).raw(), table.overdraftLimit(row).raw(),
+                 table.holderName(row)});
+         }
+     }
+ 
+     // Pass a status through, noting it in the log when the operation was rejected
+     TxStatus noteIfRejected(TxStatus status, LogEvent event, int account, Money amount) const {
+         if (status != TxStatus::Ok) {
+             note(event, status, account, amount);
+         }
+         return status;
+     }
+ 
+     // Check that `number` may be added (createMutex held)
+     TxStatus acceptNewAccount(int number) const {
+         if (index.find(number) != AccountIndex::npos) {
+             return TxStatus::AccountExists;
+         }
+         if (table.pendingSize() >= AccountTable::kMaxRows) {
+             return TxStatus::CapacityExceeded;
+         }
+         return TxStatus::Ok;
+     }
+ 
+     // Apply one batched operation to a row without printing (row lock held)
+     TxStatus applyToRow(std::size_t row, TxOp op, Money amount) {
+         switch (op) {
+             case TxOp::Deposit:  return AccountOps::deposit(table, ledger, row, amount);
+             case TxOp::Withdraw: {
+                 TxStatus status = AccountOps::withdraw(table, ledger, row, amount);
+                 if (status == TxStatus::Ok) {
+                     noteOverdraft(row);
+                 }
+                 return status;
+             }
+             case TxOp::Interest: return AccountOps::creditInterest(table, ledger, row).status;
+         }
+         return TxStatus::InvalidAmount;
+     }
+ 
+     // Look up and lock one account, then apply `op` (row-level; no account object involved)
+     TxStatus applyToAccount(int accountNumber, TxOp op, Money amount) {
+         std::size_t row = index.find(accountNumber);
+         if (row == AccountIndex::npos) {
+             return TxStatus::AccountNotFound;
+         }
+         std::lock_guard<SpinLock> guard(table.lockFor(row));
+         return applyToRow(row, op, amount);
+     }
+ 
+     // One account's requests inside a sorted batch: order[begin, end) all target `row`
+     struct BatchRun {
+         std::size_t begin;
+         std::size_t end;
+         std::size_t row;  // AccountIndex::npos if the account does not exist
+     };
+ 
+     // Sort request indices by account (stable, so per-account order is kept) and resolve each account once
+     std::vector<BatchRun> planBatch(Span<const TxRequest> requests, std::vector<std::uint32_t> &order) const {
+         order.resize(requests.size());
+         for (std::size_t i = 0; i < order.size(); ++i) {
+             order[i] = static_cast<std::uint32_t>(i);
+         }
+         std::stable_sort(order.begin(), order.end(), [&requests](std::uint32_t a, std::uint32_t b) {
+             return requests[a].accountNumber < requests[b].accountNumber;
+         });
+ 
+         std::vector<BatchRun> runs;
+         for (std::size_t begin = 0; begin < order.size(); ) {
+             int number = requests[order[begin]].accountNumber;
+             std::size_t end = begin + 1;
+             while (end < order.size() && requests[order[end]].accountNumber == number) {
+                 ++end;
+             }
+             runs.push_back(BatchRun{begin, end, index.find(number)});
+             begin = end;
+         }
+         return runs;
+     }
+ 
+     // Pre-validation stage of a planned batch, without any lock: gather each request's
+     // amount, product cap, and its row's limits and usage (relaxed loads) into lanes and
+     // reject, lane-parallel, the requests that break a rule on their own. Rejections
+     // follow the scalar order: InvalidAmount, WithdrawalLimitExceeded, DailyLimitExceeded,
+     // VelocityLimitExceeded. Usage only grows within a day or window, so unless the
+     // limits change meanwhile a request rejected here would fail under the lock too.
+     void prevalidate(Span<const TxRequest> requests, const std::vector<std::uint32_t> &order,
+                      const std::vector<BatchRun> &runs, BatchValidation &out) const {
+         out.reset(requests.size());
+         LimitWindows now = table.limitWindows(currentTimeMicros());
+         LimitLanes lanes;
+         std::uint32_t laneRequest[LimitLanes::kLanes];
+         std::size_t n = 0;
+         auto flush = [&] {
+             LimitMasks masks = checkLimitLanes(lanes, n, now);
+             if (masks.any() != 0) {
+                 for (std::size_t lane = 0; lane < n; ++lane) {
+                     std::uint64_t bit = std::uint64_t(1) << lane;
+                     if (masks.invalid & bit) {
+                         out.reject(laneRequest[lane], TxStatus::InvalidAmount);
+                     } else if (masks.overCap & bit) {
+                         out.reject(laneRequest[lane], TxStatus::WithdrawalLimitExceeded);
+                     } else if (masks.overDay & bit) {
+                         out.reject(laneRequest[lane], TxStatus::DailyLimitExceeded);
+                     } else if (masks.overRate & bit) {
+                         out.reject(laneRequest[lane], TxStatus::VelocityLimitExceeded);
+                     }
+                 }
+             }
+             n = 0;
+         };
+         for (const BatchRun &run : runs) {
+             if (run.row == AccountIndex::npos) {
+                 for (std::size_t i = run.begin; i < run.end; ++i) {
+                     out.reject(order[i], TxStatus::AccountNotFound);
+                 }
+                 continue;
+             }
+             std::int64_t cap = productRules(table.kind(run.row)).withdrawalCap.raw();
+             std::int64_t dailyLimit = table.dailyLimit(run.row);
+             std::int64_t windowLimit = table.windowLimit(run.row);
+             std::int64_t dailyUsage = static_cast<std::int64_t>(table.dailyUsage(run.row));
+             std::int64_t windowUsage = static_cast<std::int64_t>(table.windowUsage(run.row));
+             for (std::size_t i = run.begin; i < run.end; ++i) {
+                 const TxRequest &request = requests[order[i]];
+                 lanes.amount[n] = request.amount.raw();
+                 lanes.debit[n] = request.op == TxOp::Withdraw ? -1 : 0;
+                 lanes.checked[n] = request.op == TxOp::Interest ? 0 : -1;
+                 lanes.cap[n] = cap;
+                 lanes.dailyLimit[n] = dailyLimit;
+                 lanes.dailyUsage[n] = dailyUsage;
+                 lanes.windowLimit[n] = windowLimit;
+                 lanes.windowUsage[n] = windowUsage;
+                 laneRequest[n] = order[i];
+                 if (++n == LimitLanes::kLanes) {
+                     flush();
+                 }
+             }
+         }
+         if (n != 0) {
+             flush();
+         }
+     }
+ 
+     // Apply runs[first, last) of a planned batch, taking each account's lock once.
+     // Requests a `validation` rejected take its status; a run with none left takes no lock
+     void applyRuns(Span<const TxRequest> requests, const std::vector<std::uint32_t> &order,
+                    const std::vector<BatchRun> &runs, std::size_t first, std::size_t last,
+                    const BatchValidation *validation, std::vector<TxStatus> &statuses) {
+         for (std::size_t r = first; r < last; ++r) {
+             const BatchRun &run = runs[r];
+             if (run.row == AccountIndex::npos) {
+                 for (std::size_t i = run.begin; i < run.end; ++i) {
+                     statuses[order[i]] = TxStatus::AccountNotFound;
+                 }
+             } else {
+                 std::unique_lock<SpinLock> guard(table.lockFor(run.row), std::defer_lock);
+                 for (std::size_t i = run.begin; i < run.end; ++i) {
+                     if (validation && !validation->accepted(order[i])) {
+                         statuses[order[i]] = validation->status(order[i]);
+                         continue;
+                     }
+                     if (!guard.owns_lock()) {
+                         guard.lock();
+                     }
+                     const TxRequest &request = requests[order[i]];
+                     statuses[order[i]] = applyToRow(run.row, request.op, request.amount);
+                 }
+             }
+             if (logSink.load(std::memory_order_relaxed) != nullptr) {
+                 for (std::size_t i = run.begin; i < run.end; ++i) {
+                     const TxRequest &request = requests[order[i]];
+                     LogEvent event = request.op == TxOp::Deposit ? LogEvent::Deposit
+                                    : request.op == TxOp::Withdraw ? LogEvent::Withdrawal : LogEvent::Interest;
+                     noteIfRejected(statuses[order[i]], event, request.accountNumber, request.amount);
+                 }
+             }
+             if (BankMetrics *m = metrics.load(std::memory_order_relaxed)) {
+                 for (std::size_t i = run.begin; i < run.end; ++i) {
+                     m->countOutcome(metricOpOf(requests[order[i]].op), statuses[order[i]]);
+                 }
+             }
+         }
+     }
+ 
+     // applyBatch with a given validation, or (null) one run here if any row has limits
+     std::vector<TxStatus> applyValidatedBatch(Span<const TxRequest> requests, const BatchValidation *given) {
+         BankMetrics *m = metrics.load(std::memory_order_acquire);
+         std::uint64_t start = metricsStart(m);
+         std::vector<std::uint32_t> order;
+         std::vector<BatchRun> runs = planBatch(requests, order);
+         std::vector<TxStatus> statuses(requests.size(), TxStatus::Ok);
+         BatchValidation stage;
+         const BatchValidation *validation = given;
+         if (!validation && table.limitedRowCount() != 0) {
+             prevalidate(requests, order, runs, stage);
+             validation = &stage;
+         }
+         applyRuns(requests, order, runs, 0, runs.size(), validation, statuses);
+         statuses = awaitDurable(std::move(statuses));
+         if (m) {
+             m->recordLatency(MetricOp::Batch, monotonicNanos() - start);
+         }
+         return statuses;
+     }
+ 
+     // Resolve a history cursor for `row` into the sequence to start walking from.
+     // An evicted cursor can't be checked; walking from it ends at once.
+     TxStatus resolveCursor(std::size_t row, std::uint64_t cursor, std::uint64_t &start) const {
+         std::uint64_t head;
+         {
+             std::lock_guard<SpinLock> guard(table.lockFor(row));
+             head = table.historyHead(row);
+         }
+         start = cursor == HistoryPage::kNewest ? head : cursor;
+         if (start == Ledger::kNoRecord || cursor == HistoryPage::kNewest) {
+             return TxStatus::Ok;
+         }
+         if (start > head) {
+             return TxStatus::InvalidCursor;
+         }
+         auto readGuard = ledger.readGuard();
+         if (ledger.find(start)) {
+             return ledger.accountRowOf(start) == row ? TxStatus::Ok : TxStatus::InvalidCursor;
+         }
+         std::shared_ptr<const ColdHistory::Frame> frame = ledger.coldFrame(start);
+         return !frame || frame->rowOf(start) == row ? TxStatus::Ok : TxStatus::InvalidCursor;
+     }
+ 
+     // The account object for a stored row: interest-bearing products get a SavingsAccount
+     // view, the rest a CheckingAccount view (createMutex held)
+     BankAccount* createView(std::size_t row) {
+         if (productRules(table.kind(row)).interest) {
+             return savingsPool.create(table, ledger, row);
+         }
+         return checkingPool.create(table, ledger, row);
+     }
+ 
+     // Make a stored row and its view visible, then index it (createMutex held)
+     void publishAccount(int number, std::size_t row, BankAccount *view) {
+         views.ensure(row);
+         views[row] = view;
+         table.publishRows();
+         index.insert(number, row);
+     }
+ 
+ public:
+     // While one is alive on a thread, operations on that thread don't wait for their log
+     // records to be synced: they return at once (Ok stays Ok) and note the log position
+     // to wait for here. The caller then waits for log()->whenDurable(position()) and
+     // treats a failed write as NotDurable. Used by AsyncBank to wait without a thread.
+     class DeferredDurability {
+     private:
+         WriteAheadLog *logged = nullptr;
+         std::uint64_t until = 0;
+         DeferredDurability *outer;
+ 
+         static DeferredDurability*& current() {
+             static thread_local DeferredDurability *scope = nullptr;
+             return scope;
+         }
+ 
+         void defer(WriteAheadLog *log, std::uint64_t position) {
+             logged = log;
+             until = std::max(until, position);
+         }
+ 
+         friend class Bank;
+ 
+     public:
+         DeferredDurability() : outer(current()) { current() = this; }
+         ~DeferredDurability() { current() = outer; }
+ 
+         DeferredDurability(const DeferredDurability&) = delete;
+         DeferredDurability& operator=(const DeferredDurability&) = delete;
+ 
+         WriteAheadLog* log() const { return logged; }  // null: nothing to wait for
+         std::uint64_t position() const { return until; }
+     };
+ 
+     Bank() {}
+     // Account objects are destroyed and released in bulk by the pools
+     ~Bank() {}
+ 
+     // Create and store a new account of any product (rejects duplicate account numbers).
+     // The rate is kept only if the product earns interest, the limit only if it has an overdraft.
+     TxStatus createAccount(AccountKind kind, const std::string &holder, int number, Money initialBalance,
+                            Rate interestRate, Money overdraftLimit) {
+         const ProductRules &rules = productRules(kind);
+         TxStatus status;
+         {
+             std::lock_guard<std::mutex> guard(createMutex);
+             status = initialBalance.isValid() && interestRate.isValid() && overdraftLimit.isValid()
+                    ? acceptNewAccount(number) : TxStatus::InvalidAmount;
+             if (status == TxStatus::Ok) {
+                 std::size_t row = table.addRow(number, kind, initialBalance, rules.interest ? interestRate : Rate(),
+                                                rules.overdraft ? overdraftLimit : Money(), table.holderNames().intern(holder));
+                 journalCreation(row);
+                 publishAccount(number, row, createView(row));
+             }
+         }
+         note(LogEvent::AccountCreated, status, number, initialBalance);
+         return awaitDurable(status);
+     }
+ 
+     // Create an account of a product known at compile time, e.g. createAccount<MoneyMarketProduct>
+     template <class P>
+     TxStatus createAccount(const std::string &holder, int number, Money initialBalance,
+                            Rate interestRate = Rate(), Money overdraftLimit = Money()) {
+         return createAccount(P::kKind, holder, number, initialBalance, interestRate, overdraftLimit);
+     }
+ 
+     // Create and store a new SavingsAccount (rejects duplicate account numbers)
+     TxStatus createSavingsAccount(const std::string &holder, int number, Money initialBalance, Rate interestRate) {
+         return createAccount<SavingsProduct>(holder, number, initialBalance, interestRate);
+     }
+ 
+     // Create and store a new CheckingAccount (rejects duplicate account numbers)
+     TxStatus createCheckingAccount(const std::string &holder, int number, Money initialBalance, Money overdraftLimit) {
+         return createAccount<CheckingProduct>(holder, number, initialBalance, Rate(), overdraftLimit);
+     }
+ 
+     // Create every account listed in the CSV file at `path` (format: see ImportRecord).
+     // The file is mapped and split into `threads` line ranges that are parsed, checked for
+     // duplicates (first occurrence wins) and stored in parallel into storage pre-sized for
+     // the whole file; only index insertion (and journaling, if durable) runs on one thread.
+     // Rejected lines are counted, not fatal. Blocks other account creation while it runs.
+     ImportReport importAccounts(const std::string &path, unsigned threads = std::thread::hardware_concurrency()) {
+         auto begin = std::chrono::steady_clock::now();
+         ImportReport report{false, TxStatus::Ok, 0, 0, 0, 0, 0.0, 0.0};
+         MappedFile file;
+         if (!file.open(path)) {
+             return report;
+         }
+         report.fileRead = true;
+         const char *base = file.data();
+         const char *fileEnd = base + file.size();
+ 
+         // Split at line boundaries
+         struct Chunk {
+             const char *begin;
+             const char *end;
+             std::vector<ImportRecord> records;
+             std::size_t lines = 0;
+             std::size_t firstOrdinal = 0;       // ordinal of records[0] across the file
+             std::size_t firstRow = 0;           // row of the first accepted record
+             std::size_t savings = 0, checking = 0, savingsBefore = 0, checkingBefore = 0;
+             std::size_t malformed = 0, duplicates = 0;
+             std::size_t firstRejected = 0;      // chunk-local line, 0 = none
+         };
+         unsigned shards = threads == 0 ? 1 : threads;
+         std::vector<Chunk> chunks;
+         for (const char *at = base; at < fileEnd; ) {
+             const char *cut = chunks.size() + 1 == shards ? fileEnd : at + (fileEnd - at) / (shards - chunks.size());
+             cut = cut >= fileEnd ? fileEnd : static_cast<const char*>(std::memchr(cut, '\n', fileEnd - cut));
+             cut = cut == nullptr || cut == fileEnd ? fileEnd : cut + 1;
+             chunks.emplace_back();
+             chunks.back().begin = at;
+             chunks.back().end = cut;
+             at = cut;
+         }
+         auto inParallel = [&](const std::function<void(Chunk&)> &work) {
+             std::vector<std::thread> workers;
+             for (std::size_t c = 1; c < chunks.size(); ++c) {
+                 workers.emplace_back([&, c] { work(chunks[c]); });
+             }
+             work(chunks[0]);
+             for (auto &worker : workers) {
+                 worker.join();
+             }
+         };
+         auto reject = [](Chunk &chunk, std::size_t line) {
+             if (chunk.firstRejected == 0 || line < chunk.firstRejected) {
+                 chunk.firstRejected = line;
+             }
+         };
+ 
+         // 1. Parse in place
+         inParallel([&](Chunk &chunk) {
+             chunk.records.reserve(static_cast<std::size_t>(chunk.end - chunk.begin) / 32 + 1);
+             for (const char *line = chunk.begin; line < chunk.end; ) {
+                 const char *newline = static_cast<const char*>(std::memchr(line, '\n', chunk.end - line));
+                 const char *lineEnd = newline ? newline : chunk.end;
+                 ++chunk.lines;
+                 const char *first = line;
+                 while (first != lineEnd && (*first == ' ' || *first == '\t' || *first == '\r')) {
+                     ++first;
+                 }
+                 bool header = line == base && lineEnd - first >= 7 && std::strncmp(first, "holder,", 7) == 0;
+                 if (first != lineEnd && *first != '#' && !header) {
+                     ImportRecord record;
+                     record.line = static_cast<std::uint32_t>(chunk.lines);
+                     record.accepted = false;
+                     if (parseImportLine(base, line, lineEnd, record)) {
+                         chunk.records.push_back(record);
+                     } else {
+                         ++chunk.malformed;
+                         reject(chunk, chunk.lines);
+                     }
+                 }
+                 line = lineEnd + 1;
+             }
+         });
+         std::size_t total = 0;
+         for (Chunk &chunk : chunks) {
+             chunk.firstOrdinal = total;
+             total += chunk.records.size();
+         }
+ 
+         std::lock_guard<std::mutex> guard(createMutex);
+         if (total < std::numeric_limits<std::uint32_t>::max()) {
+             // 2. Resolve duplicates: the earliest line per number wins, unless the bank has it
+             ImportKeySet keys(total);
+             inParallel([&](Chunk &chunk) {
+                 for (std::size_t i = 0; i < chunk.records.size(); ++i) {
+                     keys.claim(chunk.records[i].number, static_cast<std::uint32_t>(chunk.firstOrdinal + i));
+                 }
+             });
+             inParallel([&](Chunk &chunk) {
+                 for (std::size_t i = 0; i < chunk.records.size(); ++i) {
+                     ImportRecord &record = chunk.records[i];
+                     record.accepted = keys.owner(record.number) == chunk.firstOrdinal + i
+                                    && index.find(record.number) == AccountIndex::npos;
+                     if (!record.accepted) {
+                         ++chunk.duplicates;
+                         reject(chunk, record.line);
+                     } else if (record.kind == AccountKind::Savings) {
+                         ++chunk.savings;
+                     } else {
+                         ++chunk.checking;
+                     }
+                 }
+             });
+         }
+ 
+         std::size_t savings = 0, checking = 0, lines = 0;
+         for (Chunk &chunk : chunks) {
+             chunk.savingsBefore = savings;
+             chunk.checkingBefore = checking;
+             savings += chunk.savings;
+             checking += chunk.checking;
+             report.malformed += chunk.malformed;
+             report.duplicates += chunk.duplicates;
+             if (chunk.firstRejected != 0 && report.firstRejectedLine == 0) {
+                 report.firstRejectedLine = lines + chunk.firstRejected;
+             }
+             lines += chunk.lines;
+         }
+         if (total >= std::numeric_limits<std::uint32_t>::max() || table.pendingSize() + savings + checking > AccountTable::kMaxRows) {
+             report.status = TxStatus::CapacityExceeded;
+             return report;
+         }
+ 
+         // 3. Pre-size everything, then store rows and construct accounts in parallel
+         std::size_t firstRow = table.addRows(savings + checking);
+         views.reserve(firstRow + savings + checking);
+         index.reserve(firstRow + savings + checking);
+         SavingsAccount *savingsRun = savingsPool.reserveRun(savings);
+         CheckingAccount *checkingRun = checkingPool.reserveRun(checking);
+         table.holderNames().reserve(savings + checking);
+         for (Chunk &chunk : chunks) {
+             chunk.firstRow = firstRow + chunk.savingsBefore + chunk.checkingBefore;
+         }
+         inParallel([&](Chunk &chunk) {
+             std::size_t row = chunk.firstRow;
+             SavingsAccount *nextSavings = savingsRun + chunk.savingsBefore;
+             CheckingAccount *nextChecking = checkingRun + chunk.checkingBefore;
+             for (const ImportRecord &record : chunk.records) {
+                 if (!record.accepted) {
+                     continue;
+                 }
+                 std::uint32_t holder = record.holderEscaped
+                     ? table.holderNames().intern(importHolder(base, record))
+                     : table.holderNames().intern(base + record.holderOffset, record.holderLength);
+                 BankAccount *view;
+                 if (record.kind == AccountKind::Savings) {
+                     table.storeRow(row, record.number, record.kind, record.balance, Rate::fromUnits(record.terms), Money(), holder);
+                     view = new (nextSavings++) SavingsAccount(table, ledger, row);
+                 } else {
+                     table.storeRow(row, record.number, record.kind, record.balance, Rate(), Money::fromUnits(record.terms), holder);
+                     view = new (nextChecking++) CheckingAccount(table, ledger, row);
+                 }
+                 views[row++] = view;
+             }
+         });
+         savingsPool.commitRun(savings);
+         checkingPool.commitRun(checking);
+ 
+         // 4. Journal in row order (recovery recreates rows in sequence), publish, index
+         std::size_t endRow = firstRow + savings + checking;
+         for (std::size_t row = firstRow; wal && row < endRow; ++row) {
+             journalCreation(row);
+         }
+         table.publishRows();
+         for (std::size_t row = firstRow; row < endRow; ++row) {
+             index.insert(table.id(row), row);
+         }
+         report.accepted = savings + checking;
+         report.status = awaitDurable(TxStatus::Ok);
+ 
+         std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+         report.seconds = elapsed.count();
+         report.accountsPerSecond = report.seconds > 0.0 ? report.accepted / report.seconds : 0.0;
+         return report;
+     }
+ 
+     // Pre-size storage when the number of accounts is known up front
+     void reserveAccounts(std::size_t savings, std::size_t checking) {
+         std::lock_guard<std::mutex> guard(createMutex);
+         std::size_t rows = table.pendingSize() + savings + checking;
+         savingsPool.reserve(savings);
+         checkingPool.reserve(checking);
+         table.reserve(rows);
+         views.reserve(rows);
+         index.reserve(rows);
+     }
+ 
+     // Find an account by number (returns pointer or nullptr if not found)
+     BankAccount* findAccountByNumber(int number) const {
+         std::size_t row = index.find(number);
+         return row != AccountIndex::npos ? views[row] : nullptr;
+     }
+ 
+     // Deposit to a specific account
+     TxStatus depositToAccount(int accountNumber, Money amount) {
+         BankMetrics *m = metrics.load(std::memory_order_acquire);
+         std::uint64_t start = metricsStart(m);
+         TxStatus status = applyToAccount(accountNumber, TxOp::Deposit, amount);
+         status = awaitDurable(noteIfRejected(status, LogEvent::Deposit, accountNumber, amount));
+         return recordMetric(m, MetricOp::Deposit, status, start);
+     }
+ 
+     // Withdraw from a specific account
+     TxStatus withdrawFromAccount(int accountNumber, Money amount) {
+         BankMetrics *m = metrics.load(std::memory_order_acquire);
+         std::uint64_t start = metricsStart(m);
+         TxStatus status = applyToAccount(accountNumber, TxOp::Withdraw, amount);
+         status = awaitDurable(noteIfRejected(status, LogEvent::Withdrawal, accountNumber, amount));
+         return recordMetric(m, MetricOp::Withdraw, status, start);
+     }
+ 
+     // Reject retried operations: the forms below taking a client transaction id apply
+     // each id at most once within `window` (see DedupFilter), for up to `capacity` ids per
+     // window. Call before the Bank is shared between threads; the ids aren't persisted,
+     // so the window restarts empty after recovery.
+     void enableDeduplication(std::chrono::milliseconds window = std::chrono::milliseconds(10000),
+                              std::size_t capacity = std::size_t(1) << 20) {
+         dedup.reset(new DedupFilter(window, capacity));
+     }
+ 
+     std::size_t deduplicationBytes() const {
+         return dedup ? dedup->memoryBytes() : 0;
+     }
+ 
+     // Idempotent forms: a retry with the same `clientTxId` returns DuplicateTransaction
+     // and changes nothing. Id 0 (DedupFilter::kUntracked) and a Bank without
+     // enableDeduplication() apply the operation as the plain forms do.
+     TxStatus depositToAccount(int accountNumber, Money amount, std::uint64_t clientTxId) {
+         return once(clientTxId, MetricOp::Deposit, LogEvent::Deposit, accountNumber, amount, [&] {
+             return depositToAccount(accountNumber, amount);
+         });
+     }
+ 
+     TxStatus withdrawFromAccount(int accountNumber, Money amount, std::uint64_t clientTxId) {
+         return once(clientTxId, MetricOp::Withdraw, LogEvent::Withdrawal, accountNumber, amount, [&] {
+             return withdrawFromAccount(accountNumber, amount);
+         });
+     }
+ 
+     TxStatus transfer(int fromAccount, int toAccount, Money amount, std::uint64_t clientTxId) {
+         return once(clientTxId, MetricOp::Transfer, LogEvent::Transfer, fromAccount, amount, [&] {
+             return transfer(fromAccount, toAccount, amount);
+         });
+     }
+ 
+     // Cap what an account may pay out per UTC day and how many withdrawals or transfer
+     // debits it may make per velocity window (zero removes a limit). Debits beyond them
+     // fail with DailyLimitExceeded / VelocityLimitExceeded; usage so far today is kept.
+     TxStatus setWithdrawalLimits(int accountNumber, Money dailyLimit, std::uint32_t maxPerWindow) {
+         std::size_t row = index.find(accountNumber);
+         if (row == AccountIndex::npos) {
+             return TxStatus::AccountNotFound;
+         }
+         if (dailyLimit < Money() || dailyLimit.raw() > WithdrawalLimits::kMaxDailyLimit) {
+             return TxStatus::InvalidAmount;
+         }
+         {
+             std::lock_guard<SpinLock> guard(table.lockFor(row));
+             if (wal) {
+                 wal->appendLimits(WriteAheadLog::LimitChange{static_cast<std::uint32_t>(row), dailyLimit.raw(), maxPerWindow,
+                                                              ledger.lastSequence()});
+             }
+             table.setLimits(row, dailyLimit.raw(), maxPerWindow);
+         }
+         return awaitDurable(TxStatus::Ok);
+     }
+ 
+     // Length of the velocity window (a minute by default) for every account. It isn't
+     // persisted: set it before enableDurability() so recovery counts usage the same way.
+     void setVelocityWindow(std::chrono::microseconds window) {
+         table.setVelocityWindow(window.count());
+     }
+ 
+     // Display info about a specific account
+     TxStatus displayAccount(int accountNumber, std::ostream &out = std::cout) const {
+         BankAccount *acc = findAccountByNumber(accountNumber);
+         if (!acc) {
+             return TxStatus::AccountNotFound;
+         }
+         acc->displayAccountInfo(out);
+         return TxStatus::Ok;
+     }
+ 
+     // Show transaction history of a specific account
+     TxStatus showAccountTransactions(int accountNumber, std::ostream &out = std::cout) const {
+         BankAccount *acc = findAccountByNumber(accountNumber);
+         if (!acc) {
+             return TxStatus::AccountNotFound;
+         }
+         acc->showTransactionHistory(out);
+         return TxStatus::Ok;
+     }
+ 
+     // Lazy view of an account's history, newest first, from `cursor` (HistoryPage::kNewest,
+     // or a nextCursor / iterator older() taken from this account). Only the records the
+     // caller visits are read; ledger eviction waits while `range` is alive.
+     TxStatus queryHistory(int accountNumber, HistoryRange &range, const HistoryFilter &filter = HistoryFilter(),
+                           std::uint64_t cursor = HistoryPage::kNewest) const {
+         std::size_t row = index.find(accountNumber);
+         if (row == AccountIndex::npos) {
+             return TxStatus::AccountNotFound;
+         }
+         std::uint64_t start;
+         TxStatus status = resolveCursor(row, cursor, start);
+         if (status == TxStatus::Ok) {
+             range = HistoryRange(ledger, start, filter);
+         }
+         return status;
+     }
+ 
+     // Copy up to `limit` matching records, newest first, starting at `cursor`. Pass
+     // page.nextCursor back for the next page; the walk stops at the page boundary.
+     TxStatus historyPage(int accountNumber, std::size_t limit, HistoryPage &page,
+                          const HistoryFilter &filter = HistoryFilter(), std::uint64_t cursor = HistoryPage::kNewest) const {
+         page = HistoryPage();
+         HistoryRange range;
+         TxStatus status = queryHistory(accountNumber, range, filter, cursor);
+         if (status != TxStatus::Ok) {
+             return status;
+         }
+         HistoryRange::iterator it = range.begin();
+         if (limit == 0) {
+             page.nextCursor = it != range.end() ? it.sequence() : Ledger::kNoRecord;
+             page.truncated = it.truncated();
+             return TxStatus::Ok;
+         }
+         page.records.reserve(limit < 1024 ? limit : 1024);
+         for (; it != range.end(); ++it) {
+             page.records.push_back(*it);
+             if (page.records.size() == limit) {
+                 page.nextCursor = it.older();
+                 return TxStatus::Ok;
+             }
+         }
+         page.truncated = it.truncated();
+         return TxStatus::Ok;
+     }
+ 
+     // The last `count` records of an account, oldest first
+     TxStatus lastTransactions(int accountNumber, std::size_t count, std::vector<Transaction> &out) const {
+         HistoryPage page;
+         TxStatus status = historyPage(accountNumber, count, page);
+         out.assign(page.records.rbegin(), page.records.rend());
+         return status;
+     }
+ 
+     // Specialized method for SavingsAccount to apply interest
+     // (result amount is the interest credited, zero if none applied)
+     TxResult applyInterestToSavings(int accountNumber) {
+         BankMetrics *m = metrics.load(std::memory_order_acquire);
+         std::uint64_t start = metricsStart(m);
+         std::size_t row = index.find(accountNumber);
+         TxResult result{TxStatus::AccountNotFound, Money()};
+         if (row != AccountIndex::npos) {
+             // The kind tag says whether it is a SavingsAccount; no RTTI needed
+             std::lock_guard<SpinLock> guard(table.lockFor(row));
+             result = AccountOps::creditInterest(table, ledger, row);
+         }
+         noteIfRejected(result.status, LogEvent::Interest, accountNumber, Money());
+         result.status = recordMetric(m, MetricOp::Interest, awaitDurable(result.status), start);
+         return result;
+     }
+ 
+     // Post interest to every SavingsAccount in one pass over the
+     // balance/rate columns, then append the "Interest" records in bulk.
+     // Each segment is processed while holding every stripe lock, so
+     // concurrent transactions only wait for one segment at a time.
+     InterestRunReport applyInterestToAllSavings() {
+         auto start = std::chrono::steady_clock::now();
+         InterestRunReport report{0, Money(), 0.0, 0.0};
+         std::size_t n = applyInterestToRows(0, table.size(), report);
+         finishInterestRun(report, n, start);
+         return report;
+     }
+ 
+     // One chunk of an interest run: credits rows [firstRow, firstRow + rowCount), clamped
+     // to the accounts that exist, and adds them to `report`. Returns the row to resume at.
+     // Chunks lock one segment at a time, so other work can run between them (see
+     // OperationScheduler); finishInterestRun closes the run once every chunk is done.
+     std::size_t applyInterestToRows(std::size_t firstRow, std::size_t rowCount, InterestRunReport &report) {
+         std::size_t n = table.size();
+         std::size_t end = firstRow >= n ? firstRow : (rowCount < n - firstRow ? firstRow + rowCount : n);
+         std::vector<Money> interest(end - firstRow < AccountTable::kSegmentRows ? end - firstRow : AccountTable::kSegmentRows);
+ 
+         for (std::size_t row = firstRow; row < end;) {
+             std::size_t segment = row / AccountTable::kSegmentRows;
+             std::size_t offset = row - segment * AccountTable::kSegmentRows;
+             std::size_t count = AccountTable::kSegmentRows - offset < end - row ? AccountTable::kSegmentRows - offset : end - row;
+             AllRowsGuard guard(table);
+             // Rows with closed periods still pending catch up first, so this period compounds on them
+             const std::uint32_t *accrued = table.accruedEpochSegment(segment) + offset;
+             std::uint32_t epoch = table.interestEpoch();
+             for (std::size_t i = 0; i < count; ++i) {
+                 if (accrued[i] < epoch) {
+                     AccountOps::settle(table, ledger, row + i);
+                 }
+             }
+             table.beforeSegmentWrite(segment);
+             postInterestColumns(table.balanceSegment(segment) + offset, table.interestRateSegment(segment) + offset,
+                                 interest.data(), count);
+             for (std::size_t i = 0; i < count; ++i) {
+                 if (interest[i] > Money()) {
+                     table.noteBalanceWrite(row + i, table.balance(row + i) - interest[i]);
+                     AccountOps::log(table, ledger, row + i, TransactionType::Interest, interest[i]);
+                     report.totalInterest += interest[i];
+                     ++report.accountsCredited;
+                 }
+             }
+             row += count;
+         }
+         return end;
+     }
+ 
+     // Close an interest run of `rowsScanned` rows started at `start`: time it, log and
+     // count it, and wait until its records are durable
+     void finishInterestRun(InterestRunReport &report, std::size_t rowsScanned, std::chrono::steady_clock::time_point start) {
+         std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+         report.seconds = elapsed.count();
+         report.accountsPerSecond = report.seconds > 0.0 ? rowsScanned / report.seconds : 0.0;
+         note(LogEvent::InterestRun, TxStatus::Ok, static_cast<int>(report.accountsCredited), report.totalInterest);
+         if (BankMetrics *m = metrics.load(std::memory_order_acquire)) {
+             m->count(MetricCounter::InterestCredits, report.accountsCredited);
+         }
+         awaitDurable(TxStatus::Ok);
+     }
+ 
+     // Close an interest period in O(1): no account is touched. Each savings account is
+     // credited the periods it missed, compounded, on its next read or write or an explicit
+     // settleInterest(), so dormant accounts cost nothing here. Until then totals() and
+     // totalLiabilities() count the settled balances only. Returns the new epoch.
+     std::uint32_t accrueInterestPeriod() {
+         std::uint32_t epoch;
+         {
+             std::lock_guard<std::mutex> createGuard(createMutex);  // orders it against journaled creations
+             epoch = table.interestEpoch() + 1;
+             if (wal) {
+                 wal->appendInterestEpoch(epoch);
+             }
+             table.setInterestEpoch(epoch);
+         }
+         awaitDurable(TxStatus::Ok);
+         return epoch;
+     }
+ 
+     std::uint32_t interestEpoch() const {
+         return table.interestEpoch();
+     }
+ 
+     // Credit a savings account the interest of every period closed since it was last
+     // touched (result amount is the interest credited, zero if it was current)
+     TxResult settleInterest(int accountNumber) {
+         std::size_t row = index.find(accountNumber);
+         TxResult result{TxStatus::AccountNotFound, Money()};
+         if (row != AccountIndex::npos) {
+             std::lock_guard<SpinLock> guard(table.lockFor(row));
+             if (!productRules(table.kind(row)).interest) {
+                 result.status = TxStatus::NotSavingsAccount;
+             } else {
+                 result = AccountOps::settleChecked(table, ledger, row);
+             }
+         }
+         noteIfRejected(result.status, LogEvent::Interest, accountNumber, Money());
+         result.status = awaitDurable(result.status);
+         return result;
+     }
+ 
+     // Move money between two accounts atomically. The source follows its product's debit
+     // rules (per-withdrawal cap; balance, plus overdraft where it has one) but pays no
+     // withdrawal fee. Both stripe locks are
+     // taken in stripe order, so concurrent transfers in opposite directions can't deadlock.
+     TxStatus transfer(int fromAccount, int toAccount, Money amount) {
+         BankMetrics *m = metrics.load(std::memory_order_acquire);
+         std::uint64_t start = metricsStart(m);
+         std::size_t from = index.find(fromAccount);
+         std::size_t to = index.find(toAccount);
+         TxStatus status = TxStatus::Ok;
+         if (from == AccountIndex::npos || to == AccountIndex::npos) {
+             status = TxStatus::AccountNotFound;
+         } else if (from == to) {
+             status = TxStatus::SameAccount;
+         } else if (amount <= Money()) {
+             status = TxStatus::InvalidAmount;
+         } else {
+             SpinLock *first = &table.lockFor(from);
+             SpinLock *second = &table.lockFor(to);
+             if (second < first) {
+                 std::swap(first, second);
+             }
+             std::lock_guard<SpinLock> firstGuard(*first);
+             std::unique_lock<SpinLock> secondGuard(*second, std::defer_lock);
+             if (second != first) {
+                 secondGuard.lock();
+             }
+ 
+             AccountOps::settle(table, ledger, from);
+             AccountOps::settle(table, ledger, to);
+             LimitWindows now = AccountOps::debitWindows(table, from);
+             status = AccountOps::checkDebit(table, from, amount, now);
+             Money credited;
+             if (status == TxStatus::Ok && !Money::tryAdd(table.balance(to), amount, credited)) {
+                 status = TxStatus::BalanceOverflow;
+             }
+             if (status == TxStatus::Ok) {
+                 AccountOps::countDebit(table, from, amount, now);
+                 table.addToBalance(from, -amount);
+                 table.setBalance(to, credited);
+                 std::uint64_t seq = ledger.appendTransfer(
+                     static_cast<std::uint32_t>(from), table.historyHead(from), table.balance(from),
+                     static_cast<std::uint32_t>(to), table.historyHead(to), table.balance(to), amount);
+                 table.historyHead(from) = seq;
+                 table.historyHead(to) = seq + 1;
+                 noteOverdraft(from);
+             }
+         }
+ 
+         if (status != TxStatus::Ok) {
+             note(LogEvent::Transfer, status, fromAccount, amount, toAccount);
+         }
+         return recordMetric(m, MetricOp::Transfer, awaitDurable(status), start);
+     }
+ 
+     // Participant side of a two-phase transfer between banks, driven by a coordinator
+     // (ShardedBank) that issues one transferId per transfer. prepareDebit takes the funds
+     // at once (logged as TransferOut), so a prepared debit can't be spent twice;
+     // prepareCredit only checks the account. commitTransfer credits a prepared credit
+     // (TransferIn); abortTransfer refunds a prepared debit. Aborting an unknown id is a
+     // no-op (abort is idempotent); committing one reports UnknownTransfer. A prepared
+     // debit counts toward the account's withdrawal limits even if it is later aborted.
+     // A credit or refund that would take the balance beyond Money's range reports
+     // BalanceOverflow and leaves the transfer prepared, so it can still be aborted.
+     TxStatus prepareDebit(std::uint64_t transferId, int accountNumber, Money amount) {
+         std::size_t row = index.find(accountNumber);
+         TxStatus status = TxStatus::Ok;
+         if (row == AccountIndex::npos) {
+             status = TxStatus::AccountNotFound;
+         } else if (amount <= Money()) {
+             status = TxStatus::InvalidAmount;
+         } else {
+             std::lock_guard<SpinLock> guard(table.lockFor(row));
+             AccountOps::settle(table, ledger, row);
+             LimitWindows now = AccountOps::debitWindows(table, row);
+             status = AccountOps::checkDebit(table, row, amount, now);
+             if (status == TxStatus::Ok) {
+                 AccountOps::countDebit(table, row, amount, now);
+                 table.addToBalance(row, -amount);
+                 AccountOps::log(table, ledger, row, TransactionType::TransferOut, amount);
+                 noteOverdraft(row);
+             }
+         }
+         if (status == TxStatus::Ok) {
+             std::lock_guard<std::mutex> guard(transferMutex);
+             preparedTransfers[transferId] = PreparedTransfer{row, amount, true};
+         } else {
+             note(LogEvent::Transfer, status, accountNumber, amount);
+         }
+         return awaitDurable(status);
+     }
+ 
+     TxStatus prepareCredit(std::uint64_t transferId, int accountNumber, Money amount) {
+         std::size_t row = index.find(accountNumber);
+         TxStatus status = row == AccountIndex::npos ? TxStatus::AccountNotFound
+                         : amount <= Money() ? TxStatus::InvalidAmount : TxStatus::Ok;
+         if (status == TxStatus::Ok) {
+             std::lock_guard<std::mutex> guard(transferMutex);
+             preparedTransfers[transferId] = PreparedTransfer{row, amount, false};
+         } else {
+             note(LogEvent::Transfer, status, 0, amount, accountNumber);
+         }
+         return status;
+     }
+ 
+     TxStatus commitTransfer(std::uint64_t transferId) {
+         PreparedTransfer leg;
+         {
+             std::lock_guard<std::mutex> guard(transferMutex);
+             auto it = preparedTransfers.find(transferId);
+             if (it == preparedTransfers.end()) {
+                 return TxStatus::UnknownTransfer;
+             }
+             leg = it->second;
+             preparedTransfers.erase(it);
+         }
+         if (!leg.debit && !creditPrepared(transferId, leg)) {
+             return TxStatus::BalanceOverflow;
+         }
+         return awaitDurable(TxStatus::Ok);
+     }
+ 
+     TxStatus abortTransfer(std::uint64_t transferId) {
+         PreparedTransfer leg;
+         {
+             std::lock_guard<std::mutex> guard(transferMutex);
+             auto it = preparedTransfers.find(transferId);
+             if (it == preparedTransfers.end()) {
+                 return TxStatus::Ok;
+             }
+             leg = it->second;
+             preparedTransfers.erase(it);
+         }
+         if (leg.debit && !creditPrepared(transferId, leg)) {
+             return TxStatus::BalanceOverflow;
+         }
+         return awaitDurable(TxStatus::Ok);
+     }
+ 
+     // Apply a batch of operations without printing. Requests are grouped by account, each
+     // account is looked up and locked once, and its requests run in submission order.
+     // Returns one status per request, in request order. While any account has withdrawal
+     // limits, the batch is pre-validated first (see prevalidateBatch).
+     std::vector<TxStatus> applyBatch(Span<const TxRequest> requests) {
+         return applyValidatedBatch(requests, nullptr);
+     }
+ 
+     // Same, skipping the requests `validation` (from prevalidateBatch on these requests)
+     // rejected; they report its status. A validation of another size is ignored.
+     std::vector<TxStatus> applyBatch(Span<const TxRequest> requests, const BatchValidation &validation) {
+         return applyValidatedBatch(requests, validation.size() == requests.size() ? &validation : nullptr);
+     }
+ 
+     // Check a batch against the rules each request must pass on its own (a positive
+     // amount, the product's withdrawal cap, the account's daily and velocity limits as
+     // of now), lane-parallel and without locks, so a screening stage can drop the
+     // rejects before the batch reaches the accounts. Requests that pass may still fail
+     // when applied (funds, or limits used up by earlier requests of the batch).
+     BatchValidation prevalidateBatch(Span<const TxRequest> requests) const {
+         std::vector<std::uint32_t> order;
+         std::vector<BatchRun> runs = planBatch(requests, order);
+         BatchValidation validation;
+         prevalidate(requests, order, runs, validation);
+         return validation;
+     }
+ 
+     // Same as applyBatch, but the sorted accounts are split into `threads` contiguous
+     // account-number ranges (shards) applied in parallel. Per-account order is preserved.
+     std::vector<TxStatus> applyBatchParallel(Span<const TxRequest> requests, unsigned threads) {
+         BankMetrics *m = metrics.load(std::memory_order_acquire);
+         std::uint64_t start = metricsStart(m);
+         std::vector<std::uint32_t> order;
+         std::vector<BatchRun> runs = planBatch(requests, order);
+         std::vector<TxStatus> statuses(requests.size(), TxStatus::Ok);
+         BatchValidation stage;
+         const BatchValidation *validation = nullptr;
+         if (table.limitedRowCount() != 0) {
+             prevalidate(requests, order, runs, stage);
+             validation = &stage;
+         }
+         if (threads < 2 || runs.size() < 2) {
+             applyRuns(requests, order, runs, 0, runs.size(), validation, statuses);
+             statuses = awaitDurable(std::move(statuses));
+             if (m) {
+                 m->recordLatency(MetricOp::Batch, monotonicNanos() - start);
+             }
+             return statuses;
+         }
+ 
+         // Cut shard boundaries at run edges so each shard carries about the same number of requests
+         std::vector<std::size_t> bounds(1, 0);
+         std::size_t perShard = (requests.size() + threads - 1) / threads;
+         for (std::size_t r = 0; r < runs.size(); ++r) {
+             if (runs[r].end >= perShard * bounds.size() && bounds.size() < threads) {
+                 bounds.push_back(r + 1);
+             }
+         }
+         if (bounds.back() != runs.size()) {
+             bounds.push_back(runs.size());
+         }
+ 
+         std::vector<std::thread> workers;
+         for (std::size_t s = 1; s + 1 < bounds.size(); ++s) {
+             workers.emplace_back([&, s] { applyRuns(requests, order, runs, bounds[s], bounds[s + 1], validation, statuses); });
+         }
+         applyRuns(requests, order, runs, bounds[0], bounds[1], validation, statuses);
+         for (auto &worker : workers) {
+             worker.join();
+         }
+         statuses = awaitDurable(std::move(statuses));
+         if (m) {
+             m->recordLatency(MetricOp::Batch, monotonicNanos() - start);
+         }
+         return statuses;
+     }
+ 
+     // Bound the memory held by the ledger (0 = unbounded); the oldest history is evicted beyond it
+     void setLedgerMemoryCap(std::size_t bytes) {
+         std::size_t cap = bytes / sizeof(Ledger::Segment);
+         ledger.setSegmentCap(bytes == 0 ? 0 : (cap < 2 ? 2 : cap));
+     }
+ 
+     // Keep evicted history readable from a compressed cold tier (see ColdHistory), held in
+     // memory or, given `spillPath`, in a file there; full ledger segments older than
+     // `hotAge` leave memory as new ones open (zero: only setLedgerMemoryCap evicts).
+     // Call before the Bank is shared between threads; the tier isn't part of snapshots.
+     bool enableColdHistory(std::chrono::seconds hotAge, const std::string &spillPath = std::string()) {
+         std::unique_ptr<ColdHistory> tier(new ColdHistory);
+         if (!spillPath.empty() && !tier->openSpillFile(spillPath)) {
+             return false;
+         }
+         coldHistory = std::move(tier);
+         ledger.setColdTier(coldHistory.get());
+         ledger.setHotAge(hotAge);
+         return true;
+     }
+ 
+     const Ledger& transactionLedger() const {
+         return ledger;
+     }
+ 
+     // Consistent point-in-time view of every account's balance for long reports; deposits
+     // and transfers keep running while it is open (see ReadView). Close it promptly: each
+     // segment written meanwhile keeps a copy (SegmentVersions) until the view is gone.
+     ReadView readView() const {
+         return ReadView(table);
+     }
+ 
+     // Bank-wide totals from the incrementally kept aggregates: O(shards), no account scan,
+     // and safe to call while trading runs
+     BankTotals totals() const {
+         return table.totals();
+     }
+ 
+     // Customer id of a holder name (NamePool::kNone if no account was ever opened under it)
+     std::uint32_t findCustomer(const std::string &holder) const {
+         return table.holderNames().find(holder);
+     }
+ 
+     // Numbers of every account held by a customer, oldest first: a walk of the holder's
+     // row chain, with no scan over other accounts
+     std::vector<int> accountsOfCustomer(std::uint32_t customer) const {
+         std::vector<int> numbers;
+         if (customer == NamePool::kNone) {
+             return numbers;
+         }
+         std::size_t published = table.size();
+         for (std::size_t link = table.newestRowOf(customer); link != 0; link = table.previousRowOf(link - 1)) {
+             if (link - 1 < published) {
+                 numbers.push_back(table.id(link - 1));
+             }
+         }
+         std::reverse(numbers.begin(), numbers.end());
+         return numbers;
+     }
+ 
+     std::vector<int> accountsOfHolder(const std::string &holder) const {
+         return accountsOfCustomer(findCustomer(holder));
+     }
+ 
+     // Sum of all balances, scanned over the balance column only
+     // (one segment at a time under every stripe lock, so the sum is consistent per segment)
+     Money totalLiabilities() const {
+         Money total;
+         std::size_t n = table.size();
+         for (std::size_t base = 0, segment = 0; base < n; base += AccountTable::kSegmentRows, ++segment) {
+             std::size_t count = n - base < AccountTable::kSegmentRows ? n - base : AccountTable::kSegmentRows;
+             AllRowsGuard guard(table);
+             const Money *balances = table.balanceSegment(segment);
+             for (std::size_t i = 0; i < count; ++i) {
+                 total += balances[i];
+             }
+         }
+         return total;
+     }
+ 
+     // Write a snapshot of every account and the retained ledger to `path` in one
+     // sequential pass. Account creation and all balance updates are held off while it
+     // runs, so the image is consistent. Written to `path`.tmp, then renamed over `path`.
+     SnapshotStatus saveSnapshot(const std::string &path) const {
+         std::lock_guard<std::mutex> createGuard(createMutex);
+         AllRowsGuard rowsGuard(table);  // ledger appends happen under row locks, so it is quiet too
+         return writeSnapshot(path, logGeneration);
+     }
+ 
+ private:
+     // Snapshot body (createMutex and every row lock held)
+     SnapshotStatus writeSnapshot(const std::string &path, std::uint64_t generation) const {
+         std::uint64_t rows = table.size();
+         std::uint64_t tableSegments = (rows + AccountTable::kSegmentRows - 1) / AccountTable::kSegmentRows;
+         std::uint64_t firstSegment = ledger.firstLiveSegmentNumber();
+         std::uint64_t ledgerSegments = ledger.openedSegmentCount() - firstSegment;
+ 
+         SnapshotHeader header = SnapshotHeader::forThisBuild();
+         header.rows = rows;
+         std::uint64_t offset = SnapshotHeader::kPageBytes;
+         for (std::size_t c = 0; c < AccountTable::kColumns; ++c) {
+             header.columnOffset[c] = offset;
+             offset = SnapshotHeader::pageAlign(offset + tableSegments * AccountTable::kSegmentRows * AccountTable::columnRowBytes(c));
+         }
+         header.ledgerNextSequence = ledger.lastSequence() + 1;
+         header.ledgerFirstSegment = firstSegment;
+         header.ledgerSegments = ledgerSegments;
+         header.ledgerOffset = offset;
+         header.holderOffset = offset + ledgerSegments * header.ledgerSegmentStride;
+         std::uint64_t holderChars = 0;
+         for (std::size_t row = 0; row < rows; ++row) {
+             holderChars += table.holderEntry(row).length;
+         }
+         header.holderBytes = (rows + 1) * sizeof(std::uint64_t) + holderChars;
+         header.fileBytes = header.holderOffset + header.holderBytes;
+         header.logGeneration = generation;
+         header.interestEpoch = table.interestEpoch();
+ 
+         std::string tempPath = path + ".tmp";
+         SnapshotWriter out(tempPath);
+         out.write(&header, sizeof(header));
+         for (std::size_t c = 0; c < AccountTable::kColumns; ++c) {
+             out.padTo(header.columnOffset[c]);
+             for (std::size_t segment = 0; segment < tableSegments; ++segment) {
+                 out.write(table.columnSegment(c, segment), AccountTable::kSegmentRows * AccountTable::columnRowBytes(c));
+             }
+         }
+         for (std::uint64_t i = 0; i < ledgerSegments; ++i) {
+             out.padTo(header.ledgerOffset + i * header.ledgerSegmentStride);
+             out.write(ledger.segmentAt(firstSegment + i), sizeof(Ledger::Segment));
+         }
+         out.padTo(header.holderOffset);
+         std::uint64_t holderEnd = 0;
+         out.write(&holderEnd, sizeof(holderEnd));
+         for (std::size_t row = 0; row < rows; ++row) {
+             holderEnd += table.holderEntry(row).length;
+             out.write(&holderEnd, sizeof(holderEnd));
+         }
+         for (std::size_t row = 0; row < rows; ++row) {
+             const NamePool::Entry &holder = table.holderEntry(row);
+             out.write(holder.text, holder.length);
+         }
+         header.checksum = out.checksum();  // hashed with the field still zero
+         out.rewrite(0, &header, sizeof(header));
+         if (!out.finish() || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+             std::remove(tempPath.c_str());
+             return SnapshotStatus::IoError;
+         }
+         // The rename must be durable before callers truncate the log it replaces
+         return syncParentDirectory(path) ? SnapshotStatus::Ok : SnapshotStatus::IoError;
+     }
+ 
+     // Re-apply the log tail at `walPath` on top of the loaded state. Creations and closed
+     // interest periods are replayed in log order (they fix row numbers and the epoch new
+     // rows start at); each row keeps the newest epoch it settled to; ledger records are sorted by sequence, numbered
+     // densely after the snapshot's last record (dropping gaps left by in-flight appends that
+     // never became durable) and restored in parallel, one shard of rows per thread.
+     // Withdrawal limits are set in log order; a limited row's withdrawals and transfer
+     // debits logged since then count toward its usage again, by their own timestamps.
+     void replayLog(const std::string &walPath, unsigned threads) {
+         std::uint64_t after = ledger.lastSequence();
+         std::vector<WriteAheadLog::Entry> entries;
+         std::unordered_map<std::uint32_t, std::uint64_t> countFrom;  // rows whose limits were set in the log
+         WriteAheadLog::replay(walPath, logGeneration,
+             [&](const std::vector<WriteAheadLog::Entry> &frame) {
+                 for (const auto &entry : frame) {
+                     if (entry.tx.id > after) {
+                         entries.push_back(entry);
+                     }
+                 }
+                 return true;
+             },
+             [&](const WriteAheadLog::Creation &c) {
+                 if (c.row < table.pendingSize()) {
+                     return true;  // already in the snapshot
+                 }
+                 if (c.row != table.pendingSize()) {
+                     return false;
+                 }
+                 if (!isAccountKind(c.kind)) {
+                     return false;
+                 }
+                 TxStatus status = createAccount(static_cast<AccountKind>(c.kind), c.holder, c.number, Money::fromUnits(c.balance),
+                                                 Rate::fromUnits(c.rate), Money::fromUnits(c.limit));
+                 return status == TxStatus::Ok;
+             },
+             [&](const WriteAheadLog::Accrual &a) {
+                 if (a.row == WriteAheadLog::kNoRow) {
+                     if (a.epoch > table.interestEpoch()) {
+                         table.setInterestEpoch(a.epoch);
+                     }
+                 } else if (a.row < table.pendingSize() && a.epoch > table.accruedEpoch(a.row)) {
+                     table.setAccruedEpoch(a.row, a.epoch);
+                 }
+                 return true;
+             },
+             [&](const WriteAheadLog::LimitChange &l) {
+                 if (l.row >= table.pendingSize()) {
+                     return false;
+                 }
+                 table.setLimits(l.row, l.dailyLimit, l.perWindow);
+                 countFrom[l.row] = l.sinceSequence;
+                 return true;
+             });
+ 
+         std::stable_sort(entries.begin(), entries.end(), [](const WriteAheadLog::Entry &a, const WriteAheadLog::Entry &b) {
+             return a.tx.id < b.tx.id;
+         });
+         unsigned shards = threads == 0 ? 1 : threads;
+         std::vector<std::vector<std::size_t>> shardEntries(shards);
+         std::size_t rows = table.size();
+         for (std::size_t i = 0; i < entries.size(); ++i) {
+             if (entries[i].row < rows) {
+                 shardEntries[entries[i].row % shards].push_back(i);
+             }
+         }
+ 
+         auto replayShard = [&](unsigned shard) {
+             for (std::size_t i : shardEntries[shard]) {
+                 const WriteAheadLog::Entry &entry = entries[i];
+                 std::uint64_t seq = after + 1 + i;
+                 table.setBalance(entry.row, entry.tx.resultingBalance);
+                 ledger.restore(seq, entry.row, table.historyHead(entry.row), entry.tx);
+                 table.historyHead(entry.row) = seq;
+                 TransactionType type = entry.tx.type();
+                 if ((type == TransactionType::Withdrawal || type == TransactionType::TransferOut) && table.hasLimits(entry.row)) {
+                     auto since = countFrom.find(entry.row);
+                     if (since == countFrom.end() || entry.tx.id > since->second) {
+                         table.countDebit(entry.row, entry.tx.amount.raw(),
+                                          table.limitWindows(entry.tx.timestampMicros()));
+                     }
+                 }
+             }
+         };
+         std::vector<std::thread> workers;
+         for (unsigned shard = 1; shard < shards; ++shard) {
+             workers.emplace_back(replayShard, shard);
+         }
+         replayShard(0);
+         for (auto &worker : workers) {
+             worker.join();
+         }
+         ledger.resumeAt(after + 1 + entries.size());
+     }
+ 
+ public:
+     // Make this (empty) Bank durable: load the snapshot at `snapshotPath` if it exists,
+     // replay the write-ahead log tail at `walPath` with `replayThreads` threads, checkpoint,
+     // then journal every later change. Operations return once their records are synced;
+     // the committer groups records for up to `commitLatency` per write + fdatasync.
+     SnapshotStatus enableDurability(const std::string &snapshotPath, const std::string &walPath,
+                                     std::chrono::microseconds commitLatency = std::chrono::microseconds(1000),
+                                     unsigned replayThreads = std::thread::hardware_concurrency()) {
+         if (wal || table.pendingSize() != 0) {
+             return SnapshotStatus::BankNotEmpty;
+         }
+         if (::access(snapshotPath.c_str(), F_OK) == 0) {
+             SnapshotStatus status = loadSnapshot(snapshotPath);
+             if (status != SnapshotStatus::Ok) {
+                 return status;
+             }
+         }
+         if (::access(walPath.c_str(), F_OK) == 0) {
+             replayLog(walPath, replayThreads);
+         }
+ 
+         std::lock_guard<std::mutex> createGuard(createMutex);
+         AllRowsGuard rowsGuard(table);
+         SnapshotStatus status = writeSnapshot(snapshotPath, logGeneration + 1);
+         if (status != SnapshotStatus::Ok) {
+             return status;
+         }
+         ++logGeneration;
+         std::unique_ptr<WriteAheadLog> log(new WriteAheadLog);
+         if (!log->open(walPath, logGeneration, commitLatency)) {
+             return SnapshotStatus::IoError;
+         }
+         wal = std::move(log);
+         checkpointPath = snapshotPath;
+         ledger.setJournal(wal.get());
+         return SnapshotStatus::Ok;
+     }
+ 
+     // Write a fresh snapshot and truncate the write-ahead log it supersedes
+     SnapshotStatus checkpoint() {
+         if (!wal) {
+             return SnapshotStatus::IoError;
+         }
+         std::lock_guard<std::mutex> createGuard(createMutex);
+         AllRowsGuard rowsGuard(table);
+         SnapshotStatus status = writeSnapshot(checkpointPath, logGeneration + 1);
+         if (status != SnapshotStatus::Ok) {
+             return status;
+         }
+         ++logGeneration;
+         return wal->reset(logGeneration) ? SnapshotStatus::Ok : SnapshotStatus::IoError;
+     }
+ 
+     // Load a snapshot into this (empty) Bank. The file is mapped and the table columns
+     // and ledger segments are used in place; only the index, the account views and the
+     // interned holder names and chains are rebuilt. The mapping is private: later changes stay in memory.
+     SnapshotStatus loadSnapshot(const std::string &path) {
+         std::lock_guard<std::mutex> guard(createMutex);
+         if (table.pendingSize() != 0 || ledger.lastSequence() != 0 || snapshot) {
+             return SnapshotStatus::BankNotEmpty;
+         }
+         std::unique_ptr<MappedFile> file(new MappedFile);
+         if (!file->open(path)) {
+             return SnapshotStatus::IoError;
+         }
+ 
+         SnapshotHeader header;
+         if (file->size() < SnapshotHeader::kPageBytes) {
+             return SnapshotStatus::BadFormat;
+         }
+         std::memcpy(&header, file->data(), sizeof(header));
+         if (std::memcmp(header.magic, SnapshotHeader::kMagic, sizeof(header.magic)) != 0) {
+             return SnapshotStatus::BadFormat;
+         }
+         if (!header.sameLayout(SnapshotHeader::forThisBuild())) {
+             return SnapshotStatus::LayoutMismatch;
+         }
+         if (header.fileBytes != file->size()) {
+             return SnapshotStatus::BadFormat;
+         }
+         SnapshotHeader unsealed = header;
+         unsealed.checksum = 0;
+         std::uint64_t checksum = SnapshotHeader::hashBytes(SnapshotHeader::kChecksumSeed, &unsealed, sizeof(unsealed));
+         checksum = SnapshotHeader::hashBytes(checksum, file->data() + sizeof(header), static_cast<std::size_t>(file->size() - sizeof(header)));
+         if (checksum != header.checksum) {
+             return SnapshotStatus::BadFormat;
+         }
+         std::uint64_t tableSegments = (header.rows + AccountTable::kSegmentRows - 1) / AccountTable::kSegmentRows;
+         if (header.rows > AccountTable::kMaxRows || header.ledgerSegments > Ledger::kRingSegments
+             || header.interestEpoch > std::numeric_limits<std::uint32_t>::max()
+             || header.holderOffset + header.holderBytes != header.fileBytes
+             || header.holderBytes < (header.rows + 1) * sizeof(std::uint64_t)
+             || header.ledgerOffset + header.ledgerSegments * header.ledgerSegmentStride > header.holderOffset) {
+             return SnapshotStatus::BadFormat;
+         }
+         void *bases[AccountTable::kColumns];
+         for (std::size_t c = 0; c < AccountTable::kColumns; ++c) {
+             std::uint64_t bytes = tableSegments * AccountTable::kSegmentRows * AccountTable::columnRowBytes(c);
+             if (header.columnOffset[c] % SnapshotHeader::kPageBytes != 0 || header.columnOffset[c] + bytes > header.ledgerOffset) {
+                 return SnapshotStatus::BadFormat;
+             }
+             bases[c] = file->data() + header.columnOffset[c];
+         }
+         if (!Ledger::validImage(file->data() + header.ledgerOffset, static_cast<std::size_t>(header.ledgerSegmentStride),
+                                 header.ledgerFirstSegment, header.ledgerSegments, header.ledgerNextSequence, header.rows)) {
+             return SnapshotStatus::BadFormat;
+         }
+         const std::uint8_t *kindTags = static_cast<const std::uint8_t*>(bases[1]);         // column 1: kinds
+         const std::uint64_t *historyHeads = static_cast<const std::uint64_t*>(bases[5]);   // column 5: history heads
+         const std::uint32_t *accruedEpochs = static_cast<const std::uint32_t*>(bases[6]);  // column 6: accrual epochs
+         const std::int64_t *dailyLimits = static_cast<const std::int64_t*>(bases[7]);      // column 7: daily limits
+         for (std::uint64_t row = 0; row < header.rows; ++row) {
+             if (!isAccountKind(kindTags[row]) || historyHeads[row] >= header.ledgerNextSequence
+                 || accruedEpochs[row] > header.interestEpoch
+                 || dailyLimits[row] < 0 || dailyLimits[row] > WithdrawalLimits::kMaxDailyLimit) {
+                 return SnapshotStatus::BadFormat;
+             }
+         }
+         const std::uint64_t *holderEnds = reinterpret_cast<const std::uint64_t*>(file->data() + header.holderOffset);
+         const char *holderChars = reinterpret_cast<const char*>(holderEnds + header.rows + 1);
+         std::uint64_t charBytes = header.holderBytes - (header.rows + 1) * sizeof(std::uint64_t);
+         if (holderEnds[0] != 0 || holderEnds[header.rows] != charBytes) {
+             return SnapshotStatus::BadFormat;
+         }
+         for (std::uint64_t row = 0; row < header.rows; ++row) {
+             if (holderEnds[row + 1] < holderEnds[row]) {
+                 return SnapshotStatus::BadFormat;
+             }
+         }
+ 
+         std::size_t rows = static_cast<std::size_t>(header.rows);
+         std::vector<std::uint32_t> holderOf(rows);
+         table.holderNames().reserve(rows);
+         for (std::size_t row = 0; row < rows; ++row) {
+             holderOf[row] = table.holderNames().intern(holderChars + holderEnds[row],
+                                                        static_cast<std::size_t>(holderEnds[row + 1] - holderEnds[row]));
+         }
+         table.adoptColumns(bases, rows, holderOf.data());
+         ledger.adopt(file->data() + header.ledgerOffset, static_cast<std::size_t>(header.ledgerSegmentStride),
+                      header.ledgerFirstSegment, header.ledgerSegments, header.ledgerNextSequence);
+ 
+         std::size_t savings = 0;
+         for (std::size_t row = 0; row < rows; ++row) {
+             savings += productRules(table.kind(row)).interest;
+         }
+         savingsPool.reserve(savings);
+         checkingPool.reserve(rows - savings);
+         views.reserve(rows);
+         index.reserve(rows);
+         for (std::size_t row = 0; row < rows; ++row) {
+             views[row] = createView(row);
+             index.insert(table.id(row), row);
+         }
+         table.setInterestEpoch(static_cast<std::uint32_t>(header.interestEpoch));
+         snapshot = std::move(file);
+         logGeneration = header.logGeneration;
+         return SnapshotStatus::Ok;
+     }
+ 
+     // Route diagnostics (rejected operations, account creation, interest runs) to `sink`,
+     // or turn them off with nullptr. The sink must outlive its use by this Bank.
+     void setLogSink(LogSink *sink) {
+         logSink.store(sink, std::memory_order_release);
+     }
+ 
+     // Record operation counters and latencies into `sink`, or stop with nullptr.
+     // The metrics object must outlive its use by this Bank.
+     void setMetrics(BankMetrics *sink) {
+         metrics.store(sink, std::memory_order_release);
+     }
+ 
+     // Pull the attached metrics (zero if none) together with size and memory gauges
+     MetricsSnapshot collectMetrics() const {
+         MetricsSnapshot snapshot;
+         if (BankMetrics *m = metrics.load(std::memory_order_acquire)) {
+             m->collect(snapshot);
+         }
+         std::lock_guard<std::mutex> guard(createMutex);
+         std::size_t rows = table.size();
+         std::size_t rowBytes = sizeof(BankAccount*) + 2 * sizeof(std::uint32_t);  // + holder handle and link
+         for (std::size_t c = 0; c < AccountTable::kColumns; ++c) {
+             rowBytes += AccountTable::columnRowBytes(c);
+         }
+         std::size_t tableRows = (rows + AccountTable::kSegmentRows - 1) / AccountTable::kSegmentRows * AccountTable::kSegmentRows;
+         snapshot.accounts = rows;
+         snapshot.ledgerRecords = ledger.retainedRecords();
+         snapshot.ledgerBytes = ledger.memoryBytes();
+         if (coldHistory) {
+             auto readGuard = ledger.readGuard();
+             snapshot.coldRecords = coldHistory->records();
+             snapshot.coldBytes = coldHistory->memoryBytes();
+         }
+         snapshot.accountBytes = tableRows * rowBytes + savingsPool.capacity() * sizeof(SavingsAccount)
+                               + checkingPool.capacity() * sizeof(CheckingAccount) + table.holderNames().memoryBytes();
+         snapshot.bytesPerAccount = rows > 0 ? static_cast<double>(snapshot.accountBytes + snapshot.ledgerBytes) / rows : 0.0;
+         return snapshot;
+     }
+ 
+     // Write collectMetrics() in the Prometheus text format
+     void writeMetrics(std::ostream &out) const {
+         collectMetrics().writePrometheus(out);
+     }
+ 
+     // Serve writeMetrics() at http://127.0.0.1:<port>/metrics until the Bank is destroyed
+     bool serveMetrics(std::uint16_t port) {
+         if (metricsEndpoint) {
+             return false;
+         }
+         std::unique_ptr<MetricsEndpoint> endpoint(new MetricsEndpoint());
+         if (!endpoint->start(port, [this](std::ostream &out) { writeMetrics(out); })) {
+             return false;
+         }
+         metricsEndpoint = std::move(endpoint);
+         return true;
+     }
+ 
+     // Simple listing of all accounts
+     // Prints every account as of one moment (a ReadView), without holding up writers
+     void listAllAccounts(std::ostream &out = std::cout) const {
+         ReadView snapshot = readView();
+         if (snapshot.size() == 0) {
+             out << "[Info] No accounts in the bank.\n";
+             return;
+         }
+ 
+         out << "----- Listing All Accounts -----\n";
+         listAccounts(snapshot, 0, snapshot.size(), out);
+     }
+ 
+     // Print rows [firstRow, firstRow + rowCount) of `snapshot` (clamped to its size) and
+     // return the row to resume at, so a long listing can be printed in chunks
+     std::size_t listAccounts(const ReadView &snapshot, std::size_t firstRow, std::size_t rowCount, std::ostream &out) const {
+         std::size_t n = snapshot.size();
+         std::size_t end = firstRow >= n ? firstRow : (rowCount < n - firstRow ? firstRow + rowCount : n);
+         for (std::size_t row = firstRow; row < end; ++row) {
+             views[row]->displayAccountInfo(out, snapshot.balance(row));
+             out << "--------------------------------\n";
+         }
+         return end;
+     }
+ };
+ 
+ /******************************************************
+  * ShardRouter - Maps account numbers to shards
+  *  - Hash: the mixed account number modulo the shard
+  *    count; sequential numbers spread evenly
+  *  - Range: shard i holds numbers in
+  *    [upperBounds[i-1], upperBounds[i]), the last shard
+  *    the rest, so number ranges stay together
+  ******************************************************/
+ class ShardRouter {
+ private:
+     std::size_t count;
+     std::vector<int> upperBounds;  // empty = hash routing
+ 
+     ShardRouter(std::size_t shards, std::vector<int> bounds) : count(shards), upperBounds(std::move(bounds)) {}
+ 
+ public:
+     static ShardRouter hashed(std::size_t shards) {
+         return ShardRouter(shards == 0 ? 1 : shards, std::vector<int>());
+     }
+ 
+     // upperBounds.size() + 1 shards
+     static ShardRouter ranged(std::vector<int> upperBounds) {
+         std::sort(upperBounds.begin(), upperBounds.end());
+         std::size_t shards = upperBounds.size() + 1;
+         return ShardRouter(shards, std::move(upperBounds));
+     }
+ 
+     std::size_t shards() const { return count; }
+ 
+     std::size_t shardOf(int accountNumber) const {
+         if (upperBounds.empty()) {
+             return AccountIndex::hashKey(accountNumber) % count;
+         }
+         return static_cast<std::size_t>(std::upper_bound(upperBounds.begin(), upperBounds.end(), accountNumber)
+                                         - upperBounds.begin());
+     }
+ };
+ 
+ /******************************************************
+  * ShardTransport - Request path from a coordinator to
+  * its shards
+  *  - call() delivers a list of requests to one shard as
+  *    one round trip; an RPC client to remote shards
+  *    implements the same interface
+  *  - LocalTransport serves shards in this process
+  *  - BatchingTransport coalesces concurrent callers into
+  *    one round trip per shard
+  ******************************************************/
+ enum class ShardOp : std::uint8_t {
+     Deposit,
+     Withdraw,
+     Interest,
+     Transfer,       // both accounts on the receiving shard
+     PrepareDebit,
+     PrepareCredit,
+     Commit,
+     Abort
+ };
+ 
+ struct ShardRequest {
+     ShardOp op;
+     int accountNumber;
+     int otherAccount;          // Transfer destination
+     Money amount;
+     std::uint64_t transferId;  // two-phase operations
+ };
+ 
+ class ShardTransport {
+ public:
+     virtual ~ShardTransport() {}
+ 
+     // Deliver `requests` to `shard` in order; replies[i] answers requests[i]
+     virtual void call(std::size_t shard, Span<const ShardRequest> requests, TxStatus *replies) = 0;
+ };
+ 
+ class LocalTransport : public ShardTransport {
+ private:
+     std::vector<Bank*> banks;
+ 
+ public:
+     explicit LocalTransport(std::vector<Bank*> shardBanks) : banks(std::move(shardBanks)) {}
+ 
+     // Consecutive deposits, withdrawals and interest go through one applyBatch call;
+     // the other requests apply one at a time, in order
+     void call(std::size_t shard, Span<const ShardRequest> requests, TxStatus *replies) override {
+         Bank &bank = *banks[shard];
+         std::vector<TxRequest> run;
+         std::size_t runStart = 0;
+         auto flush = [&] {
+             if (!run.empty()) {
+                 std::vector<TxStatus> statuses = bank.applyBatch(run);
+                 std::copy(statuses.begin(), statuses.end(), replies + runStart);
+                 run.clear();
+             }
+         };
+         for (std::size_t i = 0; i < requests.size(); ++i) {
+             const ShardRequest &r = requests[i];
+             if (r.op == ShardOp::Deposit || r.op == ShardOp::Withdraw || r.op == ShardOp::Interest) {
+                 if (run.empty()) {
+                     runStart = i;
+                 }
+                 TxOp op = r.op == ShardOp::Deposit ? TxOp::Deposit : r.op == ShardOp::Withdraw ? TxOp::Withdraw : TxOp::Interest;
+                 run.push_back(TxRequest{r.accountNumber, op, r.amount});
+                 continue;
+             }
+             flush();
+             switch (r.op) {
+                 case ShardOp::Transfer:      replies[i] = bank.transfer(r.accountNumber, r.otherAccount, r.amount); break;
+                 case ShardOp::PrepareDebit:  replies[i] = bank.prepareDebit(r.transferId, r.accountNumber, r.amount); break;
+                 case ShardOp::PrepareCredit: replies[i] = bank.prepareCredit(r.transferId, r.accountNumber, r.amount); break;
+                 case ShardOp::Commit:        replies[i] = bank.commitTransfer(r.transferId); break;
+                 case ShardOp::Abort:         replies[i] = bank.abortTransfer(r.transferId); break;
+                 default:                     break;
+             }
+         }
+         flush();
+     }
+ };
+ 
+ class BatchingTransport : public ShardTransport {
+ private:
+     struct Waiter {
+         Span<const ShardRequest> requests;
+         TxStatus *replies;
+         bool done;
+     };
+ 
+     // Callers queue on their shard's lane; whoever finds the lane idle sends the queue.
+     // The sender's buffers belong to the lane and keep their capacity between trips.
+     struct alignas(64) Lane {
+         std::mutex mutex;
+         std::condition_variable sent;
+         std::vector<Waiter*> queued;
+         bool sending = false;
+         std::vector<Waiter*> group;
+         std::vector<ShardRequest> batch;
+         std::vector<TxStatus> answers;
+     };
+ 
+     ShardTransport &inner;
+     std::unique_ptr<Lane[]> lanes;
+     std::atomic<std::uint64_t> trips{0};
+ 
+ public:
+     BatchingTransport(ShardTransport &innerTransport, std::size_t shards)
+         : inner(innerTransport), lanes(new Lane[shards]) {}
+ 
+     void call(std::size_t shard, Span<const ShardRequest> requests, TxStatus *replies) override {
+         Lane &lane = lanes[shard];
+         Waiter self{requests, replies, false};
+         std::unique_lock<std::mutex> lock(lane.mutex);
+         lane.queued.push_back(&self);
+         while (!self.done) {
+             if (lane.sending) {
+                 lane.sent.wait(lock);
+                 continue;
+             }
+             // Lead: everything queued so far goes out as one round trip
+             lane.sending = true;
+             lane.group.swap(lane.queued);
+             lock.unlock();
+             lane.batch.clear();
+             for (Waiter *w : lane.group) {
+                 lane.batch.insert(lane.batch.end(), w->requests.begin(), w->requests.end());
+             }
+             lane.answers.assign(lane.batch.size(), TxStatus::Ok);
+             inner.call(shard, lane.batch, lane.answers.data());
+             trips.fetch_add(1, std::memory_order_relaxed);
+             std::size_t at = 0;
+             for (Waiter *w : lane.group) {
+                 std::copy(lane.answers.begin() + at, lane.answers.begin() + at + w->requests.size(), w->replies);
+                 at += w->requests.size();
+             }
+             lock.lock();
+             for (Waiter *w : lane.group) {
+                 w->done = true;
+             }
+             lane.group.clear();
+             lane.sending = false;
+             lane.sent.notify_all();
+         }
+     }
+ 
+     // Round trips made to the inner transport so far
+     std::uint64_t roundTrips() const { return trips.load(std::memory_order_relaxed); }
+ };
+ 
+ /******************************************************
+  * ShardedBank - Accounts partitioned across Bank shards
+  *  - A ShardRouter assigns each account number to one
+  *    shard; every shard is a complete Bank with its own
+  *    table, ledger, locks and (optionally) durability
+  *  - Traffic reaches the shards through a
+  *    BatchingTransport over a LocalTransport; creation
+  *    and reads go straight to the owning shard
+  *  - A transfer inside one shard is a single request. A
+  *    transfer across shards runs two-phase: the target
+  *    prepares the credit, the source prepares (takes)
+  *    the debit, then both commit; if either refuses,
+  *    both prepared legs are aborted
+  *
+  * Thread safety:
+  *  - Every public method may be called from any thread
+  *  - A cross-shard transfer is atomic per shard, not
+  *    bank-wide: between the phases the debit shows on the
+  *    source before the credit shows on the target
+  *  - Prepared legs are kept in memory only; there is no
+  *    coordinator log, so a crash between the phases
+  *    leaves the debit taken and the credit unapplied
+  ******************************************************/
+ class ShardedBank {
+ private:
+     ShardRouter router;
+     std::vector<std::unique_ptr<Bank>> banks;
+     LocalTransport local;
+     BatchingTransport batching;
+     std::atomic<std::uint64_t> nextTransferId{1};
+     std::unique_ptr<DedupFilter> dedup;  // client transaction ids (enableDeduplication)
+ 
+     template <typename Op>
+     TxStatus once(std::uint64_t clientTxId, Op &&op) {
+         return dedup ? dedup->applyOnce(clientTxId, op) : op();
+     }
+ 
+     static std::vector<std::unique_ptr<Bank>> makeShards(std::size_t count) {
+         std::vector<std::unique_ptr<Bank>> shards;
+         for (std::size_t i = 0; i < count; ++i) {
+             shards.emplace_back(new Bank);
+         }
+         return shards;
+     }
+ 
+     static std::vector<Bank*> pointersTo(const std::vector<std::unique_ptr<Bank>> &shards) {
+         std::vector<Bank*> pointers;
+         for (const auto &bank : shards) {
+             pointers.push_back(bank.get());
+         }
+         return pointers;
+     }
+ 
+     TxStatus send(std::size_t shard, ShardOp op, int accountNumber, int otherAccount, Money amount, std::uint64_t transferId) {
+         ShardRequest request{op, accountNumber, otherAccount, amount, transferId};
+         TxStatus reply = TxStatus::Ok;
+         batching.call(shard, Span<const ShardRequest>(&request, 1), &reply);
+         return reply;
+     }
+ 
+ public:
+     explicit ShardedBank(ShardRouter shardRouter)
+         : router(std::move(shardRouter)), banks(makeShards(router.shards())), local(pointersTo(banks)),
+           batching(local, router.shards()) {}
+ 
+     ShardedBank(const ShardedBank&) = delete;
+     ShardedBank& operator=(const ShardedBank&) = delete;
+ 
+     std::size_t shardCount() const { return banks.size(); }
+     std::size_t shardOf(int accountNumber) const { return router.shardOf(accountNumber); }
+     Bank& shard(std::size_t index) { return *banks[index]; }
+     const Bank& shard(std::size_t index) const { return *banks[index]; }
+ 
+     // Round trips made to the shards (each may carry many coalesced requests)
+     std::uint64_t roundTrips() const { return batching.roundTrips(); }
+ 
+     TxStatus createAccount(AccountKind kind, const std::string &holder, int number, Money initialBalance,
+                            Rate interestRate, Money overdraftLimit) {
+         return banks[shardOf(number)]->createAccount(kind, holder, number, initialBalance, interestRate, overdraftLimit);
+     }
+ 
+     template <class P>
+     TxStatus createAccount(const std::string &holder, int number, Money initialBalance,
+                            Rate interestRate = Rate(), Money overdraftLimit = Money()) {
+         return createAccount(P::kKind, holder, number, initialBalance, interestRate, overdraftLimit);
+     }
+ 
+     TxStatus createSavingsAccount(const std::string &holder, int number, Money initialBalance, Rate interestRate) {
+         return banks[shardOf(number)]->createSavingsAccount(holder, number, initialBalance, interestRate);
+     }
+ 
+     TxStatus createCheckingAccount(const std::string &holder, int number, Money initialBalance, Money overdraftLimit) {
+         return banks[shardOf(number)]->createCheckingAccount(holder, number, initialBalance, overdraftLimit);
+     }
+ 
+     BankAccount* findAccountByNumber(int number) const {
+         return banks[shardOf(number)]->findAccountByNumber(number);
+     }
+ 
+     // Pre-size every shard for an even share of the accounts
+     void reserveAccounts(std::size_t savings, std::size_t checking) {
+         for (auto &bank : banks) {
+             bank->reserveAccounts(savings / banks.size() + 1, checking / banks.size() + 1);
+         }
+     }
+ 
+     TxStatus depositToAccount(int accountNumber, Money amount) {
+         return send(shardOf(accountNumber), ShardOp::Deposit, accountNumber, 0, amount, 0);
+     }
+ 
+     TxStatus withdrawFromAccount(int accountNumber, Money amount) {
+         return send(shardOf(accountNumber), ShardOp::Withdraw, accountNumber, 0, amount, 0);
+     }
+ 
+     // Same rules and statuses as Bank::transfer; see the class comment for cross-shard atomicity
+     TxStatus transfer(int fromAccount, int toAccount, Money amount) {
+         std::size_t source = shardOf(fromAccount);
+         std::size_t target = shardOf(toAccount);
+         if (source == target) {
+             return send(source, ShardOp::Transfer, fromAccount, toAccount, amount, 0);
+         }
+ 
+         // Phase 1: the target checks its account, then the source takes the funds
+         std::uint64_t id = nextTransferId.fetch_add(1, std::memory_order_relaxed);
+         TxStatus status = send(target, ShardOp::PrepareCredit, toAccount, 0, amount, id);
+         if (status == TxStatus::Ok) {
+             status = send(source, ShardOp::PrepareDebit, fromAccount, 0, amount, id);
+         }
+         if (status != TxStatus::Ok) {
+             // Abort is a no-op for a side that never prepared
+             send(source, ShardOp::Abort, fromAccount, 0, amount, id);
+             send(target, ShardOp::Abort, toAccount, 0, amount, id);
+             return status;
+         }
+ 
+         // Phase 2: both sides voted yes. The credit commits first: if the target's balance
+         // can't hold it, the source's debit is refunded instead
+         TxStatus credit = send(target, ShardOp::Commit, toAccount, 0, amount, id);
+         if (credit == TxStatus::BalanceOverflow) {
+             send(source, ShardOp::Abort, fromAccount, 0, amount, id);
+             send(target, ShardOp::Abort, toAccount, 0, amount, id);
+             return credit;
+         }
+         TxStatus debit = send(source, ShardOp::Commit, fromAccount, 0, amount, id);
+         return credit != TxStatus::Ok ? credit : debit;
+     }
+ 
+     // Client transaction ids, as on Bank; one filter in front of every shard, so an id is
+     // deduplicated whichever shards its operation touches
+     void enableDeduplication(std::chrono::milliseconds window = std::chrono::milliseconds(10000),
+                              std::size_t capacity = std::size_t(1) << 20) {
+         dedup.reset(new DedupFilter(window, capacity));
+     }
+ 
+     TxStatus depositToAccount(int accountNumber, Money amount, std::uint64_t clientTxId) {
+         return once(clientTxId, [&] { return depositToAccount(accountNumber, amount); });
+     }
+ 
+     TxStatus withdrawFromAccount(int accountNumber, Money amount, std::uint64_t clientTxId) {
+         return once(clientTxId, [&] { return withdrawFromAccount(accountNumber, amount); });
+     }
+ 
+     TxStatus transfer(int fromAccount, int toAccount, Money amount, std::uint64_t clientTxId) {
+         return once(clientTxId, [&] { return transfer(fromAccount, toAccount, amount); });
+     }
+ 
+     // Withdrawal limits, as on Bank; a cross-shard transfer counts at its source's prepare
+     TxStatus setWithdrawalLimits(int accountNumber, Money dailyLimit, std::uint32_t maxPerWindow) {
+         return banks[shardOf(accountNumber)]->setWithdrawalLimits(accountNumber, dailyLimit, maxPerWindow);
+     }
+ 
+     void setVelocityWindow(std::chrono::microseconds window) {
+         for (auto &bank : banks) {
+             bank->setVelocityWindow(window);
+         }
+     }
+ 
+     // Split a batch by shard and send every shard its part as one round trip, all shards
+     // at once. Per-account order is preserved; one status per request, in request order.
+     std::vector<TxStatus> applyBatch(Span<const TxRequest> requests) {
+         std::size_t shards = banks.size();
+         std::vector<std::vector<ShardRequest>> parts(shards);
+         std::vector<std::vector<std::uint32_t>> positions(shards);
+         for (std::size_t i = 0; i < requests.size(); ++i) {
+             const TxRequest &r = requests[i];
+             std::size_t s = shardOf(r.accountNumber);
+             ShardOp op = r.op == TxOp::Deposit ? ShardOp::Deposit : r.op == TxOp::Withdraw ? ShardOp::Withdraw : ShardOp::Interest;
+             parts[s].push_back(ShardRequest{op, r.accountNumber, 0, r.amount, 0});
+             positions[s].push_back(static_cast<std::uint32_t>(i));
+         }
+ 
+         std::vector<std::vector<TxStatus>> replies(shards);
+         auto deliver = [&](std::size_t s) {
+             replies[s].resize(parts[s].size());
+             batching.call(s, parts[s], replies[s].data());
+         };
+         std::vector<std::thread> workers;
+         std::size_t first = shards;
+         for (std::size_t s = 0; s < shards; ++s) {
+             if (parts[s].empty()) {
+                 continue;
+             }
+             if (first == shards) {
+                 first = s;
+             } else {
+                 workers.emplace_back(deliver, s);
+             }
+         }
+         if (first != shards) {
+             deliver(first);
+         }
+         for (auto &worker : workers) {
+             worker.join();
+         }
+ 
+         std::vector<TxStatus> statuses(requests.size(), TxStatus::Ok);
+         for (std::size_t s = 0; s < shards; ++s) {
+             for (std::size_t i = 0; i < positions[s].size(); ++i) {
+                 statuses[positions[s][i]] = replies[s][i];
+             }
+         }
+         return statuses;
+     }
+ 
+     // Sum of every shard's incrementally kept totals
+     BankTotals totals() const {
+         BankTotals sum{};
+         for (const auto &bank : banks) {
+             BankTotals t = bank->totals();
+             sum.depositsHeld += t.depositsHeld;
+             sum.overdrawn += t.overdrawn;
+             sum.overdraftLimits += t.overdraftLimits;
+             sum.projectedInterest += t.projectedInterest;
+             for (std::size_t k = 0; k < kAccountKinds; ++k) {
+                 sum.accountsOfKind[k] += t.accountsOfKind[k];
+             }
+             sum.overdrawnAccounts += t.overdrawnAccounts;
+         }
+         return sum;
+     }
+ };
+ 
+ /******************************************************
+  * OperationScheduler - Prioritized, rate-limited front
+  * of a Bank
+  *  - Jobs belong to a priority class: Customer
+  *    (deposits, withdrawals, transfers), Standard, or
+  *    Bulk (interest runs, reports, imports). A free
+  *    worker takes the oldest job of the highest class
+  *    allowed to start
+  *  - Each class has a cap on jobs running at once and a
+  *    token bucket charged one token per operation or
+  *    chunk; a class over either limit waits while lower
+  *    classes run
+  *  - Bulk jobs are cooperative: a step does one chunk of
+  *    rows and the job goes back to the end of its queue,
+  *    so customer operations queued meanwhile start
+  *    before its next chunk
+  *  - By default Bulk uses at most all but one worker, so
+  *    a customer operation waits for a free worker at
+  *    most one chunk long
+  *  - Strict priority: Bulk starves only while the higher
+  *    classes keep every worker busy (a rate limit on
+  *    them bounds that)
+  *  - Results come back as std::future; the destructor
+  *    runs every queued job first
+  ******************************************************/
+ enum class Priority : std::uint8_t {
+     Customer,
+     Standard,
+     Bulk
+ };
+ 
+ constexpr std::size_t kPriorities = 3;
+ 
+ struct PriorityLimits {
+     std::size_t maxRunning;  // jobs of the class running at once (0 = no cap)
+     double ratePerSecond;    // tokens added per second (0 = no rate limit)
+     double burst;            // bucket depth in tokens (at least 1)
+ };
+ 
+ struct SchedulerStats {
+     std::size_t queued;
+     std::size_t running;
+     std::uint64_t started;    // operations and chunks started
+     std::uint64_t completed;  // jobs finished
+     std::uint64_t throttled;  // times a worker found the class out of tokens
+ };
+ 
+ // Refills continuously at `rate` tokens per second, up to `burst`
+ class TokenBucket {
+ private:
+     double rate = 0.0;
+     double burst = 1.0;
+     double tokens = 1.0;
+     std::chrono::steady_clock::time_point refilled;
+ 
+ public:
+     void configure(double ratePerSecond, double depth, std::chrono::steady_clock::time_point now) {
+         rate = ratePerSecond;
+         burst = depth < 1.0 ? 1.0 : depth;
+         tokens = burst;
+         refilled = now;
+     }
+ 
+     bool limited() const { return rate > 0.0; }
+ 
+     // Take one token, or return false and set `ready` to when the next one is due
+     bool take(std::chrono::steady_clock::time_point now, std::chrono::steady_clock::time_point &ready) {
+         std::chrono::duration<double> elapsed = now - refilled;
+         tokens = std::min(burst, tokens + elapsed.count() * rate);
+         refilled = now;
+         if (tokens >= 1.0) {
+             tokens -= 1.0;
+             return true;
+         }
+         ready = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                           std::chrono::duration<double>((1.0 - tokens) / rate));
+         return false;
+     }
+ };
+ 
+ class OperationScheduler {
+ public:
+     static constexpr std::size_t kDefaultChunkRows = 4096;
+ 
+ private:
+     typedef std::function<bool()> Step;  // runs one operation or chunk; true once the job is finished
+ 
+     struct PriorityClass {
+         std::deque<Step> queue;
+         PriorityLimits limits{0, 0.0, 1.0};
+         TokenBucket bucket;
+         std::size_t running = 0;
+         std::uint64_t started = 0;
+         std::uint64_t completed = 0;
+         std::uint64_t throttled = 0;
+     };
+ 
+     Bank &bank;
+     mutable std::mutex mutex;
+     std::condition_variable wake;
+     PriorityClass classes[kPriorities];
+     std::size_t queued = 0;                // jobs across all queues, guarded by mutex
+     bool stopping = false;                 // guarded by mutex
+     std::vector<std::thread> workers;
+ 
+     // Under the mutex: the next step allowed to start, or false with `wakeAt` lowered
+     // to when a throttled class gets its next token
+     bool pick(std::size_t &priority, Step &step, std::chrono::steady_clock::time_point &wakeAt) {
+         std::chrono::steady_clock::time_point now;
+         bool haveNow = false;
+         for (std::size_t p = 0; p < kPriorities; ++p) {
+             PriorityClass &c = classes[p];
+             if (c.queue.empty() || (c.limits.maxRunning != 0 && c.running >= c.limits.maxRunning)) {
+                 continue;
+             }
+             if (c.bucket.limited()) {
+                 if (!haveNow) {
+                     now = std::chrono::steady_clock::now();
+                     haveNow = true;
+                 }
+                 std::chrono::steady_clock::time_point ready;
+                 if (!c.bucket.take(now, ready)) {
+                     ++c.throttled;
+                     wakeAt = std::min(wakeAt, ready);
+                     continue;
+                 }
+             }
+             step = std::move(c.queue.front());
+             c.queue.pop_front();
+             --queued;
+             ++c.running;
+             ++c.started;
+             priority = p;
+             return true;
+         }
+         return false;
+     }
+ 
+     void workerLoop() {
+         std::unique_lock<std::mutex> lock(mutex);
+         for (;;) {
+             std::size_t priority = 0;
+             Step step;
+             std::chrono::steady_clock::time_point wakeAt = std::chrono::steady_clock::time_point::max();
+             if (pick(priority, step, wakeAt)) {
+                 lock.unlock();
+                 bool finished = step();
+                 lock.lock();
+                 PriorityClass &c = classes[priority];
+                 --c.running;
+                 if (finished) {
+                     ++c.completed;
+                 } else {
+                     c.queue.push_back(std::move(step));  // yield: queued work of every class goes first
+                     ++queued;
+                 }
+                 if (queued > 1) {
+                     wake.notify_one();  // a slot just freed up; this worker takes one job, another may start
+                 }
+                 continue;
+             }
+             if (stopping && queued == 0) {
+                 return;
+             }
+             if (wakeAt == std::chrono::steady_clock::time_point::max()) {
+                 wake.wait(lock);
+             } else {
+                 wake.wait_until(lock, wakeAt);
+             }
+         }
+     }
+ 
+     void enqueue(Priority priority, Step step) {
+         {
+             std::lock_guard<std::mutex> guard(mutex);
+             classes[static_cast<std::size_t>(priority)].queue.push_back(std::move(step));
+             ++queued;
+         }
+         wake.notify_one();
+     }
+ 
+ public:
+     explicit OperationScheduler(Bank &target, unsigned threadCount = std::thread::hardware_concurrency())
+         : bank(target) {
+         unsigned count = threadCount == 0 ? 1 : threadCount;
+         classes[static_cast<std::size_t>(Priority::Bulk)].limits.maxRunning = count > 1 ? count - 1 : 1;
+         for (unsigned i = 0; i < count; ++i) {
+             workers.emplace_back(&OperationScheduler::workerLoop, this);
+         }
+     }
+ 
+     // Runs every queued job, throttled jobs included, then stops
+     ~OperationScheduler() {
+         {
+             std::lock_guard<std::mutex> guard(mutex);
+             stopping = true;
+         }
+         wake.notify_all();
+         for (auto &worker : workers) {
+             worker.join();
+         }
+     }
+ 
+     OperationScheduler(const OperationScheduler&) = delete;
+     OperationScheduler& operator=(const OperationScheduler&) = delete;
+ 
+     // Replace a class's limits; its token bucket starts full
+     void setLimits(Priority priority, PriorityLimits limits) {
+         {
+             std::lock_guard<std::mutex> guard(mutex);
+             PriorityClass &c = classes[static_cast<std::size_t>(priority)];
+             c.limits = limits;
+             c.bucket.configure(limits.ratePerSecond, limits.burst, std::chrono::steady_clock::now());
+         }
+         wake.notify_all();
+     }
+ 
+     PriorityLimits limits(Priority priority) const {
+         std::lock_guard<std::mutex> guard(mutex);
+         return classes[static_cast<std::size_t>(priority)].limits;
+     }
+ 
+     SchedulerStats stats(Priority priority) const {
+         std::lock_guard<std::mutex> guard(mutex);
+         const PriorityClass &c = classes[static_cast<std::size_t>(priority)];
+         return SchedulerStats{c.queue.size(), c.running, c.started, c.completed, c.throttled};
+     }
+ 
+     std::size_t threadCount() const { return workers.size(); }
+ 
+     // Run `operation` (any callable on the bank) as one job of `priority`
+     template <typename Operation>
+     auto submit(Priority priority, Operation operation) -> std::future<decltype(operation())> {
+         typedef decltype(operation()) Result;
+         std::shared_ptr<std::packaged_task<Result()>> task = std::make_shared<std::packaged_task<Result()>>(std::move(operation));
+         std::future<Result> result = task->get_future();
+         enqueue(priority, [task] {
+             (*task)();
+             return true;
+         });
+         return result;
+     }
+ 
+     // Run a job in steps: each call of `step` does one chunk and returns true once the job
+     // is done. The job yields to queued work between chunks and never runs two at once.
+     template <typename ChunkStep>
+     std::future<void> submitChunked(Priority priority, ChunkStep step) {
+         std::shared_ptr<std::promise<void>> done = std::make_shared<std::promise<void>>();
+         std::future<void> result = done->get_future();
+         enqueue(priority, [step, done]() mutable {
+             if (!step()) {
+                 return false;
+             }
+             done->set_value();
+             return true;
+         });
+         return result;
+     }
+ 
+     std::future<TxStatus> deposit(int accountNumber, Money amount, Priority priority = Priority::Customer) {
+         return submit(priority, [this, accountNumber, amount] { return bank.depositToAccount(accountNumber, amount); });
+     }
+ 
+     std::future<TxStatus> withdraw(int accountNumber, Money amount, Priority priority = Priority::Customer) {
+         return submit(priority, [this, accountNumber, amount] { return bank.withdrawFromAccount(accountNumber, amount); });
+     }
+ 
+     std::future<TxStatus> transfer(int fromAccount, int toAccount, Money amount, Priority priority = Priority::Customer) {
+         return submit(priority, [this, fromAccount, toAccount, amount] { return bank.transfer(fromAccount, toAccount, amount); });
+     }
+ 
+     // Bank::applyInterestToAllSavings as a Bulk job of `chunkRows` rows per step. Accounts
+     // created before the run reaches their row are credited too.
+     std::future<InterestRunReport> applyInterestToAllSavings(std::size_t chunkRows = kDefaultChunkRows) {
+         struct Run {
+             InterestRunReport report{0, Money(), 0.0, 0.0};
+             std::size_t next = 0;
+             std::chrono::steady_clock::time_point start;
+             std::promise<InterestRunReport> done;
+         };
+         std::shared_ptr<Run> run = std::make_shared<Run>();
+         std::future<InterestRunReport> result = run->done.get_future();
+         std::size_t rows = chunkRows == 0 ? 1 : chunkRows;
+         enqueue(Priority::Bulk, [this, run, rows] {
+             if (run->next == 0) {
+                 run->start = std::chrono::steady_clock::now();
+             }
+             std::size_t end = bank.applyInterestToRows(run->next, rows, run->report);
+             bool finished = end - run->next < rows;
+             run->next = end;
+             if (finished) {
+                 bank.finishInterestRun(run->report, end, run->start);
+                 run->done.set_value(run->report);
+             }
+             return finished;
+         });
+         return result;
+     }
+ 
+     // Bank::listAllAccounts as a Bulk job printing `chunkRows` accounts per step, all as
+     // of the moment its first chunk runs
+     std::future<void> listAllAccounts(std::ostream &out, std::size_t chunkRows = kDefaultChunkRows) {
+         struct Listing {
+             std::unique_ptr<ReadView> snapshot;
+             std::size_t next = 0;
+         };
+         std::shared_ptr<Listing> listing = std::make_shared<Listing>();
+         std::size_t rows = chunkRows == 0 ? 1 : chunkRows;
+         return submitChunked(Priority::Bulk, [this, listing, rows, &out] {
+             if (!listing->snapshot) {
+                 listing->snapshot.reset(new ReadView(bank.readView()));
+                 if (listing->snapshot->size() == 0) {
+                     out << "[Info] No accounts in the bank.\n";
+                     return true;
+                 }
+                 out << "----- Listing All Accounts -----\n";
+             }
+             listing->next = bank.listAccounts(*listing->snapshot, listing->next, rows, out);
+             return listing->next >= listing->snapshot->size();
+         });
+     }
+ 
+     // Bank::importAccounts as one Bulk job (it splits the file across its own threads)
+     std::future<ImportReport> importAccounts(const std::string &path, unsigned threads = std::thread::hardware_concurrency()) {
+         return submit(Priority::Bulk, [this, path, threads] { return bank.importAccounts(path, threads); });
+     }
+ };
+ 
+ #if defined(__cpp_lib_coroutine)
+ /******************************************************
+  * Async API (C++20 builds only)
+  *  - BankTask<T>: a lazily started coroutine returning T;
+  *    co_await one to run it and get its result
+  *  - TaskExecutor: a fixed set of worker threads, one
+  *    run queue each. A worker runs its own queue newest
+  *    first (the frame is still in cache) and, when it
+  *    runs dry, steals the oldest task from another queue
+  *  - AsyncBank: co_await bank.deposit(acct, amt) and
+  *    friends. The operation runs on a worker; with
+  *    durability on, the task then suspends until the log
+  *    write covering it is synced instead of blocking
+  *    the worker, so a few threads keep many thousands of
+  *    operations in flight
+  ******************************************************/
+ template <typename T> class BankTask;
+ 
+ namespace task_detail {
+ 
+ struct PromiseBase {
+     std::coroutine_handle<> continuation;  // resumed when the task finishes
+     bool detached = false;                 // spawned: the frame frees itself
+ 
+     struct FinalAwaiter {
+         bool await_ready() noexcept { return false; }
+ 
+         template <typename Promise>
+         std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> self) noexcept {
+             PromiseBase &promise = self.promise();
+             if (promise.continuation) {
+                 return promise.continuation;
+             }
+             if (promise.detached) {
+                 self.destroy();
+             }
+             return std::noop_coroutine();
+         }
+ 
+         void await_resume() noexcept {}
+     };
+ 
+     std::suspend_always initial_suspend() noexcept { return {}; }
+     FinalAwaiter final_suspend() noexcept { return {}; }
+     void unhandled_exception() { std::terminate(); }  // operations report TxStatus, never throw
+ };
+ 
+ template <typename T>
+ struct Promise : PromiseBase {
+     T value{};
+ 
+     BankTask<T> get_return_object();
+     void return_value(T result) { value = std::move(result); }
+ };
+ 
+ template <>
+ struct Promise<void> : PromiseBase {
+     BankTask<void> get_return_object();
+     void return_void() {}
+ };
+ 
+ }  // namespace task_detail
+ 
+ template <typename T>
+ class BankTask {
+ public:
+     using promise_type = task_detail::Promise<T>;
+ 
+ private:
+     std::coroutine_handle<promise_type> handle;
+ 
+     friend class TaskExecutor;
+ 
+ public:
+     explicit BankTask(std::coroutine_handle<promise_type> h) : handle(h) {}
+     BankTask(BankTask &&other) noexcept : handle(other.handle) { other.handle = nullptr; }
+     BankTask& operator=(BankTask &&other) noexcept {
+         std::swap(handle, other.handle);
+         return *this;
+     }
+     ~BankTask() {
+         if (handle) {
+             handle.destroy();
+         }
+     }
+ 
+     BankTask(const BankTask&) = delete;
+     BankTask& operator=(const BankTask&) = delete;
+ 
+     // Awaiting starts the task; the awaiter resumes, on whichever thread finished it, with the result
+     bool await_ready() const noexcept { return false; }
+     std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+         handle.promise().continuation = awaiter;
+         return handle;
+     }
+     T await_resume() {
+         if constexpr (!std::is_void<T>::value) {
+             return std::move(handle.promise().value);
+         }
+     }
+ };
+ 
+ namespace task_detail {
+ 
+ template <typename T>
+ BankTask<T> Promise<T>::get_return_object() {
+     return BankTask<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+ }
+ 
+ inline BankTask<void> Promise<void>::get_return_object() {
+     return BankTask<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+ }
+ 
+ }  // namespace task_detail
+ 
+ class TaskExecutor {
+ private:
+     struct alignas(64) Worker {
+         SpinLock lock;
+         std::deque<std::coroutine_handle<>> queue;
+     };
+ 
+     std::size_t count;
+     std::unique_ptr<Worker[]> workers;
+     std::vector<std::thread> threads;
+     std::atomic<std::size_t> queued{0};      // handles across all queues
+     std::atomic<std::size_t> nextQueue{0};   // round robin for submissions from other threads
+     std::atomic<std::size_t> sleepers{0};
+     std::mutex sleepMutex;
+     std::condition_variable wake;
+     bool stopping = false;                   // guarded by sleepMutex
+ 
+     struct WorkerSlot {
+         TaskExecutor *executor;
+         std::size_t index;
+     };
+ 
+     static WorkerSlot& currentWorker() {
+         static thread_local WorkerSlot slot{nullptr, 0};
+         return slot;
+     }
+ 
+     bool take(std::size_t self, std::coroutine_handle<> &out) {
+         {
+             Worker &own = workers[self];
+             std::lock_guard<SpinLock> guard(own.lock);
+             if (!own.queue.empty()) {
+                 out = own.queue.back();
+                 own.queue.pop_back();
+                 queued.fetch_sub(1);
+                 return true;
+             }
+         }
+         for (std::size_t i = 1; i < count; ++i) {
+             Worker &victim = workers[(self + i) % count];
+             std::lock_guard<SpinLock> guard(victim.lock);
+             if (!victim.queue.empty()) {
+                 out = victim.queue.front();
+                 victim.queue.pop_front();
+                 queued.fetch_sub(1);
+                 return true;
+             }
+         }
+         return false;
+     }
+ 
+     void workerLoop(std::size_t self) {
+         currentWorker() = WorkerSlot{this, self};
+         for (;;) {
+             std::coroutine_handle<> next;
+             if (take(self, next)) {
+                 next.resume();
+                 continue;
+             }
+             std::unique_lock<std::mutex> lock(sleepMutex);
+             sleepers.fetch_add(1);
+             wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+             sleepers.fetch_sub(1);
+             if (stopping && queued.load() == 0) {
+                 return;
+             }
+         }
+     }
+ 
+     template <typename T>
+     static BankTask<void> complete(BankTask<T> task, std::promise<T> done) {
+         done.set_value(co_await task);
+     }
+ 
+     static BankTask<void> complete(BankTask<void> task, std::promise<void> done) {
+         co_await task;
+         done.set_value();
+     }
+ 
+ public:
+     explicit TaskExecutor(unsigned threadCount = std::thread::hardware_concurrency())
+         : count(threadCount == 0 ? 1 : threadCount), workers(new Worker[count]) {
+         for (std::size_t i = 0; i < count; ++i) {
+             threads.emplace_back(&TaskExecutor::workerLoop, this, i);
+         }
+     }
+ 
+     // Runs every queued task, then stops; tasks still suspended elsewhere must have finished
+     ~TaskExecutor() {
+         {
+             std::lock_guard<std::mutex> guard(sleepMutex);
+             stopping = true;
+         }
+         wake.notify_all();
+         for (auto &thread : threads) {
+             thread.join();
+         }
+     }
+ 
+     TaskExecutor(const TaskExecutor&) = delete;
+     TaskExecutor& operator=(const TaskExecutor&) = delete;
+ 
+     // Queue a suspended coroutine: on the current worker's queue when called from one,
+     // round robin otherwise
+     void post(std::coroutine_handle<> handle) {
+         WorkerSlot &slot = currentWorker();
+         std::size_t target = slot.executor == this ? slot.index : nextQueue.fetch_add(1, std::memory_order_relaxed) % count;
+         {
+             Worker &worker = workers[target];
+             std::lock_guard<SpinLock> guard(worker.lock);
+             worker.queue.push_back(handle);
+         }
+         queued.fetch_add(1);
+         if (sleepers.load() > 0) {
+             std::lock_guard<std::mutex> guard(sleepMutex);
+             wake.notify_one();
+         }
+     }
+ 
+     // co_await executor.schedule() continues on a worker (at once if already on one)
+     struct ScheduleAwaiter {
+         TaskExecutor &executor;
+         bool await_ready() const noexcept { return currentWorker().executor == &executor; }
+         void await_suspend(std::coroutine_handle<> handle) { executor.post(handle); }
+         void await_resume() const noexcept {}
+     };
+     ScheduleAwaiter schedule() { return ScheduleAwaiter{*this}; }
+ 
+     // Start a task that nobody awaits; its frame is freed when it finishes
+     void spawn(BankTask<void> task) {
+         std::coroutine_handle<task_detail::Promise<void>> handle = task.handle;
+         task.handle = nullptr;
+         handle.promise().detached = true;
+         post(handle);
+     }
+ 
+     // Run a task to completion from a thread outside the executor and return its result
+     template <typename T>
+     T run(BankTask<T> task) {
+         std::promise<T> done;
+         std::future<T> result = done.get_future();
+         spawn(complete(std::move(task), std::move(done)));
+         return result.get();
+     }
+ 
+     std::size_t threadCount() const { return count; }
+ };
+ 
+ class AsyncBank {
+ private:
+     Bank &bank;
+     TaskExecutor &executor;
+ 
+     // Suspends until the log position an operation noted is synced; true if it was written
+     struct DurableAwaiter {
+         TaskExecutor &executor;
+         WriteAheadLog *log;
+         std::uint64_t position;
+         bool ok;
  
-         if (amount <= balance) {
-             balance -= amount;
-             transactionHistory.emplace_back("Withdrawal", amount, balance);
-         } else {
-             std::cout << "[Withdraw Error] Amount exceeds available balance.\n";
+         bool await_ready() const noexcept { return log == nullptr; }
+         void await_suspend(std::coroutine_handle<> handle) {
+             log->whenDurable(position, [this, handle](bool written) {
+                 ok = written;
+                 executor.post(handle);
+             });
          }
+         bool await_resume() const noexcept { return ok; }
+     };
+ 
+     // Run `operation` here with durability deferred; the awaiter then waits for its log
+     // records. The scope ends before the task suspends, since it is per thread.
+     template <typename Operation>
+     DurableAwaiter deferred(Operation &&operation) {
+         Bank::DeferredDurability scope;
+         operation();
+         return DurableAwaiter{executor, scope.log(), scope.position(), true};
      }
  
-     // Returns current balance
-     double getBalance() const {
-         return balance;
+     static TxStatus logged(TxStatus status, bool written) {
+         return status == TxStatus::Ok && !written ? TxStatus::NotDurable : status;
      }
  
-     // Returns account number
-     int getAccountNumber() const {
-         return accountNumber;
+ public:
+     AsyncBank(Bank &target, TaskExecutor &workers) : bank(target), executor(workers) {}
+ 
+     Bank& underlying() { return bank; }
+ 
+     BankTask<TxStatus> deposit(int accountNumber, Money amount) {
+         co_await executor.schedule();
+         TxStatus status = TxStatus::Ok;
+         bool written = co_await deferred([&] { status = bank.depositToAccount(accountNumber, amount); });
+         co_return logged(status, written);
      }
  
-     // Polymorphic display function – each derived class can override
-     virtual void displayAccountInfo() const {
-         std::cout << "Account Holder  : " << accountHolder << "\n"
-                   << "Account Number  : " << accountNumber << "\n"
-                   << "Current Balance : $" << std::fixed << std::setprecision(2) << balance << "\n";
+     BankTask<TxStatus> withdraw(int accountNumber, Money amount) {
+         co_await executor.schedule();
+         TxStatus status = TxStatus::Ok;
+         bool written = co_await deferred([&] { status = bank.withdrawFromAccount(accountNumber, amount); });
+         co_return logged(status, written);
      }
  
-     // Show the transaction log
-     virtual void showTransactionHistory() const {
-         if (transactionHistory.empty()) {
-             std::cout << "No transactions recorded for this account.\n";
-             return;
-         }
+     BankTask<TxStatus> transfer(int fromAccount, int toAccount, Money amount) {
+         co_await executor.schedule();
+         TxStatus status = TxStatus::Ok;
+         bool written = co_await deferred([&] { status = bank.transfer(fromAccount, toAccount, amount); });
+         co_return logged(status, written);
+     }
+ 
+     BankTask<TxResult> applyInterest(int accountNumber) {
+         co_await executor.schedule();
+         TxResult result{TxStatus::Ok, Money()};
+         bool written = co_await deferred([&] { result = bank.applyInterestToSavings(accountNumber); });
+         result.status = logged(result.status, written);
+         co_return result;
+     }
  
-         std::cout << "Transaction History for Account #" << accountNumber << ":\n";
-         for (const auto &tx : transactionHistory) {
-             std::cout << "  [" << tx.type << "]  Amount: $"
-                       << std::fixed << std::setprecision(2) << tx.amount
-                       << "  => Balance After: $"
-                       << tx.resultingBalance << "\n";
+     BankTask<std::vector<TxStatus>> applyBatch(std::vector<TxRequest> requests) {
+         co_await executor.schedule();
+         std::vector<TxStatus> statuses;
+         bool written = co_await deferred([&] { statuses = bank.applyBatch(requests); });
+         for (TxStatus &status : statuses) {
+             status = logged(status, written);
          }
+         co_return statuses;
      }
  };
+ #endif  // __cpp_lib_coroutine
  
+ #if defined(BANK_BENCHMARK)
  /******************************************************
-  * SavingsAccount - Derived Class
-  *  - Inherits from BankAccount
-  *  - Has an additional interest rate
-  *  - Offers interest application method
+  * Benchmark build (-DBANK_BENCHMARK)
+  *  - Replaces the menu with a microbenchmark run:
+  *      g++ -std=c++17 -O2 -march=native -pthread -DBANK_BENCHMARK \
+  *          BankAccountSystem.cpp -o bank_bench
+  *      ./bank_bench [maxAccounts]   (default 1000000)
+  *  - Sizes step by 10x from 1K up to maxAccounts
+  *  - Reports ns/op, heap allocations/op and, for the
+  *    create benchmarks, heap bytes allocated per account
+  *  - Allocations are counted by replacing global
+  *    operator new for this build only
   ******************************************************/
- class SavingsAccount : public BankAccount {
- private:
-     double interestRate;  // e.g., 0.03 for 3% annual interest
+ static std::atomic<std::uint64_t> benchAllocations(0);
+ static std::atomic<std::uint64_t> benchAllocatedBytes(0);
  
- public:
-     SavingsAccount(const std::string &holder, int number, double initialBalance, double rate)
-         : BankAccount(holder, number, initialBalance), interestRate(rate) {}
+ static void* benchAllocate(std::size_t bytes, std::size_t alignment) {
+     benchAllocations.fetch_add(1, std::memory_order_relaxed);
+     benchAllocatedBytes.fetch_add(bytes, std::memory_order_relaxed);
+     if (bytes == 0) {
+         bytes = 1;
+     }
+     void *p = alignment <= alignof(std::max_align_t)
+         ? std::malloc(bytes)
+         : std::aligned_alloc(alignment, (bytes + alignment - 1) / alignment * alignment);
+     if (!p) {
+         throw std::bad_alloc();
+     }
+     return p;
+ }
  
-     // Apply interest to the current balance
-     void applyInterest() {
-         double interest = balance * interestRate;
-         balance += interest;
-         // Log as a "Deposit" to maintain a consistent transaction record
-         // though it's not a deposit from outside
-         // This can help show how the balance changed
-         Transaction tx("Interest", interest, balance);
-         
-         // Since transactionHistory is private in BankAccount, we need
-         // a specialized logging approach if we want to preserve it exactly.
-         // For simplicity, let's do a deposit call so it logs it:
-         //   deposit(interest);
-         // But deposit also checks that interest > 0, which is fine here.
-         if (interest > 0) {
-             deposit(interest); // This will both add to balance again and log
-             // But that would double-add the interest, so let's revert that approach:
-             // We'll mimic what deposit does internally instead:
-         } else {
-             // If rate <= 0 or balance is 0, no interest is added
-             std::cout << "[Info] No interest applied because calculated interest is zero or negative.\n";
-         }
-         // To keep the correct final number, let's fix the approach:
-         //   - We'll increment the balance ourselves
-         //   - We'll create a custom transaction record
-         // Because transactionHistory is private in BankAccount, we could
-         // store partial info or bypass. For demonstration, let's keep it
-         // simpler by applying interest in a custom manner:
+ void* operator new(std::size_t bytes) { return benchAllocate(bytes, 0); }
+ void* operator new[](std::size_t bytes) { return benchAllocate(bytes, 0); }
+ void* operator new(std::size_t bytes, std::align_val_t a) { return benchAllocate(bytes, static_cast<std::size_t>(a)); }
+ void* operator new[](std::size_t bytes, std::align_val_t a) { return benchAllocate(bytes, static_cast<std::size_t>(a)); }
+ void operator delete(void *p) noexcept { std::free(p); }
+ void operator delete[](void *p) noexcept { std::free(p); }
+ void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+ void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+ void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+ void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+ void operator delete(void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+ void operator delete[](void *p, std::size_t, std::align_val_t) noexcept { std::free(p); }
  
-         // We'll revert the repeated deposit above by subtracting interest:
-         balance -= interest;
-         // Now let's do a "deposit" but rename it to "Interest" in logs properly:
-         // We'll do it by an override approach to keep transaction logging consistent.
+ // Stream that discards output, for the display benchmarks
+ class NullBuffer : public std::streambuf {
+ protected:
+     int overflow(int c) override { return c; }
+     std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+ };
  
-         // "Direct approach": We can create a protected method to add to transactionHistory,
-         // or we can do a little workaround to reapply interest properly.
+ struct BenchResult {
+     double nsPerOp;
+     double allocsPerOp;
+ };
  
-         // Let's do the workaround: 
-         // 1) Subtract interest from balance (back to original).
-         // 2) deposit(interest) which logs it. We still have a deposit label though.
-         //    It's simpler than rewriting the entire logging logic. 
-         // We'll rename deposit calls as "Interest" by overloading or bridging. 
-         // For demonstration, let's do an interest deposit approach:
+ // Run `body` (which performs `opsPerCall` operations) until ~0.2 s have passed
+ template <typename Body>
+ static BenchResult measure(std::size_t opsPerCall, Body &&body) {
+     std::uint64_t allocationsBefore = benchAllocations.load(std::memory_order_relaxed);
+     auto start = std::chrono::steady_clock::now();
+     std::chrono::duration<double> elapsed(0);
+     std::uint64_t calls = 0;
+     do {
+         body();
+         ++calls;
+         elapsed = std::chrono::steady_clock::now() - start;
+     } while (elapsed.count() < 0.2);
+     double ops = static_cast<double>(calls) * opsPerCall;
+     double allocations = static_cast<double>(benchAllocations.load(std::memory_order_relaxed) - allocationsBefore);
+     return BenchResult{elapsed.count() * 1e9 / ops, allocations / ops};
+ }
  
-         // We'll define a separate function to log this custom transaction.
+ static void report(const char *name, std::size_t accounts, BenchResult r, double bytesPerAccount = -1.0) {
+     std::cout << std::left << std::setw(28) << name << std::right << std::setw(11) << accounts
+               << std::fixed << std::setprecision(1) << std::setw(12) << r.nsPerOp
+               << std::setprecision(2) << std::setw(12) << r.allocsPerOp;
+     if (bytesPerAccount >= 0.0) {
+         std::cout << std::setprecision(1) << std::setw(14) << bytesPerAccount;
+     } else {
+         std::cout << std::setw(14) << "-";
      }
+     std::cout << "\n";
+ }
  
-     // A specialized method to deposit interest directly in the log
-     // to keep the naming more accurate. This function isn't standard
-     // but shows extended usage.
-     void depositInterest(double interest) {
-         if (interest > 0) {
-             balance += interest;
-             // We need a new transaction record named "Interest"
-             // However, transactionHistory is private in BankAccount,
-             // so we don't have direct access. We'll do a manual approach:
-             // We'll do a standard deposit call with a "custom deposit type".
-             // Another approach is to rename deposit to allow passing a "type".
-             // For clarity, let's re-implement it here:
-             std::cout << "[Info] Successfully applied interest of $"
-                       << std::fixed << std::setprecision(2) << interest << "\n";
-             // We can't call deposit(interest) if we want a different type name in logs
-             // (the base deposit logs as "Deposit"). If you want a custom name,
-             // you must store your transactions differently or add another parameter
-             // to deposit. For demonstration, let's just do a deposit(interest) so it's
-             // properly in the transaction list, even though it's labeled "Deposit".
-             
-             deposit(interest); // logs as "Deposit"
+ // Build a bank of `accounts` accounts: even numbers are savings with a large balance,
+ // odd numbers are checking at zero with a large overdraft limit
+ template <typename BankType>
+ static void populate(BankType &bank, std::size_t accounts) {
+     bank.reserveAccounts(accounts / 2 + 1, accounts / 2 + 1);
+     for (std::size_t i = 0; i < accounts; ++i) {
+         int number = static_cast<int>(i);
+         if (i % 2 == 0) {
+             bank.createSavingsAccount("Holder", number, Money::fromUnits(std::int64_t(1) << 50), Rate::fromUnits(1));
+         } else {
+             bank.createCheckingAccount("Holder", number, Money(), Money::fromUnits(std::int64_t(1) << 50));
          }
      }
+ }
  
-     // Overridden display
-     void displayAccountInfo() const override {
-         std::cout << "----- SAVINGS ACCOUNT -----\n";
-         BankAccount::displayAccountInfo();
-         std::cout << "Interest Rate   : " << (interestRate * 100) << "%\n";
+ // Pseudo-random account numbers of one parity (0 = savings, 1 = checking) below `accounts`
+ static std::vector<int> sampleAccounts(std::size_t accounts, int parity, std::size_t count) {
+     std::vector<int> numbers(count);
+     std::uint64_t state = 0x9E3779B97F4A7C15ull + parity;
+     for (int &n : numbers) {
+         state = state * 6364136223846793005ull + 1442695040888963407ull;
+         std::size_t pick = static_cast<std::size_t>(state >> 33) % ((accounts + 1 - parity) / 2);
+         n = static_cast<int>(pick * 2 + parity);
      }
+     return numbers;
+ }
  
-     // Let's finalize a single convenient function to handle interest:
-     void handleInterest() {
-         double interest = balance * interestRate;
-         if (interest <= 0) {
-             std::cout << "[Info] No interest to apply.\n";
-             return;
-         }
-         depositInterest(interest);
-     }
- };
+ int main(int argc, char **argv) {
+     std::size_t maxAccounts = argc > 1 ? static_cast<std::size_t>(std::strtoull(argv[1], nullptr, 10)) : 1000000;
+     NullBuffer nullBuffer;
+     std::ostream nullStream(&nullBuffer);
+     volatile std::uintptr_t sink = 0;
+     const std::size_t kSample = 4096;
  
- /******************************************************
-  * CheckingAccount - Derived Class
-  *  - Inherits from BankAccount
-  *  - Has an overdraft limit
-  *  - Overridden withdraw method to allow overdraft
-  ******************************************************/
- class CheckingAccount : public BankAccount {
- private:
-     double overdraftLimit; // The extra limit when balance is insufficient
+     std::cout << std::left << std::setw(28) << "benchmark" << std::right << std::setw(11) << "accounts"
+               << std::setw(12) << "ns/op" << std::setw(12) << "allocs/op" << std::setw(14) << "bytes/acct" << "\n";
  
- public:
-     CheckingAccount(const std::string &holder, int number, double initialBalance, double limit)
-         : BankAccount(holder, number, initialBalance), overdraftLimit(limit) {}
+     for (std::size_t accounts = 1000; accounts <= maxAccounts; accounts *= 10) {
+         // Creation: one fresh Bank per run, all of its heap counted against the accounts
+         {
+             std::uint64_t bytesBefore = benchAllocatedBytes.load(std::memory_order_relaxed);
+             std::uint64_t allocationsBefore = benchAllocations.load(std::memory_order_relaxed);
+             auto start = std::chrono::steady_clock::now();
+             std::unique_ptr<Bank> bank(new Bank);
+             for (std::size_t i = 0; i < accounts; ++i) {
+                 bank->createSavingsAccount("Holder", static_cast<int>(i), Money::fromUnits(100), Rate::fromUnits(1));
+             }
+             std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+             double n = static_cast<double>(accounts);
+             report("createSavingsAccount", accounts,
+                    BenchResult{elapsed.count() * 1e9 / n, (benchAllocations.load() - allocationsBefore) / n},
+                    (benchAllocatedBytes.load() - bytesBefore) / n);
+         }
+         {
+             std::uint64_t bytesBefore = benchAllocatedBytes.load(std::memory_order_relaxed);
+             std::uint64_t allocationsBefore = benchAllocations.load(std::memory_order_relaxed);
+             auto start = std::chrono::steady_clock::now();
+             std::unique_ptr<Bank> bank(new Bank);
+             for (std::size_t i = 0; i < accounts; ++i) {
+                 bank->createCheckingAccount("Holder", static_cast<int>(i), Money::fromUnits(100), Money::fromUnits(100));
+             }
+             std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+             double n = static_cast<double>(accounts);
+             report("createCheckingAccount", accounts,
+                    BenchResult{elapsed.count() * 1e9 / n, (benchAllocations.load() - allocationsBefore) / n},
+                    (benchAllocatedBytes.load() - bytesBefore) / n);
+         }
  
-     // Overridden withdraw to allow overdraft
-     void withdraw(double amount) override {
-         if (amount <= 0) {
-             std::cout << "[Withdraw Error] Amount must be positive.\n";
-             return;
+         std::unique_ptr<Bank> bank(new Bank);
+         bank->setLedgerMemoryCap(std::size_t(64) << 20);  // keep history bounded while hammering
+         populate(*bank, accounts);
+         std::vector<int> savings = sampleAccounts(accounts, 0, kSample);
+         std::vector<int> checking = sampleAccounts(accounts, 1, kSample);
+         std::vector<int> missing(kSample);
+         for (std::size_t i = 0; i < kSample; ++i) {
+             missing[i] = -1 - savings[i];
          }
  
-         if (amount <= balance + overdraftLimit) {
-             // Enough combined funds to withdraw
-             balance -= amount;
- 
-             // Because transactionHistory is private, normal approach is to log:
-             // We'll replicate the deposit's or base withdraw's logging approach.
-             // But we can do something more direct if needed. We'll do the base approach:
-             // super-like call to the base method is tricky because it doesn't handle overdraft.
-             // We'll just push our own transaction. We can replicate deposit logic,
-             // or do a small trick:
-             //   BankAccount::withdraw(amount);
-             // but that doesn't let us go negative. We'll do it manually:
- 
-             // We'll do the logging by calling base class deposit(-amount) but that
-             // won't be correct because deposit expects a positive. We'll do an actual
-             // "Withdrawal" log. To do that, we could implement a protected method for logging.
-             // For demonstration, let's do a direct approach:
-             std::cout << "[Info] Withdrew $"
-                       << std::fixed << std::setprecision(2) << amount
-                       << " from checking account.\n";
-             
-             // Or call the base version if it had a transaction record function. 
-             // Let's keep it consistent with what we do: 
-             // We'll call BankAccount::withdraw in a "safe" way by temporarily
-             // setting the base balance to the needed value. However, that's messy.
-             // Let's just re-implement logging here for clarity.
- 
-             // We'll define a transaction struct here, but we can't push to
-             // transactionHistory since it's private in base. This is a design limitation.
-             // The ideal design is to have a protected method in the base to log transactions.
-             // For demonstration, let's do the simpler approach:
-             // We'll call the base class's withdraw for the logging part, but we first
-             // must temporarily bump the balance so the base won't reject the transaction.
-             double originalBalance = balance + amount; // revert to before subtract
-             BankAccount::balance = originalBalance;
-             BankAccount::withdraw(amount); // logs transaction
-             // Then we set our balance to the new overdrafted one
-             BankAccount::balance = originalBalance - amount;
-         } else {
-             std::cout << "[Withdraw Error] Amount exceeds overdraft limit.\n";
+         report("findAccountByNumber/hit", accounts, measure(kSample, [&] {
+             for (int n : savings) {
+                 sink = sink + reinterpret_cast<std::uintptr_t>(bank->findAccountByNumber(n));
+             }
+         }));
+         report("findAccountByNumber/miss", accounts, measure(kSample, [&] {
+             for (int n : missing) {
+                 sink = sink + reinterpret_cast<std::uintptr_t>(bank->findAccountByNumber(n));
+             }
+         }));
+         report("depositToAccount", accounts, measure(kSample, [&] {
+             for (int n : savings) {
+                 bank->depositToAccount(n, Money::fromUnits(1));
+             }
+         }));
+         report("withdraw/within balance", accounts, measure(kSample, [&] {
+             for (int n : savings) {
+                 bank->withdrawFromAccount(n, Money::fromUnits(1));
+             }
+         }));
+         report("withdraw/overdraft", accounts, measure(kSample, [&] {
+             for (int n : checking) {
+                 bank->withdrawFromAccount(n, Money::fromUnits(1));
+             }
+         }));
+         report("withdraw/rejected", accounts, measure(kSample, [&] {
+             for (int n : savings) {
+                 bank->withdrawFromAccount(n, Money::fromUnits(std::int64_t(1) << 60));
+             }
+         }));
+         {
+             // Fixed-term deposits charge a fee, so each withdrawal journals two records
+             std::unique_ptr<Bank> deposits(new Bank);
+             for (std::size_t i = 0; i < kSample; ++i) {
+                 deposits->createAccount<FixedTermProduct>("Holder", static_cast<int>(i), Money::fromUnits(std::int64_t(1) << 50),
+                                                           Rate::fromUnits(1));
+             }
+             report("withdraw/with fee", accounts, measure(kSample, [&] {
+                 for (std::size_t i = 0; i < kSample; ++i) {
+                     deposits->withdrawFromAccount(static_cast<int>(i), Money::fromUnits(1));
+                 }
+             }));
+         }
+         {
+             // Accounts with daily limits; every other request of the batch is over its
+             // limit, so pre-validation drops it before the row lock
+             std::unique_ptr<Bank> limited(new Bank);
+             limited->setLedgerMemoryCap(std::size_t(64) << 20);
+             std::vector<TxRequest> batch;
+             for (std::size_t i = 0; i < kSample; ++i) {
+                 int number = static_cast<int>(i);
+                 limited->createSavingsAccount("Holder", number, Money::fromUnits(std::int64_t(1) << 50), Rate::fromUnits(1));
+                 limited->setWithdrawalLimits(number, Money::fromUnits(std::int64_t(1) << 40), 0);
+                 batch.push_back(TxRequest{number, TxOp::Withdraw, Money::fromUnits(i % 2 ? std::int64_t(1) << 41 : 1)});
+             }
+             report("applyBatch/limited", accounts, measure(kSample, [&] {
+                 sink = sink + limited->applyBatch(batch).size();
+             }));
+             report("prevalidateBatch", accounts, measure(kSample, [&] {
+                 sink = sink + limited->prevalidateBatch(batch).rejectedCount();
+             }));
+         }
+         {
+             DedupFilter filter(std::chrono::seconds(10), std::size_t(1) << 20);
+             std::uint64_t nextId = 1;
+             report("DedupFilter::claim/fresh", accounts, measure(kSample, [&] {
+                 for (std::size_t i = 0; i < kSample; ++i) {
+                     sink = sink + filter.claim(nextId++);
+                 }
+             }));
+             report("DedupFilter::claim/repeat", accounts, measure(kSample, [&] {
+                 for (std::size_t i = 1; i <= kSample; ++i) {
+                     sink = sink + filter.claim(i);
+                 }
+             }));
+         }
+         bank->enableDeduplication();
+         std::uint64_t clientTxId = 1;
+         report("deposit/client id", accounts, measure(kSample, [&] {
+             for (int n : savings) {
+                 bank->depositToAccount(n, Money::fromUnits(1), clientTxId++);
+             }
+         }));
+         {
+             // Round trip through the scheduler: queue, worker hand-off, future
+             OperationScheduler scheduler(*bank, 2);
+             report("scheduled deposit", accounts, measure(kSample, [&] {
+                 for (int n : savings) {
+                     scheduler.deposit(n, Money::fromUnits(1)).get();
+                 }
+             }));
+             std::future<InterestRunReport> run = scheduler.applyInterestToAllSavings();
+             report("scheduled deposit/bulk", accounts, measure(kSample, [&] {
+                 for (int n : savings) {
+                     scheduler.deposit(n, Money::fromUnits(1)).get();
+                 }
+             }));
+             run.get();
          }
-     }
  
-     // Overridden display
-     void displayAccountInfo() const override {
-         std::cout << "---- CHECKING ACCOUNT ----\n";
-         BankAccount::displayAccountInfo();
-         std::cout << "Overdraft Limit : $" << std::fixed << std::setprecision(2) << overdraftLimit << "\n";
-     }
- };
+         std::vector<SavingsAccount*> savingsViews;
+         for (int n : savings) {
+             savingsViews.push_back(static_cast<SavingsAccount*>(bank->findAccountByNumber(n)));
+         }
+         report("handleInterest", accounts, measure(kSample, [&] {
+             for (SavingsAccount *account : savingsViews) {
+                 sink = sink + static_cast<std::uintptr_t>(account->handleInterest().amount.raw());
+             }
+         }));
+         report("applyInterestToSavings", accounts, measure(kSample, [&] {
+             for (int n : savings) {
+                 sink = sink + static_cast<std::uintptr_t>(bank->applyInterestToSavings(n).amount.raw());
+             }
+         }));
  
+         // A dedicated account with exactly 100 records
+         int historyAccount = static_cast<int>(accounts);
+         bank->createSavingsAccount("History", historyAccount, Money(), Rate());
+         for (int i = 0; i < 100; ++i) {
+             bank->depositToAccount(historyAccount, Money::fromUnits(1));
+         }
+         report("showTransactionHistory/100", accounts, measure(1, [&] {
+             bank->showAccountTransactions(historyAccount, nullStream);
+         }));
+         std::vector<Transaction> recent;
+         report("lastTransactions/10 of 100", accounts, measure(1, [&] {
+             bank->lastTransactions(historyAccount, 10, recent);
+         }));
+         {
+             // Encode the oldest live ledger segment into a standalone cold tier, then decode it
+             const Ledger &ledger = bank->transactionLedger();
+             auto readGuard = ledger.readGuard();
+             std::uint64_t number = ledger.firstLiveSegmentNumber();
+             const Ledger::Segment *segment = ledger.segmentAt(number);
+             std::size_t count = segment ? segment->written.load(std::memory_order_acquire) : 0;
+             if (count >= ColdHistory::kFrameRecords) {
+                 std::uint64_t firstSeq = (number << Ledger::kSegmentShift) + 1;
+                 ColdHistory tier;
+                 report("ColdHistory::prepare/record", accounts, measure(count, [&] {
+                     ColdHistory::Batch batch = tier.prepare(firstSeq, segment->records, segment->prevForAccount,
+                                                             segment->accountRow, count);
+                 }));
+                 tier.add(firstSeq, segment->records, segment->prevForAccount, segment->accountRow, count);
+                 report("ColdHistory::frame/record", accounts, measure(ColdHistory::kFrameRecords, [&] {
+                     sink = sink + static_cast<std::uintptr_t>(tier.frame(firstSeq)->count);
+                 }));
+             }
+         }
+         report("totals", accounts, measure(1, [&] {
+             sink = sink + static_cast<std::uintptr_t>(bank->totals().depositsHeld.raw());
+         }));
+         report("readView/open", accounts, measure(1, [&] {
+             sink = sink + bank->readView().size();
+         }));
+         {
+             // Writes while a view is open: the first one per segment copies it
+             ReadView view = bank->readView();
+             report("deposit/view open", accounts, measure(kSample, [&] {
+                 for (int n : savings) {
+                     bank->depositToAccount(n, Money::fromUnits(1));
+                 }
+             }));
+             report("readView/balance", accounts, measure(accounts, [&] {
+                 sink = sink + static_cast<std::uintptr_t>(view.totalBalance().raw());
+             }));
+         }
+         {
+             // Two hash shards: pair each sampled account with one on the same / the other shard
+             ShardedBank sharded(ShardRouter::hashed(2));
+             populate(sharded, accounts);
+             std::vector<std::pair<int, int>> local, remote;
+             for (std::size_t i = 0; i + 1 < kSample; ++i) {
+                 int a = savings[i], b = savings[i + 1];
+                 (sharded.shardOf(a) == sharded.shardOf(b) ? local : remote).emplace_back(a, b);
+             }
+             report("sharded transfer/same", accounts, measure(local.size(), [&] {
+                 for (const auto &pair : local) {
+                     sharded.transfer(pair.first, pair.second, Money::fromUnits(1));
+                 }
+             }));
+             report("sharded transfer/cross", accounts, measure(remote.size(), [&] {
+                 for (const auto &pair : remote) {
+                     sharded.transfer(pair.first, pair.second, Money::fromUnits(1));
+                 }
+             }));
+         }
+         report("listAllAccounts (per acct)", accounts, measure(accounts, [&] {
+             bank->listAllAccounts(nullStream);
+         }));
+         // Last: the periods closed here leave the unsampled accounts with many pending
+         // periods, which would slow every later read of them
+         report("settleInterest/1 period", accounts, measure(kSample, [&] {
+             bank->accrueInterestPeriod();
+             for (int n : savings) {
+                 sink = sink + static_cast<std::uintptr_t>(bank->settleInterest(n).amount.raw());
+             }
+         }));
+         report("accrueInterestPeriod", accounts, measure(1, [&] {
+             sink = sink + bank->accrueInterestPeriod();
+         }));
+     }
+     return sink == 42 ? 1 : 0;
+ }
+ #elif defined(BANK_LOADGEN)
  /******************************************************
-  * Bank Class
-  *  - Manages a list of BankAccounts (including derived).
-  *  - Offers methods to create accounts, find accounts,
-  *    and handle deposits/withdrawals.
+  * Load generator build (-DBANK_LOADGEN)
+  *  - Replaces the menu with a non-interactive driver:
+  *      g++ -std=c++17 -O2 -march=native -pthread -DBANK_LOADGEN \
+  *          BankAccountSystem.cpp -o bank_loadgen
+  *      ./bank_loadgen --accounts 1000000 --threads 8 --ops 10000000
+  *  - Options (defaults in brackets):
+  *      --accounts N      accounts to create [100000]
+  *      --savings F       fraction that are savings [0.5]
+  *      --threads T       driver threads [hardware threads]
+  *      --ops M           synthetic operations in total [1000000]
+  *      --zipf S          Zipf exponent of account popularity,
+  *                        0 = uniform [0.99]
+  *      --mix D:W:T:I     deposit:withdraw:transfer:interest
+  *                        weights [40:40:15:5]
+  *      --replay FILE     replay a recorded stream instead; one
+  *                        op per line: "deposit A AMT",
+  *                        "withdraw A AMT", "transfer A B AMT",
+  *                        "interest A" (A, B < accounts)
+  *      --durable PREFIX  enable the snapshot + write-ahead log
+  *      --seed N          random seed [1]
+  *      --metrics 0|1     print the Prometheus metrics export
+  *                        after the report [0]
+  *      --metrics-port P  serve /metrics on 127.0.0.1:P while
+  *                        running, 0 = off [0]
+  *      --batch 0|1       run interest runs back to back
+  *                        alongside the load [0]
+  *      --scheduled 0|1   send the ops (Customer) and the batch
+  *                        runs (chunked Bulk jobs) through an
+  *                        OperationScheduler [0]
+  *  - Streams are generated before timing; each op is timed
+  *    individually and throughput plus p50/p99/p999
+  *    latency are reported
   ******************************************************/
- class Bank {
+ 
+ // Zipf(s) ranks in [1, n] by rejection-inversion (Hormann & Derflinger), O(1) memory
+ class ZipfSampler {
  private:
-     std::vector<BankAccount*> accounts;
+     double exponent;
+     double n;
+     double hIntegralX1;
+     double hIntegralN;
+     double threshold;
+ 
+     static double helper1(double x) { return std::fabs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x)); }
+     static double helper2(double x) { return std::fabs(x) > 1e-8 ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x / 3.0 * (1 + 0.25 * x)); }
+     double h(double x) const { return std::exp(-exponent * std::log(x)); }
+     double hIntegral(double x) const {
+         double logX = std::log(x);
+         return helper2((1 - exponent) * logX) * logX;
+     }
+     double hIntegralInverse(double x) const {
+         double t = x * (1 - exponent);
+         if (t < -1) {
+             t = -1;
+         }
+         return std::exp(helper1(t) * x);
+     }
  
  public:
-     Bank() {}
-     ~Bank() {
-         // Cleanup all allocated account objects
-         for (auto acc : accounts) {
-             delete acc;
+     ZipfSampler(std::size_t elements, double s)
+         : exponent(s), n(static_cast<double>(elements)),
+           hIntegralX1(hIntegral(1.5) - 1.0), hIntegralN(hIntegral(n + 0.5)),
+           threshold(2 - hIntegralInverse(hIntegral(2.5) - h(2))) {}
+ 
+     // `uniform` returns doubles in [0, 1)
+     template <typename Uniform>
+     std::size_t operator()(Uniform &uniform) const {
+         for (;;) {
+             double u = hIntegralN + uniform() * (hIntegralX1 - hIntegralN);
+             double x = hIntegralInverse(u);
+             double k = std::floor(x + 0.5);
+             if (k < 1) {
+                 k = 1;
+             } else if (k > n) {
+                 k = n;
+             }
+             if (k - x <= threshold || u >= hIntegral(k + 0.5) - h(k)) {
+                 return static_cast<std::size_t>(k);
+             }
          }
-         accounts.clear();
      }
+ };
+ 
+ struct LoadOp {
+     TxOp op;
+     bool transfer;  // op is ignored for transfers
+     int account;
+     int otherAccount;
+     Money amount;
+ };
  
-     // Create and store a new SavingsAccount
-     void createSavingsAccount(const std::string &holder, int number, double initialBalance, double interestRate) {
-         BankAccount* newAccount = new SavingsAccount(holder, number, initialBalance, interestRate);
-         accounts.push_back(newAccount);
-         std::cout << "[Success] Created SavingsAccount #" << number << " for " << holder << "\n";
+ struct LoadOptions {
+     std::size_t accounts = 100000;
+     double savingsFraction = 0.5;
+     unsigned threads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+     std::size_t ops = 1000000;
+     double zipf = 0.99;
+     unsigned mix[4] = {40, 40, 15, 5};
+     std::string replayPath;
+     std::string durablePrefix;
+     std::uint64_t seed = 1;
+     bool metrics = false;        // print the Prometheus export after the report
+     unsigned metricsPort = 0;    // serve /metrics on this loopback port while running (0 = off)
+     bool batch = false;          // run interest runs back to back while the ops are measured
+     bool scheduled = false;      // route ops and batch runs through an OperationScheduler
+ };
+ 
+ static bool parseLoadOptions(int argc, char **argv, LoadOptions &o) {
+     for (int i = 1; i + 1 < argc; i += 2) {
+         std::string key = argv[i];
+         const char *value = argv[i + 1];
+         if (key == "--accounts") {
+             o.accounts = std::strtoull(value, nullptr, 10);
+         } else if (key == "--savings") {
+             o.savingsFraction = std::strtod(value, nullptr);
+         } else if (key == "--threads") {
+             o.threads = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+         } else if (key == "--ops") {
+             o.ops = std::strtoull(value, nullptr, 10);
+         } else if (key == "--zipf") {
+             o.zipf = std::strtod(value, nullptr);
+         } else if (key == "--mix") {
+             if (std::sscanf(value, "%u:%u:%u:%u", &o.mix[0], &o.mix[1], &o.mix[2], &o.mix[3]) != 4) {
+                 return false;
+             }
+         } else if (key == "--replay") {
+             o.replayPath = value;
+         } else if (key == "--durable") {
+             o.durablePrefix = value;
+         } else if (key == "--seed") {
+             o.seed = std::strtoull(value, nullptr, 10);
+         } else if (key == "--metrics") {
+             o.metrics = std::strtoul(value, nullptr, 10) != 0;
+         } else if (key == "--metrics-port") {
+             o.metricsPort = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+         } else if (key == "--batch") {
+             o.batch = std::strtoul(value, nullptr, 10) != 0;
+         } else if (key == "--scheduled") {
+             o.scheduled = std::strtoul(value, nullptr, 10) != 0;
+         } else {
+             return false;
+         }
      }
+     return (argc % 2) == 1 && o.accounts > 1 && o.accounts <= static_cast<std::size_t>(std::numeric_limits<int>::max())
+         && o.threads > 0 && o.mix[0] + o.mix[1] + o.mix[2] + o.mix[3] > 0 && o.metricsPort <= 65535;
+ }
  
-     // Create and store a new CheckingAccount
-     void createCheckingAccount(const std::string &holder, int number, double initialBalance, double overdraftLimit) {
-         BankAccount* newAccount = new CheckingAccount(holder, number, initialBalance, overdraftLimit);
-         accounts.push_back(newAccount);
-         std::cout << "[Success] Created CheckingAccount #" << number << " for " << holder << "\n";
+ // Synthetic stream for one thread
+ static std::vector<LoadOp> generateOps(const LoadOptions &o, std::size_t count, std::uint64_t seed) {
+     std::mt19937_64 rng(seed);
+     std::uniform_real_distribution<double> unit(0.0, 1.0);
+     auto uniform = [&] { return unit(rng); };
+     ZipfSampler zipf(o.accounts, o.zipf > 0 ? o.zipf : 1.0);
+ 
+     // Scatter ranks over account numbers so popular accounts don't share neighbouring rows
+     std::uint64_t stride = 2654435761u % o.accounts;
+     auto gcd = [](std::uint64_t a, std::uint64_t b) { while (b) { std::uint64_t t = a % b; a = b; b = t; } return a; };
+     while (stride == 0 || gcd(stride, o.accounts) != 1) {
+         ++stride;
      }
+     auto pick = [&]() -> int {
+         std::size_t rank = o.zipf > 0 ? zipf(uniform) - 1 : static_cast<std::size_t>(rng() % o.accounts);
+         return static_cast<int>((rank * stride) % o.accounts);
+     };
  
-     // Find an account by number (returns pointer or nullptr if not found)
-     BankAccount* findAccountByNumber(int number) const {
-         for (auto acc : accounts) {
-             if (acc->getAccountNumber() == number) {
-                 return acc;
+     unsigned total = o.mix[0] + o.mix[1] + o.mix[2] + o.mix[3];
+     std::vector<LoadOp> ops(count);
+     for (LoadOp &op : ops) {
+         unsigned r = static_cast<unsigned>(rng() % total);
+         op.transfer = false;
+         op.account = pick();
+         op.otherAccount = op.account;
+         op.amount = Money::fromUnits(static_cast<std::int64_t>(1 + rng() % (100 * Money::scale)));
+         if (r < o.mix[0]) {
+             op.op = TxOp::Deposit;
+         } else if (r < o.mix[0] + o.mix[1]) {
+             op.op = TxOp::Withdraw;
+         } else if (r < o.mix[0] + o.mix[1] + o.mix[2]) {
+             op.transfer = true;
+             while (op.otherAccount == op.account) {
+                 op.otherAccount = pick();
              }
+         } else {
+             op.op = TxOp::Interest;
          }
-         return nullptr;
      }
+     return ops;
+ }
  
-     // Deposit to a specific account
-     void depositToAccount(int accountNumber, double amount) {
-         BankAccount *acc = findAccountByNumber(accountNumber);
-         if (acc) {
-             acc->deposit(amount);
+ // Recorded stream, dealt round-robin to the threads; false on a malformed line
+ static bool readReplay(const LoadOptions &o, std::vector<std::vector<LoadOp>> &perThread) {
+     std::FILE *file = std::fopen(o.replayPath.c_str(), "r");
+     if (!file) {
+         return false;
+     }
+     char line[256], verb[32];
+     std::size_t next = 0;
+     bool ok = true;
+     while (ok && std::fgets(line, sizeof(line), file)) {
+         LoadOp op{TxOp::Deposit, false, 0, 0, Money()};
+         double amount = 0;
+         int fields = std::sscanf(line, "%31s", verb);
+         if (fields != 1 || verb[0] == '#') {
+             continue;
+         }
+         std::string v = verb;
+         if (v == "deposit" || v == "withdraw") {
+             op.op = v == "deposit" ? TxOp::Deposit : TxOp::Withdraw;
+             ok = std::sscanf(line, "%*s %d %lf", &op.account, &amount) == 2;
+         } else if (v == "transfer") {
+             op.transfer = true;
+             ok = std::sscanf(line, "%*s %d %d %lf", &op.account, &op.otherAccount, &amount) == 3;
+         } else if (v == "interest") {
+             op.op = TxOp::Interest;
+             ok = std::sscanf(line, "%*s %d", &op.account) == 1;
          } else {
-             std::cout << "[Error] Account #" << accountNumber << " not found.\n";
+             ok = false;
          }
+         op.amount = Money::fromDouble(amount);
+         perThread[next++ % perThread.size()].push_back(op);
      }
+     std::fclose(file);
+     return ok;
+ }
  
-     // Withdraw from a specific account
-     void withdrawFromAccount(int accountNumber, double amount) {
-         BankAccount *acc = findAccountByNumber(accountNumber);
-         if (acc) {
-             acc->withdraw(amount);
+ static double percentile(const std::vector<std::uint32_t> &sorted, double p) {
+     if (sorted.empty()) {
+         return 0.0;
+     }
+     std::size_t i = static_cast<std::size_t>(p * (sorted.size() - 1) + 0.5);
+     return sorted[i] / 1000.0;
+ }
+ 
+ int main(int argc, char **argv) {
+     LoadOptions o;
+     if (!parseLoadOptions(argc, argv, o)) {
+         std::cerr << "usage: " << argv[0] << " [--accounts N] [--savings F] [--threads T] [--ops M] [--zipf S]\n"
+                   << "       [--mix D:W:T:I] [--replay FILE] [--durable PREFIX] [--seed N]\n"
+                   << "       [--metrics 0|1] [--metrics-port P] [--batch 0|1] [--scheduled 0|1]\n";
+         return 2;
+     }
+ 
+     BankMetrics metrics;  // declared first so it outlives the bank's metrics endpoint
+     Bank bank;
+     if (!o.durablePrefix.empty()
+         && bank.enableDurability(o.durablePrefix + ".snapshot", o.durablePrefix + ".wal") != SnapshotStatus::Ok) {
+         std::cerr << "[Error] Could not enable durability at " << o.durablePrefix << "\n";
+         return 1;
+     }
+     auto setupStart = std::chrono::steady_clock::now();
+     std::size_t savings = static_cast<std::size_t>(o.accounts * o.savingsFraction);
+     bank.reserveAccounts(savings, o.accounts - savings);
+     for (std::size_t i = 0; i < o.accounts; ++i) {
+         int number = static_cast<int>(i);
+         // Spread the kinds evenly so savings and checking both get popular accounts
+         if ((i + 1) * savings / o.accounts != i * savings / o.accounts) {
+             bank.createSavingsAccount("Load", number, Money::fromUnits(1000 * Money::scale), Rate::fromDouble(0.0001));
          } else {
-             std::cout << "[Error] Account #" << accountNumber << " not found.\n";
+             bank.createCheckingAccount("Load", number, Money::fromUnits(1000 * Money::scale), Money::fromUnits(500 * Money::scale));
          }
      }
+     std::chrono::duration<double> setup = std::chrono::steady_clock::now() - setupStart;
  
-     // Display info about a specific account
-     void displayAccount(int accountNumber) const {
-         BankAccount *acc = findAccountByNumber(accountNumber);
-         if (acc) {
-             acc->displayAccountInfo();
-         } else {
-             std::cout << "[Error] Account #" << accountNumber << " not found.\n";
+     // Attach metrics after setup so the counters cover only the measured run
+     if (o.metrics || o.metricsPort != 0) {
+         bank.setMetrics(&metrics);
+     }
+     if (o.metricsPort != 0 && !bank.serveMetrics(static_cast<std::uint16_t>(o.metricsPort))) {
+         std::cerr << "[Error] Could not serve metrics on port " << o.metricsPort << "\n";
+         return 1;
+     }
+ 
+     std::vector<std::vector<LoadOp>> streams(o.threads);
+     if (!o.replayPath.empty()) {
+         if (!readReplay(o, streams)) {
+             std::cerr << "[Error] Could not read replay file " << o.replayPath << "\n";
+             return 1;
+         }
+     } else {
+         std::vector<std::thread> generators;
+         for (unsigned t = 0; t < o.threads; ++t) {
+             std::size_t count = o.ops / o.threads + (t < o.ops % o.threads ? 1 : 0);
+             generators.emplace_back([&, t, count] { streams[t] = generateOps(o, count, o.seed * 1000003 + t); });
+         }
+         for (auto &g : generators) {
+             g.join();
          }
      }
  
-     // Show transaction history of a specific account
-     void showAccountTransactions(int accountNumber) const {
-         BankAccount *acc = findAccountByNumber(accountNumber);
-         if (acc) {
-             acc->showTransactionHistory();
-         } else {
-             std::cout << "[Error] Account #" << accountNumber << " not found.\n";
+     if (o.batch) {
+         bank.setLedgerMemoryCap(std::size_t(256) << 20);  // each run adds a record per savings account
+     }
+     // One worker per driver: Bulk may then take all but one of them
+     std::unique_ptr<OperationScheduler> scheduler;
+     if (o.scheduled) {
+         scheduler.reset(new OperationScheduler(bank, o.threads));
+     }
+     auto execute = [&](const LoadOp &op) -> TxStatus {
+         if (scheduler) {
+             if (op.transfer) {
+                 return scheduler->transfer(op.account, op.otherAccount, op.amount).get();
+             } else if (op.op == TxOp::Deposit) {
+                 return scheduler->deposit(op.account, op.amount).get();
+             } else if (op.op == TxOp::Withdraw) {
+                 return scheduler->withdraw(op.account, op.amount).get();
+             }
+             int account = op.account;
+             return scheduler->submit(Priority::Customer, [&bank, account] { return bank.applyInterestToSavings(account).status; }).get();
          }
+         if (op.transfer) {
+             return bank.transfer(op.account, op.otherAccount, op.amount);
+         } else if (op.op == TxOp::Deposit) {
+             return bank.depositToAccount(op.account, op.amount);
+         } else if (op.op == TxOp::Withdraw) {
+             return bank.withdrawFromAccount(op.account, op.amount);
+         }
+         return bank.applyInterestToSavings(op.account).status;
+     };
+ 
+     std::vector<std::vector<std::uint32_t>> latencies(o.threads);
+     std::vector<std::size_t> rejected(o.threads, 0);
+     std::atomic<unsigned> ready(0);
+     std::atomic<bool> go(false);
+     std::vector<std::thread> drivers;
+     for (unsigned t = 0; t < o.threads; ++t) {
+         drivers.emplace_back([&, t] {
+             const std::vector<LoadOp> &stream = streams[t];
+             std::vector<std::uint32_t> &samples = latencies[t];
+             samples.reserve(stream.size());
+             ready.fetch_add(1);
+             while (!go.load(std::memory_order_acquire)) {
+                 std::this_thread::yield();
+             }
+             for (const LoadOp &op : stream) {
+                 auto start = std::chrono::steady_clock::now();
+                 TxStatus status = execute(op);
+                 auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+                 samples.push_back(static_cast<std::uint32_t>(ns < 0xFFFFFFFF ? ns : 0xFFFFFFFF));
+                 rejected[t] += status != TxStatus::Ok;
+             }
+         });
+     }
+     while (ready.load() != o.threads) {
+         std::this_thread::yield();
+     }
+     auto runStart = std::chrono::steady_clock::now();
+     go.store(true, std::memory_order_release);
+     std::atomic<bool> driving(true);
+     std::size_t batchRuns = 0;
+     std::thread batch;
+     if (o.batch) {
+         batch = std::thread([&] {
+             while (driving.load(std::memory_order_acquire)) {
+                 if (scheduler) {
+                     scheduler->applyInterestToAllSavings().get();
+                 } else {
+                     bank.applyInterestToAllSavings();
+                 }
+                 ++batchRuns;
+             }
+         });
+     }
+     for (auto &d : drivers) {
+         d.join();
+     }
+     std::chrono::duration<double> run = std::chrono::steady_clock::now() - runStart;
+     driving.store(false, std::memory_order_release);
+     if (batch.joinable()) {
+         batch.join();
      }
  
-     // Specialized method for SavingsAccount to apply interest
-     void applyInterestToSavings(int accountNumber) {
-         BankAccount *acc = findAccountByNumber(accountNumber);
-         if (!acc) {
-             std::cout << "[Error] Account #" << accountNumber << " not found.\n";
-             return;
+     std::vector<std::uint32_t> all;
+     std::size_t totalRejected = 0;
+     for (unsigned t = 0; t < o.threads; ++t) {
+         all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+         totalRejected += rejected[t];
+     }
+     std::sort(all.begin(), all.end());
+ 
+     std::cout << std::fixed << std::setprecision(2)
+               << "accounts      : " << o.accounts << " (" << savings << " savings), created in " << setup.count() << " s\n"
+               << "threads       : " << o.threads << (scheduler ? " (scheduled)" : "") << "\n"
+               << "operations    : " << all.size() << " (" << totalRejected << " rejected)\n"
+               << "throughput    : " << (run.count() > 0 ? all.size() / run.count() : 0.0) << " ops/s\n"
+               << "latency (us)  : p50 " << percentile(all, 0.50) << "  p99 " << percentile(all, 0.99)
+               << "  p999 " << percentile(all, 0.999) << "  max " << (all.empty() ? 0.0 : all.back() / 1000.0) << "\n";
+     if (o.batch) {
+         std::cout << "batch runs    : " << batchRuns << " interest runs alongside\n";
+     }
+     if (o.metrics) {
+         bank.writeMetrics(std::cout);
+     }
+     return 0;
+ }
+ #elif defined(BANK_SELFTEST)
+ /******************************************************
+  * Self-test build (-DBANK_SELFTEST)
+  *  - Replaces the menu with persistence checks:
+  *      g++ -std=c++17 -O2 -pthread -DBANK_SELFTEST \
+  *          BankAccountSystem.cpp -o bank_selftest
+  *      ./bank_selftest [prefix]   (default bank_selftest)
+  *  - Recovery round trip: a durable bank takes deposits,
+  *    withdrawals, transfers, limits and interest around a
+  *    checkpoint; a second bank recovered from the same
+  *    snapshot + log must hold the same balances, history
+  *    and totals, and keep sequencing after them
+  *  - A torn log tail drops only the last operation
+ *  - Withdrawals near the top of Money's range (with a
+ *    fee, or against balance plus overdraft) neither pass
+ *    nor wrap
+  *  - Damaged snapshots (ledger position or first segment
+  *    in the header, a balance byte, a truncated file)
+  *    must fail with BadFormat
+  *  - Prints one PASS/FAIL line per check; exits nonzero
+  *    if any failed. Files are written next to `prefix`
+  *    and removed afterwards
+  ******************************************************/
+ static int selfTestFailures = 0;
+ 
+ static void selfTestCheck(bool ok, const char *what) {
+     std::cout << (ok ? "PASS  " : "FAIL  ") << what << "\n";
+     selfTestFailures += ok ? 0 : 1;
+ }
+ 
+ static bool selfTestRead(const std::string &path, std::vector<char> &bytes) {
+     std::FILE *file = std::fopen(path.c_str(), "rb");
+     if (!file) {
+         return false;
+     }
+     bytes.clear();
+     char buffer[1 << 16];
+     for (std::size_t n; (n = std::fread(buffer, 1, sizeof(buffer), file)) > 0;) {
+         bytes.insert(bytes.end(), buffer, buffer + n);
+     }
+     std::fclose(file);
+     return true;
+ }
+ 
+ static bool selfTestWrite(const std::string &path, const std::vector<char> &bytes) {
+     std::FILE *file = std::fopen(path.c_str(), "wb");
+     if (!file) {
+         return false;
+     }
+     bool ok = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+     return std::fclose(file) == 0 && ok;
+ }
+ 
+ // Every balance plus every record of every account, for comparing two banks
+ static std::string selfTestState(const Bank &bank, const std::vector<int> &accounts) {
+     std::ostringstream out;
+     for (int number : accounts) {
+         const BankAccount *account = bank.findAccountByNumber(number);
+         if (!account) {
+             out << number << " missing\n";
+             continue;
+         }
+         out << number << " " << account->getBalance() << "\n";
+         std::vector<Transaction> records;
+         bank.lastTransactions(number, std::numeric_limits<std::size_t>::max(), records);
+         for (const Transaction &tx : records) {
+             out << "  " << tx.id << " " << static_cast<int>(tx.type()) << " " << tx.amount << " " << tx.resultingBalance << "\n";
          }
+     }
+     out << "total " << bank.totals().totalBalance() << "\n";
+     return out.str();
+ }
  
-         // Use dynamic_cast to confirm it's a SavingsAccount
-         SavingsAccount *sa = dynamic_cast<SavingsAccount*>(acc);
-         if (!sa) {
-             std::cout << "[Error] Account #" << accountNumber << " is not a SavingsAccount.\n";
-             return;
+ // The damaged image at `path` (from `image` with byte `at` flipped) must load as BadFormat
+ static void selfTestDamaged(const std::string &path, std::vector<char> image, std::size_t at, const char *what) {
+     image[at] ^= 0x40;
+     Bank bank;
+     selfTestCheck(selfTestWrite(path, image) && bank.loadSnapshot(path) == SnapshotStatus::BadFormat, what);
+ }
+ 
+ int main(int argc, char **argv) {
+     const std::string prefix = argc > 1 ? argv[1] : "bank_selftest";
+     const std::string snapshotPath = prefix + ".snapshot", walPath = prefix + ".wal";
+     const std::string imagePath = prefix + ".image", damagedPath = prefix + ".damaged";
+     std::remove(snapshotPath.c_str());
+     std::remove(walPath.c_str());
+     const std::vector<int> accounts = {100, 101, 102, 103, 104};
+     std::string before;
+ 
+     {
+         Bank bank;
+         selfTestCheck(bank.enableDurability(snapshotPath, walPath) == SnapshotStatus::Ok, "durability on an empty bank");
+         bank.createSavingsAccount("Ada", 100, Money::fromUnits(1000 * Money::scale), Rate::fromUnits(Rate::scale / 50));
+         bank.createCheckingAccount("Ben", 101, Money::fromUnits(250 * Money::scale), Money::fromUnits(100 * Money::scale));
+         bank.createAccount<MoneyMarketProduct>("Cy", 102, Money::fromUnits(5000 * Money::scale), Rate::fromUnits(Rate::scale / 25));
+         bank.createSavingsAccount("Ada", 103, Money(), Rate::fromUnits(Rate::scale / 100));
+         for (int i = 0; i < 200; ++i) {
+             bank.depositToAccount(accounts[i % 4], Money::fromUnits(1 + i));
+             bank.withdrawFromAccount(101, Money::fromUnits(3));
+             bank.transfer(102, 103, Money::fromUnits(7));
          }
+         bank.setWithdrawalLimits(101, Money::fromUnits(10 * Money::scale), 5);
+         bank.accrueInterestPeriod();
+         selfTestCheck(bank.checkpoint() == SnapshotStatus::Ok, "checkpoint");
+         // After the checkpoint: only the log holds these
+         bank.createCheckingAccount("Dee", 104, Money::fromUnits(75 * Money::scale), Money());
+         bank.settleInterest(100);
+         bank.accrueInterestPeriod();
+         bank.transfer(100, 104, Money::fromUnits(12345));
+         bank.withdrawFromAccount(101, Money::fromUnits(2 * Money::scale));
+         bank.applyInterestToAllSavings();
+         selfTestCheck(bank.saveSnapshot(imagePath) == SnapshotStatus::Ok, "save a snapshot copy");
+         before = selfTestState(bank, accounts);
+     }
  
-         sa->handleInterest(); // apply interest
+     {
+         Bank bank;
+         selfTestCheck(bank.enableDurability(snapshotPath, walPath) == SnapshotStatus::Ok, "recover snapshot + log");
+         selfTestCheck(selfTestState(bank, accounts) == before, "recovered balances, history and totals match");
+         selfTestCheck(bank.withdrawFromAccount(101, Money::fromUnits(9 * Money::scale)) == TxStatus::DailyLimitExceeded,
+                       "recovered withdrawal limits and usage");
+         selfTestCheck(bank.depositToAccount(104, Money::fromUnits(1)) == TxStatus::Ok, "deposit after recovery");
      }
  
-     // Simple listing of all accounts
-     void listAllAccounts() const {
-         if (accounts.empty()) {
-             std::cout << "[Info] No accounts in the bank.\n";
-             return;
-         }
+     std::vector<char> log;
+     if (selfTestRead(walPath, log) && !log.empty()) {
+         log.pop_back();  // tear the last frame (the deposit above)
+         selfTestWrite(walPath, log);
+     }
+     {
+         Bank bank;
+         selfTestCheck(bank.enableDurability(snapshotPath, walPath) == SnapshotStatus::Ok, "recover with a torn log tail");
+         selfTestCheck(selfTestState(bank, accounts) == before, "torn tail drops only the last operation");
+     }
  
-         std::cout << "----- Listing All Accounts -----\n";
-         for (auto acc : accounts) {
-             acc->displayAccountInfo();
-             std::cout << "--------------------------------\n";
+     std::vector<char> image;
+     if (!selfTestRead(imagePath, image) || image.size() < SnapshotHeader::kPageBytes) {
+         selfTestCheck(false, "read the snapshot copy");
+     } else {
+         {
+             Bank bank;
+             selfTestCheck(bank.loadSnapshot(imagePath) == SnapshotStatus::Ok && selfTestState(bank, accounts) == before,
+                           "intact snapshot loads");
          }
+         SnapshotHeader header;
+         std::memcpy(&header, image.data(), sizeof(header));
+         selfTestDamaged(damagedPath, image, offsetof(SnapshotHeader, ledgerNextSequence) + 7,
+                         "rejects a damaged ledger position");
+         selfTestDamaged(damagedPath, image, offsetof(SnapshotHeader, ledgerFirstSegment) + 1,
+                         "rejects a damaged first ledger segment");
+         selfTestDamaged(damagedPath, image, static_cast<std::size_t>(header.columnOffset[2]) + 1,
+                         "rejects a damaged balance");
+         std::vector<char> truncated(image.begin(), image.end() - 1);
+         Bank bank;
+         selfTestCheck(selfTestWrite(damagedPath, truncated) && bank.loadSnapshot(damagedPath) == SnapshotStatus::BadFormat,
+                       "rejects a truncated snapshot");
      }
- };
+ 
+     {
+         const std::int64_t top = std::numeric_limits<std::int64_t>::max();
+         const Money held = Money::fromUnits(100 * Money::scale);
+         Bank bank;
+         bank.createAccount<FixedTermProduct>("Eve", 200, held, Rate());
+         bank.createCheckingAccount("Fay", 201, Money::fromUnits(top - 1000), Money::fromUnits(5000));
+         selfTestCheck(bank.withdrawFromAccount(200, Money::fromUnits(top - 10)) != TxStatus::Ok
+                       && bank.findAccountByNumber(200)->getBalance() == held,
+                       "rejects an over-range withdrawal with a fee");
+         selfTestCheck(bank.withdrawFromAccount(201, Money::fromUnits(1)) == TxStatus::Ok
+                       && bank.findAccountByNumber(201)->getBalance() == Money::fromUnits(top - 1001),
+                       "withdraws from a balance near the top of the range");
+     }
+ 
+     for (const std::string &path : {snapshotPath, walPath, imagePath, damagedPath}) {
+         std::remove(path.c_str());
+     }
+     std::cout << (selfTestFailures == 0 ? "all checks passed\n" : "some checks FAILED\n");
+     return selfTestFailures == 0 ? 0 : 1;
+ }
+ #else
+  /******************************************************
+  * Menu output - Bank operations return statuses; the
+  * menu is the only place their results are printed
+  ******************************************************/
+ static void printError(const char *operation, TxStatus status, int accountNumber) {
+     switch (status) {
+         case TxStatus::AccountNotFound:
+             std::cout << "[Error] Account #" << accountNumber << " not found.\n";
+             break;
+         case TxStatus::NotSavingsAccount:
+             std::cout << "[Error] Account #" << accountNumber << " is not a SavingsAccount.\n";
+             break;
+         case TxStatus::AccountExists:
+             std::cout << "[Error] Account #" << accountNumber << " already exists.\n";
+             break;
+         default:
+             std::cout << "[" << operation << " Error] " << txStatusMessage(status) << ".\n";
+             break;
+     }
+ }
  
  /******************************************************
   * Main - Basic text-based menu to demonstrate usage
@@ -462,6 +8790,18 @@ Improve Architecture: Split classes into .hpp/.cpp files, apply design patterns,
          std::cout << "7) Apply Interest (Savings Only)\n";
          std::cout << "8) List All Accounts\n";
          std::cout << "9) Exit\n";
+         std::cout << "10) Transfer Between Accounts\n";
+         std::cout << "11) Save Snapshot\n";
+         std::cout << "12) Load Snapshot (empty bank only)\n";
+         std::cout << "13) Enable Durability (snapshot + write-ahead log)\n";
+         std::cout << "14) Show Recent Transactions\n";
+         std::cout << "15) Show Bank Totals\n";
+         std::cout << "16) Import Accounts (CSV)\n";
+         std::cout << "17) List Accounts by Holder\n";
+         std::cout << "18) Close Interest Period (credited on next access)\n";
+         std::cout << "19) Create Money Market Account\n";
+         std::cout << "20) Create Fixed-Term Deposit\n";
+         std::cout << "21) Set Withdrawal Limits\n";
          std::cout << "Enter your choice: ";
  
          if (!(std::cin >> choice)) {
@@ -492,7 +8832,12 @@ Improve Architecture: Split classes into .hpp/.cpp files, apply design patterns,
                  std::cout << "Enter interest rate (e.g. 0.03 for 3%): ";
                  std::cin >> rate;
  
-                 myBank.createSavingsAccount(holder, acctNum, initBal, rate);
+                 TxStatus status = myBank.createSavingsAccount(holder, acctNum, Money::fromDouble(initBal), Rate::fromDouble(rate));
+                 if (status == TxStatus::Ok) {
+                     std::cout << "[Success] Created SavingsAccount #" << acctNum << " for " << holder << "\n";
+                 } else {
+                     printError("Create", status, acctNum);
+                 }
                  break;
              }
              case 2: {
@@ -509,7 +8854,12 @@ Improve Architecture: Split classes into .hpp/.cpp files, apply design patterns,
                  std::cout << "Enter overdraft limit: ";
                  std::cin >> overdraft;
  
-                 myBank.createCheckingAccount(holder, acctNum, initBal, overdraft);
+                 TxStatus status = myBank.createCheckingAccount(holder, acctNum, Money::fromDouble(initBal), Money::fromDouble(overdraft));
+                 if (status == TxStatus::Ok) {
+                     std::cout << "[Success] Created CheckingAccount #" << acctNum << " for " << holder << "\n";
+                 } else {
+                     printError("Create", status, acctNum);
+                 }
                  break;
              }
              case 3: {
@@ -520,7 +8870,10 @@ Improve Architecture: Split classes into .hpp/.cpp files, apply design patterns,
                  std::cout << "Enter deposit amount: ";
                  std::cin >> amount;
  
-                 myBank.depositToAccount(acctNum, amount);
+                 TxStatus status = myBank.depositToAccount(acctNum, Money::fromDouble(amount));
+                 if (status != TxStatus::Ok) {
+                     printError("Deposit", status, acctNum);
+                 }
                  break;
              }
              case 4: {
@@ -531,41 +8884,239 @@ Improve Architecture: Split classes into .hpp/.cpp files, apply design patterns,
                  std::cout << "Enter withdrawal amount: ";
                  std::cin >> amount;
  
-                 myBank.withdrawFromAccount(acctNum, amount);
+                 TxStatus status = myBank.withdrawFromAccount(acctNum, Money::fromDouble(amount));
+                 if (status == TxStatus::Ok) {
+                     std::cout << "[Info] Withdrew $" << Money::fromDouble(amount) << " from account #" << acctNum << ".\n";
+                 } else {
+                     printError("Withdraw", status, acctNum);
+                 }
                  break;
              }
              case 5: {
                  int acctNum;
                  std::cout << "Enter account number: ";
                  std::cin >> acctNum;
-                 myBank.displayAccount(acctNum);
+                 TxStatus status = myBank.displayAccount(acctNum);
+                 if (status != TxStatus::Ok) {
+                     printError("Display", status, acctNum);
+                 }
                  break;
              }
              case 6: {
                  int acctNum;
                  std::cout << "Enter account number: ";
                  std::cin >> acctNum;
-                 myBank.showAccountTransactions(acctNum);
+                 TxStatus status = myBank.showAccountTransactions(acctNum);
+                 if (status != TxStatus::Ok) {
+                     printError("History", status, acctNum);
+                 }
                  break;
              }
              case 7: {
                  int acctNum;
                  std::cout << "Enter account number: ";
                  std::cin >> acctNum;
-                 myBank.applyInterestToSavings(acctNum);
+                 TxResult result = myBank.applyInterestToSavings(acctNum);
+                 if (!result.ok()) {
+                     printError("Interest", result.status, acctNum);
+                 } else if (result.amount > Money()) {
+                     std::cout << "[Info] Successfully applied interest of $" << result.amount << "\n";
+                 } else {
+                     std::cout << "[Info] No interest to apply.\n";
+                 }
                  break;
              }
              case 8: {
                  myBank.listAllAccounts();
                  break;
              }
+             case 10: {
+                 int fromNum, toNum;
+                 double amount;
+                 std::cout << "Enter source account number: ";
+                 std::cin >> fromNum;
+                 std::cout << "Enter destination account number: ";
+                 std::cin >> toNum;
+                 std::cout << "Enter transfer amount: ";
+                 std::cin >> amount;
+ 
+                 TxStatus status = myBank.transfer(fromNum, toNum, Money::fromDouble(amount));
+                 if (status == TxStatus::Ok) {
+                     std::cout << "[Success] Transferred $" << Money::fromDouble(amount)
+                               << " from #" << fromNum << " to #" << toNum << "\n";
+                 } else {
+                     // Report whichever side is missing
+                     printError("Transfer", status, myBank.findAccountByNumber(fromNum) ? toNum : fromNum);
+                 }
+                 break;
+             }
+             case 11:
+             case 12:
+             case 13: {
+                 std::string path;
+                 std::cout << (choice == 13 ? "Enter data file prefix: " : "Enter snapshot file path: ");
+                 std::cin >> path;
+                 SnapshotStatus status = choice == 11 ? myBank.saveSnapshot(path)
+                                       : choice == 12 ? myBank.loadSnapshot(path)
+                                       : myBank.enableDurability(path + ".snapshot", path + ".wal");
+                 switch (status) {
+                     case SnapshotStatus::Ok:
+                         if (choice == 13) {
+                             std::cout << "[Success] Recovered from " << path << ".snapshot/.wal; changes are now logged\n";
+                         } else {
+                             std::cout << "[Success] Snapshot " << (choice == 11 ? "saved to " : "loaded from ") << path << "\n";
+                         }
+                         break;
+                     case SnapshotStatus::IoError:
+                         std::cout << "[Error] Could not access " << path << ".\n";
+                         break;
+                     case SnapshotStatus::BadFormat:
+                         std::cout << "[Error] " << path << " is not a valid snapshot.\n";
+                         break;
+                     case SnapshotStatus::LayoutMismatch:
+                         std::cout << "[Error] " << path << " was written by an incompatible build.\n";
+                         break;
+                     case SnapshotStatus::BankNotEmpty:
+                         std::cout << "[Error] Snapshots can only be loaded into an empty bank (or durability is already on).\n";
+                         break;
+                 }
+                 break;
+             }
+             case 14: {
+                 int acctNum;
+                 std::size_t count;
+                 std::cout << "Enter account number: ";
+                 std::cin >> acctNum;
+                 std::cout << "Enter number of transactions: ";
+                 std::cin >> count;
+                 std::vector<Transaction> recent;
+                 TxStatus status = myBank.lastTransactions(acctNum, count, recent);
+                 if (status != TxStatus::Ok) {
+                     printError("History", status, acctNum);
+                 } else if (recent.empty()) {
+                     std::cout << "No transactions recorded for this account.\n";
+                 } else {
+                     std::cout << "Last " << recent.size() << " transactions for Account #" << acctNum << ":\n";
+                     for (const Transaction &tx : recent) {
+                         printTransaction(std::cout, tx);
+                     }
+                 }
+                 break;
+             }
+             case 15: {
+                 BankTotals totals = myBank.totals();
+                 std::cout << "Accounts           : " << totals.accountCount() << " (";
+                 for (std::size_t k = 0; k < kAccountKinds; ++k) {
+                     AccountKind kind = static_cast<AccountKind>(k);
+                     if (kind == AccountKind::Savings || kind == AccountKind::Checking || totals.accounts(kind) != 0) {
+                         std::cout << (k ? ", " : "") << totals.accounts(kind) << " " << productRules(kind).name;
+                     }
+                 }
+                 std::cout << ")\n"
+                           << "Total Balance      : $" << totals.totalBalance() << "\n"
+                           << "Deposits Held      : $" << totals.depositsHeld << "\n"
+                           << "Overdrawn          : $" << totals.overdrawn << " across " << totals.overdrawnAccounts << " accounts"
+                           << " (limits $" << totals.overdraftLimits << ")\n"
+                           << "Projected Interest : $" << totals.projectedInterest << "\n";
+                 break;
+             }
+             case 16: {
+                 std::string path;
+                 std::cout << "Enter CSV file path: ";
+                 std::cin >> path;
+                 ImportReport report = myBank.importAccounts(path);
+                 if (!report.fileRead) {
+                     std::cout << "[Error] Could not read " << path << ".\n";
+                 } else if (report.status == TxStatus::CapacityExceeded) {
+                     std::cout << "[Error] Import would exceed the account table; nothing was imported.\n";
+                 } else {
+                     std::cout << "[Success] Imported " << report.accepted << " accounts in " << report.seconds << " s ("
+                               << report.malformed << " malformed, " << report.duplicates << " duplicate lines)\n";
+                     if (report.firstRejectedLine != 0) {
+                         std::cout << "[Info] First rejected line: " << report.firstRejectedLine << "\n";
+                     }
+                     if (report.status != TxStatus::Ok) {
+                         std::cout << "[Import Error] " << txStatusMessage(report.status) << ".\n";
+                     }
+                 }
+                 break;
+             }
+             case 17: {
+                 std::string holder;
+                 std::cout << "Enter account holder name: ";
+                 std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // flush leftover
+                 std::getline(std::cin, holder);
+                 std::vector<int> numbers = myBank.accountsOfHolder(holder);
+                 if (numbers.empty()) {
+                     std::cout << "[Info] No accounts held by " << holder << ".\n";
+                 } else {
+                     std::cout << holder << " holds " << numbers.size() << " account(s):";
+                     for (int number : numbers) {
+                         std::cout << " #" << number;
+                     }
+                     std::cout << "\n";
+                 }
+                 break;
+             }
+             case 18: {
+                 std::uint32_t epoch = myBank.accrueInterestPeriod();
+                 std::cout << "[Info] Closed interest period " << epoch
+                           << "; savings accounts are credited when next used.\n";
+                 break;
+             }
+             case 19:
+             case 20: {
+                 AccountKind kind = choice == 19 ? AccountKind::MoneyMarket : AccountKind::FixedTerm;
+                 std::string holder;
+                 int acctNum;
+                 double initBal, rate;
+                 std::cout << "Enter account holder name: ";
+                 std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n'); // flush leftover
+                 std::getline(std::cin, holder);
+                 std::cout << "Enter account number: ";
+                 std::cin >> acctNum;
+                 std::cout << "Enter initial balance: ";
+                 std::cin >> initBal;
+                 std::cout << "Enter interest rate (e.g. 0.03 for 3%): ";
+                 std::cin >> rate;
+ 
+                 TxStatus status = myBank.createAccount(kind, holder, acctNum, Money::fromDouble(initBal),
+                                                        Rate::fromDouble(rate), Money());
+                 if (status == TxStatus::Ok) {
+                     std::cout << "[Success] Created " << productRules(kind).name << " account #" << acctNum
+                               << " for " << holder << "\n";
+                 } else {
+                     printError("Create", status, acctNum);
+                 }
+                 break;
+             }
+             case 21: {
+                 int acctNum;
+                 double daily;
+                 std::uint32_t perWindow;
+                 std::cout << "Enter account number: ";
+                 std::cin >> acctNum;
+                 std::cout << "Enter daily withdrawal limit (0 for none): ";
+                 std::cin >> daily;
+                 std::cout << "Enter withdrawals allowed per minute (0 for none): ";
+                 std::cin >> perWindow;
+ 
+                 TxStatus status = myBank.setWithdrawalLimits(acctNum, Money::fromDouble(daily), perWindow);
+                 if (status == TxStatus::Ok) {
+                     std::cout << "[Success] Updated withdrawal limits of account #" << acctNum << "\n";
+                 } else {
+                     printError("Limits", status, acctNum);
+                 }
+                 break;
+             }
              default:
                  std::cout << "[Error] Invalid choice. Please try again.\n";
                  break;
          }
      }
  
-     // Program ends, Bank destructor cleans up account pointers
+     // Program ends, Bank destructor releases the account pools
      return 0;
  }
- 
\ No newline at end of file
+ 
+ #endif